@@ -0,0 +1,88 @@
+#!/bin/sh
+# -------------------------------------------------------------------------
+# async_master.sh
+# Wall time per communication step with asynchronous slaves. Builds two
+# variants of waterTankEnv whose fmiDoStep waits for a given time, as a
+# tool-coupled slave would: one steps synchronously, the other declares
+# canRunAsynchronuously="true" and steps in a thread of its own, see
+# RUN_ASYNCHRONOUSLY in fmuTemplate.h. Simulates a graph of pairs of such
+# a tank and a waterTankCtr with each variant and checks that the results
+# are identical. The master waits for the asynchronous steps only after
+# it stepped all other components, so a step of the asynchronous graph
+# should take about as long as one slow component.
+# Usage: async_master.sh [<number of pairs> [<delay in us> [<tEnd>]]]
+# Run 'make asyncmaster' in src after 'make', on Linux. Not part of 'make test'.
+# -------------------------------------------------------------------------
+
+PAIRS=${1:-8}
+DELAY=${2:-2000}
+TEND=${3:-10}
+cd "$(dirname "$0")/../.." || exit 1
+DIR=$(mktemp -d async_master.XXXXXX) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+MODEL=src/models/waterTankEnv
+
+# build <name> <capabilities> <cflags>
+build() {
+    mkdir -p "$DIR/$1/binaries/linux64"
+    gcc -shared -fPIC -DFMI_COSIMULATION -DDO_STEP_DELAY_US="$DELAY" $3 \
+        -Isrc/co_simulation/include -Isrc/models $MODEL/waterTankEnv.c \
+        -o "$DIR/$1/binaries/linux64/waterTankEnv.so" -lpthread 2>/dev/null || return 1
+    cat $MODEL/modelDescription.xml src/models/cs.xml \
+        | sed "s/canHandleEvents=\"true\"/canHandleEvents=\"true\" $2/" > "$DIR/$1/modelDescription.xml"
+    (cd "$DIR/$1" && zip -q -r "../$1.fmu" modelDescription.xml binaries)
+}
+
+# graph <fmu of the tanks>
+graph() {
+    echo '<?xml version="1.0" encoding="UTF-8"?>'
+    echo '<Graph fmiVersion="1.0">'
+    echo '  <Components>'
+    i=0
+    while [ $i -lt "$PAIRS" ]; do
+        echo "    <Component modelName=\"waterTankEnv\" fmuPath=\"$1\">"
+        echo "      <Inputs><Port name=\"pump\" type=\"Boolean\" connection=\"p$i\"/></Inputs>"
+        echo "      <Outputs><Port name=\"level\" type=\"Real\" connection=\"l$i\"/></Outputs>"
+        echo "    </Component>"
+        echo "    <Component modelName=\"waterTankCtr\" fmuPath=\"fmu/cs/waterTankCtr.fmu\">"
+        echo "      <Inputs><Port name=\"level\" type=\"Real\" connection=\"l$i\"/></Inputs>"
+        echo "      <Outputs><Port name=\"pump\" type=\"Boolean\" connection=\"p$i\"/></Outputs>"
+        echo "    </Component>"
+        i=$((i + 1))
+    done
+    echo '  </Components>'
+    echo '  <Connections>'
+    i=0
+    while [ $i -lt "$PAIRS" ]; do
+        echo "    <Connection name=\"p$i\"/><Connection name=\"l$i\"/>"
+        i=$((i + 1))
+    done
+    echo '  </Connections>'
+    echo '</Graph>'
+}
+
+if ! build sync "" "" || ! build async 'canRunAsynchronuously="true"' -DRUN_ASYNCHRONOUSLY; then
+    echo "error: Could not build the slow waterTankEnv"
+    exit 1
+fi
+graph "$DIR/sync.fmu" > "$DIR/sync.xml"
+graph "$DIR/async.fmu" > "$DIR/async.xml"
+
+echo "$PAIRS slow tanks of $DELAY us per step and $PAIRS controllers, tEnd=$TEND, h=0.1"
+echo "tanks    seconds  ms per step"
+for variant in sync async; do
+    # the wall time of the simulation loop, see the summary of fmusim_cs
+    seconds=$(bin/fmusim_cs "$DIR/$variant.xml" "$TEND" 0.1 0 s --isolate \
+        | awk '/step threads/ { print $5 }')
+    if [ -z "$seconds" ]; then
+        echo "error: Simulation of the $variant tanks failed"
+        exit 1
+    fi
+    if [ $variant = sync ]; then
+        cp result.csv "$DIR/sync.csv"
+    elif ! cmp -s result.csv "$DIR/sync.csv"; then
+        echo "error: Results of the asynchronous tanks differ"
+        exit 1
+    fi
+    awk -v v=$variant -v s="$seconds" -v n="$TEND" 'BEGIN { printf("%-6s %9.3f %12.2f\n", v, s, 1000 * s / (n / 0.1)) }'
+done
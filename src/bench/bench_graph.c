@@ -0,0 +1,144 @@
+/* -------------------------------------------------------------------------
+ * bench_graph.c
+ * Benchmark of parsing and validating component graphs. Generates graphs
+ * with up to 20000 components, each with 3 outputs that feed inputs of
+ * the next components, i.e. 60000 connections, and reports the time per
+ * port of parseGraph, which stays flat if parsing and validation scale
+ * linearly. Compares the connection lookup of validateGraph with the
+ * linear scan over the connections used before the connection index.
+ * Usage: bench_graph [<number of components> [<repetitions>]]
+ * Run 'make benchgraph' in src. Not part of 'make test'.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "xml_parser.h"
+#include "timings.h"
+
+#define DEFAULT_COMPONENTS 20000
+#define DEFAULT_REPS 3
+#define PORTS 3            // inputs and outputs per component
+#define LINEAR_PORTS 2000  // the linear search is timed for this many ports and extrapolated
+#define XML_PATH "bench_graph.xml"
+
+static const char* types[] = { "Real", "Integer", "Boolean", "String" };
+
+// Returns 0 to indicate failure
+// Output k of component i drives connection c<PORTS*i+k>, which is read
+// by input k of component i+1, the first component reads the last one.
+static int generate(const char* path, int nComps) {
+    FILE* file = fopen(path, "wb");
+    int i, k, nCons = PORTS * nComps;
+    if (!file) return 0;
+    fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Graph fmiVersion=\"1.0\">\n<Components>\n");
+    for (i = 0; i < nComps; i++) {
+        int from = (i + nComps - 1) % nComps;
+        fprintf(file, "  <Component modelName=\"m%d\" fmuPath=\"fmu/cs/m%d.fmu\">\n    <Inputs>\n", i, i % 100);
+        for (k = 0; k < PORTS; k++)
+            fprintf(file, "      <Port name=\"u%d\" type=\"%s\" connection=\"c%d\"/>\n",
+                k, types[(PORTS * from + k) % 4], PORTS * from + k);
+        fprintf(file, "    </Inputs>\n    <Outputs>\n");
+        for (k = 0; k < PORTS; k++)
+            fprintf(file, "      <Port name=\"y%d\" type=\"%s\" connection=\"c%d\"/>\n",
+                k, types[(PORTS * i + k) % 4], PORTS * i + k);
+        fprintf(file, "    </Outputs>\n  </Component>\n");
+    }
+    fprintf(file, "</Components>\n<Connections>\n");
+    for (i = 0; i < nCons; i++) fprintf(file, "  <Connection name=\"c%d\"/>\n", i);
+    fprintf(file, "</Connections>\n</Graph>\n");
+    return fclose(file) == 0;
+}
+
+// connection lookup before the connection index: linear search
+static Connection* linearConnectionByName(Graph* graph, const char* name) {
+    int i;
+    for (i = 0; graph->connections[i]; i++)
+        if (!strcmp(name, getName(graph->connections[i]))) return graph->connections[i];
+    return NULL;
+}
+
+// Returns NULL to indicate failure
+// Parses XML_PATH, best of reps, and sets *best
+static Graph* parseBest(int reps, double* best) {
+    Graph* graph = NULL;
+    double start;
+    int r;
+    *best = 1e30;
+    for (r = 0; r < reps; r++) {
+        if (graph) freeElement(graph);
+        start = monotonicTime();
+        graph = parseGraph(XML_PATH);
+        start = monotonicTime() - start;
+        if (start < *best) *best = start;
+        if (!graph) return NULL;
+    }
+    return graph;
+}
+
+int main(int argc, char *argv[]) {
+    int nComps = argc > 1 ? atoi(argv[1]) : DEFAULT_COMPONENTS;
+    int reps = argc > 2 ? atoi(argv[2]) : DEFAULT_REPS;
+    Graph* graph = NULL;
+    double best, start, linear, indexed;
+    long sum = 0;
+    int sizes[3];
+    int i, k, n, s, nPorts = 0, nLinear;
+
+    if (nComps < 100 || reps <= 0) {
+        printf("usage: %s [<number of components, at least 100> [<repetitions>]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // parse and validate graphs of 1%, 10% and 100% of the size
+    printf("%10s %12s %12s %12s %10s\n", "components", "connections", "ports", "parseGraph", "per port");
+    sizes[0] = nComps / 100;
+    sizes[1] = nComps / 10;
+    sizes[2] = nComps;
+    for (s = 0; s < 3; s++) {
+        n = sizes[s];
+        if (graph) freeElement(graph);
+        if (!generate(XML_PATH, n)) {
+            printf("error: Could not write %s\n", XML_PATH);
+            return EXIT_FAILURE;
+        }
+        graph = parseBest(reps, &best);
+        if (!graph) {
+            printf("error: Parsing %s failed\n", XML_PATH);
+            unlink(XML_PATH);
+            return EXIT_FAILURE;
+        }
+        nPorts = 2 * PORTS * n;
+        printf("%10d %12d %12d %9.3f ms %7.0f ns\n", n, PORTS * n, nPorts, 1000 * best, 1e9 * best / nPorts);
+    }
+    unlink(XML_PATH);
+
+    // look up the connection of each port, as validateGraph does
+    nLinear = nPorts < LINEAR_PORTS ? nPorts : LINEAR_PORTS;
+    printf("\nconnection lookup of %d ports, linear extrapolated from %d ports\n", nPorts, nLinear);
+    start = monotonicTime();
+    for (i = 0; PORTS * i < nLinear; i++) {
+        Component* c = graph->components[(i * 7919L) % nComps];
+        for (k = 0; k < PORTS; k++)
+            sum += linearConnectionByName(graph, getString(c->outputs[k], att_connection)) == c->outputs[k]->connection;
+    }
+    linear = (monotonicTime() - start) * nPorts / (PORTS * i);
+    sum -= PORTS * i;
+    start = monotonicTime();
+    if (!validateGraph(graph)) sum++;
+    indexed = monotonicTime() - start;
+    printf("  %-22s %10.3f ms %10.3f ms %8.1fx\n", "validateGraph", 1000 * linear, 1000 * indexed,
+        indexed > 0 ? linear / indexed : 0);
+
+    // connections of the same type have consecutive signals
+    for (i = 0; i < PORTS * nComps; i++) {
+        if (graph->connections[i]->signal != i / 4) sum++;
+    }
+    freeElement(graph);
+    if (sum != 0) {
+        printf("error: Results differ\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,352 @@
+/* -------------------------------------------------------------------------
+ * bench_parser.c
+ * Benchmark of the model description parser. Generates a synthetic
+ * modelDescription.xml with many variables, parses it from memory and
+ * compares name resolution, attribute access and variable lookup with
+ * the linear scans used before the hash tables and indexes were introduced.
+ * Port binding looks up the variables of nPorts ports, as loadGraph does.
+ * Parsing only the variables of the ports is compared with a full parse,
+ * see parserContextSelect. Parsing a file with expat is compared with the
+ * in-situ tokenizer, see xml_scanner.h. Finally compares parsing with
+ * mapping the binary image, see md_image.h.
+ * Usage: bench_parser [<number of variables> [<repetitions> [<number of ports>]]]
+ * Run 'make bench' in src. Not part of 'make test'.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "xml_parser.h"
+#include "md_image.h"
+#include "timings.h"
+
+#define DEFAULT_VARS 100000
+#define DEFAULT_REPS 5
+#define DEFAULT_PORTS 10000
+#define IMAGE_PATH "bench_parser.bin"
+#define XML_PATH "bench_parser.xml"
+#define LINEAR_PORTS 500   // the linear search is timed for this many ports and extrapolated
+
+// names resolved by the parser for each generated variable, in document order
+static const char* elmStream[] = { "ScalarVariable", "Real" };
+static const char* attStream[] = { "name", "valueReference", "description",
+    "variability", "causality", "start", "fixed", "unit" };
+
+// Atts read from each variable by the simulator and the bench
+static const Att readAtts[] = { att_name, att_valueReference, att_causality,
+    att_variability, att_alias, att_description };
+
+// Returns NULL to indicate failure
+// The receiver must free the returned text
+static char* generate(int nVars, size_t* size) {
+    size_t n = 0, cap = 1024 + (size_t)nVars * 256;
+    char* text = (char*)malloc(cap);
+    int i;
+    if (!text) return NULL;
+    n += sprintf(text + n,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<fmiModelDescription fmiVersion=\"1.0\" modelName=\"bench\" "
+        "modelIdentifier=\"bench\" guid=\"{00000000-0000-0000-0000-000000000000}\" "
+        "numberOfContinuousStates=\"0\" numberOfEventIndicators=\"0\">\n"
+        "<ModelVariables>\n");
+    for (i = 0; i < nVars; i++) {
+        n += sprintf(text + n,
+            "  <ScalarVariable name=\"x%d\" valueReference=\"%d\" description=\"variable %d\" "
+            "variability=\"%s\" causality=\"%s\">\n"
+            "    <Real start=\"%d.5\" fixed=\"true\" unit=\"m\"/>\n"
+            "  </ScalarVariable>\n",
+            i, i, i, i % 3 ? "continuous" : "parameter",
+            i % 4 == 0 ? "input" : (i % 4 == 1 ? "output" : "internal"), i);
+    }
+    n += sprintf(text + n, "</ModelVariables>\n</fmiModelDescription>\n");
+    *size = n;
+    return text;
+}
+
+// name resolution before the hash tables: linear search
+static int linearIndex(const char* name, const char* array[], int n) {
+    int i;
+    for (i = 0; i < n; i++)
+        if (!strcmp(name, array[i])) return i;
+    return -1;
+}
+
+// attribute access before the attributes were ordered: linear search
+static const char* linearGetString(void* element, Att a) {
+    Element* e = (Element*)element;
+    int i;
+    for (i = 0; i < e->n; i += 2)
+        if (e->attributes[i] == attNames[a]) return e->attributes[i+1];
+    return NULL;
+}
+
+// variable lookup by name before the index: linear search
+static ScalarVariable* linearVariableByName(ModelDescription* md, const char* name) {
+    int i;
+    for (i = 0; md->modelVariables[i]; i++)
+        if (!strcmp(getName(md->modelVariables[i]), name)) return md->modelVariables[i];
+    return NULL;
+}
+
+// variable lookup by value reference before the index: linear search
+static ScalarVariable* linearVariable(ModelDescription* md, fmiValueReference vr, Elm type) {
+    int i;
+    for (i = 0; md->modelVariables[i]; i++) {
+        ScalarVariable* sv = md->modelVariables[i];
+        if (sameBaseType(type, sv->typeSpec->type) && getValueReference(sv) == vr) return sv;
+    }
+    return NULL;
+}
+
+// 1 if the attributes of both elements are equal
+static int sameAttributes(void* element1, void* element2) {
+    Element* e1 = (Element*)element1;
+    Element* e2 = (Element*)element2;
+    int i;
+    if (e1->type != e2->type || e1->n != e2->n) return 0;
+    for (i = 0; i < e1->n; i += 2) {
+        if (e1->attributes[i] != e2->attributes[i] || strcmp(e1->attributes[i+1], e2->attributes[i+1])) return 0;
+    }
+    return 1;
+}
+
+// Returns NULL to indicate failure
+// Parses file XML_PATH with the given tokenizer, best of reps, and sets *best
+static ModelDescription* parseFileWith(Tokenizer tokenizer, int reps, double* best) {
+    ModelDescription* md = NULL;
+    ParserContext* ctx = parserContextNew();
+    double start;
+    int r;
+    if (!ctx) return NULL;
+    parserContextSetTokenizer(ctx, tokenizer);
+    *best = 1e30;
+    for (r = 0; r < reps; r++) {
+        if (md) freeElement(md);
+        start = monotonicTime();
+        md = parseWithContext(ctx, XML_PATH);
+        start = monotonicTime() - start;
+        if (start < *best) *best = start;
+        if (!md) break;
+    }
+    parserContextFree(ctx);
+    return md;
+}
+
+static void report(const char* what, double linear, double hashed) {
+    printf("  %-22s %10.3f ms %10.3f ms %8.1fx\n", what, 1000 * linear, 1000 * hashed,
+        hashed > 0 ? linear / hashed : 0);
+}
+
+int main(int argc, char *argv[]) {
+    int nVars = argc > 1 ? atoi(argv[1]) : DEFAULT_VARS;
+    int reps = argc > 2 ? atoi(argv[2]) : DEFAULT_REPS;
+    int nPorts = argc > 3 ? atoi(argv[3]) : DEFAULT_PORTS;
+    int nElm = sizeof(elmStream) / sizeof(char*);
+    int nAtt = sizeof(attStream) / sizeof(char*);
+    int nRead = sizeof(readAtts) / sizeof(Att);
+    size_t size;
+    char* text;
+    char name[32];
+    struct stat st;
+    ModelDescription* md = NULL;
+    ModelDescription* image = NULL;
+    ModelDescription* selected = NULL;
+    ModelDescription* expat;
+    ModelDescription* inSitu;
+    ParserContext* ctx;
+    FILE* file;
+    char (*names)[32];
+    const char** selectedNames;
+    double start, best = 1e30, linear, hashed, expatBest;
+    long sum = 0;
+    int i, j, r, nLinear;
+
+    if (nVars <= 0 || reps <= 0 || nPorts <= 0) {
+        printf("usage: %s [<number of variables> [<repetitions> [<number of ports>]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    text = generate(nVars, &size);
+    if (!text) {
+        printf("error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    printf("model description with %d variables, %.1f MB\n", nVars, size / 1e6);
+
+    // parse, best of reps
+    for (r = 0; r < reps; r++) {
+        if (md) freeElement(md);
+        start = monotonicTime();
+        md = parseBuffer(text, size, "bench");
+        start = monotonicTime() - start;
+        if (start < best) best = start;
+        if (!md) {
+            printf("error: Parsing failed\n");
+            free(text);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("  parse and validate ..... %10.3f ms, %.0f variables/s\n", 1000 * best, nVars / best);
+
+    // name resolution for the names of the document
+    printf("  %-22s %13s %13s %9s\n", "", "linear", "hashed", "speedup");
+    start = monotonicTime();
+    for (i = 0; i < nVars; i++) {
+        for (j = 0; j < nElm; j++) sum += linearIndex(elmStream[j], elmNames, SIZEOF_ELM);
+        for (j = 0; j < nAtt; j++) sum += linearIndex(attStream[j], attNames, SIZEOF_ATT);
+    }
+    linear = monotonicTime() - start;
+    start = monotonicTime();
+    for (i = 0; i < nVars; i++) {
+        for (j = 0; j < nElm; j++) sum -= getElmIndex(elmStream[j]);
+        for (j = 0; j < nAtt; j++) sum -= getAttIndex(attStream[j]);
+    }
+    hashed = monotonicTime() - start;
+    report("element/attribute names", linear, hashed);
+
+    // attribute access of all variables
+    start = monotonicTime();
+    for (i = 0; i < nVars; i++)
+        for (j = 0; j < nRead; j++) sum += linearGetString(md->modelVariables[i], readAtts[j]) != NULL;
+    linear = monotonicTime() - start;
+    start = monotonicTime();
+    for (i = 0; i < nVars; i++)
+        for (j = 0; j < nRead; j++) sum -= getString(md->modelVariables[i], readAtts[j]) != NULL;
+    hashed = monotonicTime() - start;
+    report("getString", linear, hashed);
+
+    // bind ports to variables spread over the model
+    nLinear = nPorts < LINEAR_PORTS ? nPorts : LINEAR_PORTS;
+    printf("  binding %d ports, linear extrapolated from %d ports\n", nPorts, nLinear);
+    start = monotonicTime();
+    for (i = 0; i < nLinear; i++) {
+        sprintf(name, "x%d", (int)((i * 7919L) % nVars));
+        sum += linearVariableByName(md, name) == getVariableByName(md, name);
+    }
+    linear = (monotonicTime() - start) * nPorts / nLinear;
+    sum -= nLinear;
+    start = monotonicTime();
+    for (i = 0; i < nPorts; i++) {
+        sprintf(name, "x%d", (int)((i * 7919L) % nVars));
+        sum += getVariableByName(md, name) == NULL;
+    }
+    hashed = monotonicTime() - start;
+    report("getVariableByName", linear, hashed);
+    start = monotonicTime();
+    for (i = 0; i < nLinear; i++) {
+        fmiValueReference vr = (fmiValueReference)((i * 7919L) % nVars);
+        sum += linearVariable(md, vr, elm_Real) == getVariable(md, vr, elm_Real);
+    }
+    linear = (monotonicTime() - start) * nPorts / nLinear;
+    sum -= nLinear;
+    start = monotonicTime();
+    for (i = 0; i < nPorts; i++)
+        sum += getVariable(md, (fmiValueReference)((i * 7919L) % nVars), elm_Real) == NULL;
+    hashed = monotonicTime() - start;
+    report("getVariable", linear, hashed);
+
+    // parse only the variables of the ports, best of reps
+    names = malloc(nPorts * sizeof(*names));
+    selectedNames = (const char**)calloc(nPorts + 1, sizeof(const char*));
+    ctx = parserContextNew();
+    if (!names || !selectedNames || !ctx) {
+        printf("error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < nPorts; i++) {
+        sprintf(names[i], "x%d", (int)((i * 7919L) % nVars));
+        selectedNames[i] = names[i];
+    }
+    parserContextSelect(ctx, selectedNames);
+    linear = best;
+    best = 1e30;
+    for (r = 0; r < reps; r++) {
+        if (selected) freeElement(selected);
+        start = monotonicTime();
+        selected = parseBufferWithContext(ctx, text, size, "bench");
+        start = monotonicTime() - start;
+        if (start < best) best = start;
+        if (!selected) {
+            printf("error: Parsing failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    for (i = 0; selected->modelVariables[i]; i++);
+    printf("  selective parse ........ %10.3f ms, %d of %d variables, %.1f of %.1f MB, %.1fx faster\n",
+        1000 * best, i, i + parserContextSkipped(ctx), selected->arena->used / 1e6,
+        md->arena->used / 1e6, linear / best);
+    for (i = 0; i < nPorts; i++) {
+        ScalarVariable* sv = getVariableByName(selected, names[i]);
+        if (!sv || getValueReference(sv) != getValueReference(getVariableByName(md, names[i]))) sum++;
+    }
+    freeElement(selected);
+    parserContextFree(ctx);
+    free(selectedNames);
+    free(names);
+
+    // parse the file with expat and in situ, best of reps
+    file = fopen(XML_PATH, "wb");
+    if (!file || fwrite(text, sizeof(char), size, file) != size) {
+        printf("error: Could not write %s\n", XML_PATH);
+        return EXIT_FAILURE;
+    }
+    fclose(file);
+    expat = parseFileWith(tokenizerExpat, reps, &expatBest);
+    inSitu = parseFileWith(tokenizerInSitu, reps, &best);
+    unlink(XML_PATH);
+    if (!expat || !inSitu) {
+        printf("error: Parsing %s failed\n", XML_PATH);
+        return EXIT_FAILURE;
+    }
+    printf("  parse file with expat .. %10.3f ms, %.1f MB\n", 1000 * expatBest, expat->arena->used / 1e6);
+    printf("  parse file in situ ..... %10.3f ms, %.1f MB and %.1f MB mapped, %.1fx faster\n",
+        1000 * best, inSitu->arena->used / 1e6, inSitu->arena->mappedSize / 1e6, expatBest / best);
+    if (!sameAttributes(expat, inSitu)) sum++;
+    for (i = 0; i < nVars; i++) {
+        ScalarVariable* sv = inSitu->modelVariables[i];
+        if (!sv || !sameAttributes(expat->modelVariables[i], sv)
+                || !sameAttributes(expat->modelVariables[i]->typeSpec, sv->typeSpec)) sum++;
+    }
+    freeElement(inSitu);
+    freeElement(expat);
+
+    // write the binary image and map it, best of reps
+    if (!writeModelDescriptionImage(md, IMAGE_PATH)) {
+        printf("error: Could not write %s\n", IMAGE_PATH);
+        return EXIT_FAILURE;
+    }
+    best = 1e30;
+    for (r = 0; r < reps; r++) {
+        if (image) freeElement(image);
+        start = monotonicTime();
+        image = mapModelDescriptionImage(IMAGE_PATH);
+        start = monotonicTime() - start;
+        if (start < best) best = start;
+        if (!image) {
+            printf("error: Could not map %s\n", IMAGE_PATH);
+            return EXIT_FAILURE;
+        }
+    }
+    if (stat(IMAGE_PATH, &st)) st.st_size = 0;
+    unlink(IMAGE_PATH);
+    printf("  map binary image ....... %10.3f ms, %.0f variables/s, %.1f MB\n",
+        1000 * best, nVars / best, st.st_size / 1e6);
+    for (i = 0; i < nVars; i++) {
+        ScalarVariable* sv = image->modelVariables[i];
+        if (strcmp(getName(sv), getName(md->modelVariables[i]))
+                || getValueReference(sv) != getValueReference(md->modelVariables[i])
+                || getCausality(sv) != getCausality(md->modelVariables[i])
+                || getVariableByName(image, getName(sv)) != sv
+                || getVariable(image, getValueReference(sv), sv->typeSpec->type) != sv) sum++;
+    }
+    freeElement(image);
+
+    freeElement(md);
+    free(text);
+    if (sum != 0) {
+        printf("error: Results differ\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
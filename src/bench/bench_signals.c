@@ -0,0 +1,308 @@
+/* -------------------------------------------------------------------------
+ * bench_signals.c
+ * Benchmark of the exchange of connection values by the co-simulation
+ * master. Builds an exchange plan for a graph with 100000 connections:
+ * each component has 4 outputs, 2 Real, 1 Integer and 1 Boolean, and 4
+ * inputs that read the outputs of a pseudo-random other component. The
+ * FMU calls are stubs that copy the values, so the time is that of the
+ * master. Reports the time per connection and step of
+ *  - pointers to one allocation per connection value,
+ *  - pointers into one array per type, the layout before signals.h,
+ *  - signal indexes into the double-buffered signal buffer, see signals.h,
+ * and checks that all three exchange the same values.
+ * Usage: bench_signals [<number of connections> [<steps>]]
+ * Run 'make benchsignals' in src. Not part of 'make test'.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "exchange.h"
+#include "timings.h"
+
+#define DEFAULT_CONNECTIONS 100000
+#define DEFAULT_STEPS 200
+#define REPS 3
+#define PORTS 4              // inputs and outputs per component
+
+static const PortType types[PORTS] = { portReal, portReal, portInteger, portBoolean };
+
+// the stub instance of a component: its outputs and its last inputs
+typedef struct {
+    fmiReal reals[2];
+    fmiInteger integer;
+    fmiBoolean boolean;
+    fmiReal inReals[2];
+    fmiInteger inInteger;
+    fmiBoolean inBoolean;
+} Instance;
+
+static fmiStatus stubGetReal(fmiComponent c, const fmiValueReference vr[], size_t nvr, fmiReal value[]) {
+    size_t k;
+    for (k=0; k<nvr; k++) value[k] = ((Instance*)c)->reals[vr[k]];
+    return fmiOK;
+}
+
+static fmiStatus stubGetInteger(fmiComponent c, const fmiValueReference vr[], size_t nvr, fmiInteger value[]) {
+    if (nvr) value[0] = ((Instance*)c)->integer;
+    return fmiOK;
+}
+
+static fmiStatus stubGetBoolean(fmiComponent c, const fmiValueReference vr[], size_t nvr, fmiBoolean value[]) {
+    if (nvr) value[0] = ((Instance*)c)->boolean;
+    return fmiOK;
+}
+
+static fmiStatus stubSetReal(fmiComponent c, const fmiValueReference vr[], size_t nvr, const fmiReal value[]) {
+    size_t k;
+    for (k=0; k<nvr; k++) ((Instance*)c)->inReals[vr[k]] = value[k];
+    return fmiOK;
+}
+
+static fmiStatus stubSetInteger(fmiComponent c, const fmiValueReference vr[], size_t nvr, const fmiInteger value[]) {
+    if (nvr) ((Instance*)c)->inInteger = value[0];
+    return fmiOK;
+}
+
+static fmiStatus stubSetBoolean(fmiComponent c, const fmiValueReference vr[], size_t nvr, const fmiBoolean value[]) {
+    if (nvr) ((Instance*)c)->inBoolean = value[0];
+    return fmiOK;
+}
+
+// the stub step: new outputs from the inputs
+static void step(Instance* s, int i) {
+    s->reals[0] = s->inReals[1] + 1;
+    s->reals[1] = s->inReals[0] * 0.5 + i;
+    s->integer = s->inInteger + 1;
+    s->boolean = !s->inBoolean;
+}
+
+// The port groups of one component before signals.h: a pointer to the
+// value of the connection of each port
+typedef struct {
+    int n;
+    fmiValueReference* vrs;
+    void* values;
+    void** connections;
+} PointerGroup;
+
+// the exchange with pointers, all outputs are read, then all inputs set
+static void pointerStep(ExchangePlan* plan, PointerGroup (*groups)[2][SIZEOF_PORT_TYPE]) {
+    int i, k;
+    for (i=0; i<plan->n; i++) {
+        Instance* s = (Instance*)plan->components[i].component->instance;
+        PointerGroup* g = groups[i][0];
+        stubGetReal(s, g[portReal].vrs, g[portReal].n, (fmiReal*)g[portReal].values);
+        for (k=0; k<g[portReal].n; k++) *(fmiReal*)g[portReal].connections[k] = ((fmiReal*)g[portReal].values)[k];
+        stubGetInteger(s, g[portInteger].vrs, g[portInteger].n, (fmiInteger*)g[portInteger].values);
+        for (k=0; k<g[portInteger].n; k++) *(fmiInteger*)g[portInteger].connections[k] = ((fmiInteger*)g[portInteger].values)[k];
+        stubGetBoolean(s, g[portBoolean].vrs, g[portBoolean].n, (fmiBoolean*)g[portBoolean].values);
+        for (k=0; k<g[portBoolean].n; k++) *(fmiBoolean*)g[portBoolean].connections[k] = ((fmiBoolean*)g[portBoolean].values)[k];
+    }
+    for (i=0; i<plan->n; i++) {
+        Instance* s = (Instance*)plan->components[i].component->instance;
+        PointerGroup* g = groups[i][1];
+        for (k=0; k<g[portReal].n; k++) ((fmiReal*)g[portReal].values)[k] = *(fmiReal*)g[portReal].connections[k];
+        stubSetReal(s, g[portReal].vrs, g[portReal].n, (fmiReal*)g[portReal].values);
+        for (k=0; k<g[portInteger].n; k++) ((fmiInteger*)g[portInteger].values)[k] = *(fmiInteger*)g[portInteger].connections[k];
+        stubSetInteger(s, g[portInteger].vrs, g[portInteger].n, (fmiInteger*)g[portInteger].values);
+        for (k=0; k<g[portBoolean].n; k++) ((fmiBoolean*)g[portBoolean].values)[k] = *(fmiBoolean*)g[portBoolean].connections[k];
+        stubSetBoolean(s, g[portBoolean].vrs, g[portBoolean].n, (fmiBoolean*)g[portBoolean].values);
+        step(s, i);
+    }
+}
+
+// the exchange of the master with the signal buffer, see doStepTask in main.c
+static void signalStep(ExchangePlan* plan) {
+    int i;
+    for (i=0; i<plan->n; i++) {
+        exchangeSetInputs(plan, i, signalsCurrent(plan->signals));
+        step((Instance*)plan->components[i].component->instance, i);
+        exchangeGetOutputs(plan, i, signalsNext(plan->signals));
+    }
+    signalBufferSwap(plan->signals);
+}
+
+// Returns 0 to indicate failure
+// Points the pointer groups of the plan to the connection values: one
+// allocation per connection if scattered, else one array per type
+static int pointTo(ExchangePlan* plan, PointerGroup (*groups)[2][SIZEOF_PORT_TYPE], int nCons, int scattered, void*** owned) {
+    int i, k, t, n[SIZEOF_PORT_TYPE];
+    void* arrays[SIZEOF_PORT_TYPE];
+    *owned = (void**)calloc(nCons + SIZEOF_PORT_TYPE, sizeof(void*));
+    if (!*owned) return 0;
+    for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+        n[t] = plan->signals->n[t];
+        arrays[t] = scattered ? NULL : ((*owned)[nCons + t] = calloc(n[t] + 1, signalSize(t)));
+    }
+    for (i=0; i<plan->n; i++) {
+        for (k=0; k<2; k++) {
+            for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+                PortGroup* p = k ? &plan->components[i].inputs[t] : &plan->components[i].outputs[t];
+                PointerGroup* g = &groups[i][k][t];
+                int j;
+                g->n = p->n;
+                g->vrs = p->vrs;
+                g->values = p->values;
+                g->connections = (void**)malloc((p->n + 1) * sizeof(void*));
+                if (!g->connections) return 0;
+                for (j=0; j<p->n; j++) {
+                    // the connections are numbered per type: global number from type and signal
+                    int c = t == portReal ? 4 * (p->signals[j] / 2) + p->signals[j] % 2
+                          : t == portInteger ? 4 * p->signals[j] + 2 : 4 * p->signals[j] + 3;
+                    if (scattered) {
+                        if (!(*owned)[c] && !((*owned)[c] = calloc(1, signalSize(t)))) return 0;
+                        g->connections[j] = (*owned)[c];
+                    }
+                    else g->connections[j] = (char*)arrays[t] + p->signals[j] * signalSize(t);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+static void freePointers(ExchangePlan* plan, PointerGroup (*groups)[2][SIZEOF_PORT_TYPE], int nCons, void** owned) {
+    int i, k, t;
+    for (i=0; i<plan->n; i++)
+        for (k=0; k<2; k++)
+            for (t=0; t<SIZEOF_PORT_TYPE; t++) free(groups[i][k][t].connections);
+    for (i=0; owned && i<nCons + SIZEOF_PORT_TYPE; i++) free(owned[i]);
+    free(owned);
+}
+
+// checksum of the outputs of all instances
+static double checksum(Instance* instances, int n) {
+    double sum = 0;
+    int i;
+    for (i=0; i<n; i++) sum += instances[i].reals[0] + instances[i].reals[1] + instances[i].integer + instances[i].boolean;
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    int nCons = argc > 1 ? atoi(argv[1]) : DEFAULT_CONNECTIONS;
+    int nSteps = argc > 2 ? atoi(argv[2]) : DEFAULT_STEPS;
+    static const char* names[] = { "malloc per connection", "pointers into arrays", "signal buffer" };
+    Graph graph;
+    FMU fmu;
+    Connection* cons;
+    Component* comps;
+    Instance* instances;
+    PointerGroup (*groups)[2][SIZEOF_PORT_TYPE];
+    ExchangePlan plan;
+    void** owned = NULL;
+    double best, start, sums[3];
+    int i, k, s, r, v, nComps;
+
+    if (nCons < 4 * 100 || nSteps <= 0) {
+        printf("usage: %s [<number of connections, at least 400> [<steps>]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    nComps = nCons / PORTS;
+    nCons = PORTS * nComps;
+
+    // connection PORTS*i+k is driven by output k of component i, as numbered by validateGraph
+    memset(&graph, 0, sizeof(graph));
+    memset(&fmu, 0, sizeof(fmu));
+    fmu.getReal = stubGetReal;
+    fmu.getInteger = stubGetInteger;
+    fmu.getBoolean = stubGetBoolean;
+    fmu.setReal = stubSetReal;
+    fmu.setInteger = stubSetInteger;
+    fmu.setBoolean = stubSetBoolean;
+    graph.arena = arenaNew();
+    cons = (Connection*)calloc(nCons, sizeof(Connection));
+    comps = (Component*)calloc(nComps, sizeof(Component));
+    instances = (Instance*)calloc(nComps, sizeof(Instance));
+    graph.connections = (Connection**)calloc(nCons + 1, sizeof(Connection*));
+    groups = calloc(nComps, sizeof(*groups));
+    plan.n = nComps;
+    plan.components = (ComponentPlan*)calloc(nComps, sizeof(ComponentPlan));
+    if (!graph.arena || !cons || !comps || !instances || !graph.connections || !groups || !plan.components) {
+        printf("error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (i=0; i<nCons; i++) {
+        cons[i].valueType = types[i % PORTS] == portReal ? enu_Real : types[i % PORTS] == portInteger ? enu_Integer : enu_Boolean;
+        cons[i].signal = types[i % PORTS] == portReal ? 2 * (i / PORTS) + i % PORTS : i / PORTS;
+        graph.connections[i] = &cons[i];
+    }
+    plan.signals = signalBufferNew(&graph);
+    if (!plan.signals) {
+        printf("error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // input k of component i reads output k of a pseudo-random component
+    for (i=0; i<nComps; i++) {
+        ComponentPlan* p = &plan.components[i];
+        int from = (int)((i * 7919L + 1) % nComps);
+        comps[i].fmu = &fmu;
+        comps[i].instance = &instances[i];
+        p->component = &comps[i];
+        for (k=0; k<2; k++) {
+            PortGroup* g = k ? p->inputs : p->outputs;
+            int c = PORTS * (k ? from : i);
+            g[portReal].n = 2;
+            g[portInteger].n = g[portBoolean].n = 1;
+            for (s=0; s<SIZEOF_PORT_TYPE; s++) {
+                if (!g[s].n) continue;
+                g[s].vrs = (fmiValueReference*)arenaAlloc(graph.arena, g[s].n * sizeof(fmiValueReference));
+                g[s].values = arenaAlloc(graph.arena, g[s].n * signalSize(s));
+                g[s].signals = (int*)arenaAlloc(graph.arena, g[s].n * sizeof(int));
+                if (!g[s].vrs || !g[s].values || !g[s].signals) {
+                    printf("error: Out of memory\n");
+                    return EXIT_FAILURE;
+                }
+            }
+            for (v=0; v<PORTS; v++) {
+                PortGroup* t = &g[types[v]];
+                int j = types[v] == portReal ? v : 0;
+                t->vrs[j] = j;
+                t->signals[j] = cons[c + v].signal;
+            }
+        }
+    }
+
+    printf("%d components, %d connections, %d steps, best of %d\n", nComps, nCons, nSteps, REPS);
+    printf("  %-22s %10s %14s %16s\n", "layout", "seconds", "ns per value", "bytes per port");
+    for (v=0; v<3; v++) {
+        if (v < 2 && !pointTo(&plan, groups, nCons, v == 0, &owned)) {
+            printf("error: Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        best = 1e30;
+        for (r=0; r<REPS; r++) {
+            memset(instances, 0, nComps * sizeof(Instance));
+            for (k=0; k<SIZEOF_PORT_TYPE; k++) {
+                memset(plan.signals->values[0][k], 0, plan.signals->n[k] * signalSize(k));
+                memset(plan.signals->values[1][k], 0, plan.signals->n[k] * signalSize(k));
+            }
+            start = monotonicTime();
+            for (s=0; s<nSteps; s++) {
+                if (v < 2) pointerStep(&plan, groups);
+                else signalStep(&plan);
+            }
+            start = monotonicTime() - start;
+            if (start < best) best = start;
+        }
+        sums[v] = checksum(instances, nComps);
+        printf("  %-22s %10.4f %14.2f %16d\n", names[v], best, 1e9 * best / ((double)nSteps * nCons),
+            (int)(v < 2 ? sizeof(void*) : sizeof(int)));
+        if (v < 2) freePointers(&plan, groups, nCons, owned);
+    }
+
+    signalBufferFree(plan.signals);
+    arenaFree(graph.arena);
+    free(cons);
+    free(comps);
+    free(instances);
+    free(graph.connections);
+    free(groups);
+    free(plan.components);
+    if (sums[0] != sums[2] || sums[1] != sums[2]) {
+        printf("error: Results differ\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
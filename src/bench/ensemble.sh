@@ -0,0 +1,71 @@
+#!/bin/sh
+# -------------------------------------------------------------------------
+# ensemble.sh
+# Throughput of an ensemble of runs of componentGraphEnvCtr.xml, in runs
+# per second of wall time including startup. Runs the graph once per run
+# as separate fmusim_cs processes, each with a one-row --ensemble, and
+# as one --ensemble of all rows with 1..n workers. Each row has its own
+# level H and inflow v1, chosen so that the pump switches off before
+# t=15. Each run of the ensemble must give the result of the separate
+# process of its row, so a row applied to the wrong run, or not at all,
+# is detected.
+# Usage: ensemble.sh [<runs> [<max workers> [<tEnd>]]]
+# Run 'make ensemble' in src after 'make'. Not part of 'make test'.
+# -------------------------------------------------------------------------
+
+RUNS=${1:-200}
+MAX_WORKERS=${2:-$(getconf _NPROCESSORS_ONLN)}
+TEND=${3:-300}
+GRAPH=componentGraphEnvCtr.xml
+cd "$(dirname "$0")/../.." || exit 1
+TABLE=$(mktemp ensemble.XXXXXX) || exit 1
+ROW=$(mktemp ensemble.XXXXXX) || exit 1
+trap 'rm -f "$TABLE" "$ROW" ensemble.csv' EXIT
+
+# H in 6..15.5 and v1 from 3 up, distinct for every run
+awk -v n="$RUNS" 'BEGIN {
+    print "waterTankCtr.H,waterTankEnv.v1"
+    for (i = 0; i < n; i++) printf("%g,%g\n", 6 + (i % 20) / 2, 3 + int(i / 20) / 4)
+}' > "$TABLE"
+
+# wall time of the given command in seconds
+wallTime() {
+    start=$(date +%s.%N)
+    "$@" > /dev/null || return 1
+    awk -v s="$start" -v e="$(date +%s.%N)" 'BEGIN { print e - s }'
+}
+
+echo "$RUNS runs of $GRAPH, tEnd=$TEND, h=0.1"
+echo "mode           workers  seconds   runs/s  speedup"
+# the rows of each separate process, with the run column set to its row
+: > ensemble.csv
+start=$(date +%s.%N)
+i=1
+while [ $i -le "$RUNS" ]; do
+    sed -n "1p;$((i + 1))p" "$TABLE" > "$ROW"
+    if ! bin/fmusim_cs "$GRAPH" "$TEND" 0.1 0 c --ensemble="$ROW" > /dev/null; then
+        echo "error: Simulation $i failed"
+        exit 1
+    fi
+    awk -F, -v OFS=, -v r=$i 'FNR > 1 { $1 = r; print }' result.csv >> ensemble.csv
+    i=$((i + 1))
+done
+base=$(awk -v s="$start" -v e="$(date +%s.%N)" 'BEGIN { print e - s }')
+awk -v n="$RUNS" -v s="$base" 'BEGIN { printf("%-14s %7d %8.3f %8.1f %8.2f\n", "processes", 1, s, n / s, 1) }'
+
+w=1
+while [ "$w" -le "$MAX_WORKERS" ]; do
+    seconds=$(wallTime bin/fmusim_cs "$GRAPH" "$TEND" 0.1 0 c --ensemble="$TABLE" --step-threads=$w)
+    if [ -z "$seconds" ] || ! grep -q . result.csv; then
+        echo "error: Ensemble with $w workers failed"
+        exit 1
+    fi
+    # every run must reproduce the rows of the separate process of its row
+    if ! tail -n +2 result.csv | cmp -s - ensemble.csv; then
+        echo "error: Runs of the ensemble with $w workers differ from the separate processes of their rows"
+        exit 1
+    fi
+    awk -v w=$w -v n="$RUNS" -v s="$seconds" -v b="$base" \
+        'BEGIN { printf("%-14s %7d %8.3f %8.1f %8.2f\n", "ensemble", w, s, n / s, b / s) }'
+    w=$((w + 1))
+done
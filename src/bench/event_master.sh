@@ -0,0 +1,84 @@
+#!/bin/sh
+# -------------------------------------------------------------------------
+# event_master.sh
+# Accuracy of the event-aware master, see events.h. A waterTank switches
+# its pump at internal state events and drives the pump of a waterTankEnv
+# with the same parameters, so the level of the tank and of its mirror
+# should be identical. Reports the largest deviation of the two levels in
+# result.csv and the steps taken by
+#  - jacobi:  the Jacobi master with fixed steps,
+#  - events:  --events with the waterTank of fmu/cs, which switches in the
+#             middle of a step, so the mirror sees the switch one step late,
+#  - stop:    --events with a waterTank built with STOP_AT_EVENTS and
+#             canSignalEvents="true", which ends its step at the event.
+# First checks that a step of length zero fires the event of a new value,
+# see zero_step.c.
+# Usage: event_master.sh [<tEnd> [<step sizes>]]
+# Run 'make eventmaster' in src after 'make', on Linux. Not part of 'make test'.
+# -------------------------------------------------------------------------
+
+TEND=${1:-30}
+STEPS=${2:-"0.5 0.2 0.1"}
+cd "$(dirname "$0")/../.." || exit 1
+DIR=$(mktemp -d event_master.XXXXXX) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+MODEL=src/models/waterTank
+
+if ! gcc -DFMI_COSIMULATION -Isrc/co_simulation/include -Isrc/models \
+        src/bench/zero_step.c -o "$DIR/zero_step" 2>/dev/null; then
+    echo "error: Could not build zero_step"
+    exit 1
+fi
+"$DIR/zero_step" || exit 1
+
+mkdir -p "$DIR/stop/binaries/linux64"
+if ! gcc -shared -fPIC -DFMI_COSIMULATION -DSTOP_AT_EVENTS -Isrc/co_simulation/include -Isrc/models \
+        $MODEL/waterTank.c -o "$DIR/stop/binaries/linux64/waterTank.so" 2>/dev/null; then
+    echo "error: Could not build the waterTank with STOP_AT_EVENTS"
+    exit 1
+fi
+cat $MODEL/modelDescription.xml src/models/cs.xml \
+    | sed 's/canHandleEvents="true"/canHandleEvents="true" canSignalEvents="true"/' > "$DIR/stop/modelDescription.xml"
+(cd "$DIR/stop" && zip -q -r ../stop.fmu modelDescription.xml binaries)
+
+# graph <fmu of the tank>
+graph() {
+    echo '<?xml version="1.0" encoding="UTF-8"?>'
+    echo '<Graph fmiVersion="1.0">'
+    echo '  <Components>'
+    echo "    <Component modelName=\"waterTank\" fmuPath=\"$1\">"
+    echo '      <Outputs><Port name="pump" type="Boolean" connection="p"/></Outputs>'
+    echo '    </Component>'
+    echo '    <Component modelName="waterTankEnv" fmuPath="fmu/cs/waterTankEnv.fmu">'
+    echo '      <Inputs><Port name="pump" type="Boolean" connection="p"/></Inputs>'
+    echo '    </Component>'
+    echo '  </Components>'
+    echo '  <Connections><Connection name="p"/></Connections>'
+    echo '</Graph>'
+}
+graph fmu/cs/waterTank.fmu > "$DIR/tank.xml"
+graph "$DIR/stop.fmu" > "$DIR/stop.xml"
+
+echo "waterTank driving a waterTankEnv, tEnd=$TEND"
+echo "variant     h    steps  doSteps  events  max deviation"
+for h in $STEPS; do
+    for variant in jacobi events stop; do
+        case $variant in
+            jacobi) summary=$(bin/fmusim_cs "$DIR/tank.xml" "$TEND" "$h" 0 c) ;;
+            events) summary=$(bin/fmusim_cs "$DIR/tank.xml" "$TEND" "$h" 0 c --events) ;;
+            stop)   summary=$(bin/fmusim_cs "$DIR/stop.xml" "$TEND" "$h" 0 c --events) ;;
+        esac
+        if ! echo "$summary" | grep -q "terminated successful"; then
+            echo "error: Simulation of $variant with h=$h failed"
+            exit 1
+        fi
+        # the level is column 6 for the tank and 11 for its mirror, see the header of result.csv
+        echo "$summary" | awk -v v=$variant -v h="$h" '
+            /steps \.\./ { steps = $3 }
+            /doStep calls/ { calls = $4 }
+            /events \.\./ { events = $3 + 0 }
+            END { printf("%-7s %5g %8d %8d %7d ", v, h, steps, calls, events) }'
+        awk -F, 'NR > 1 { d = $6 - $11; if (d < 0) d = -d; if (d > e) e = d }
+            END { printf("%14.4g\n", e) }' result.csv
+    done
+done
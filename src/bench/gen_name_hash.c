@@ -0,0 +1,53 @@
+/* -------------------------------------------------------------------------
+ * gen_name_hash.c
+ * Generates the perfect hash tables for elmNames, attNames and enuNames
+ * used by the XML parser. For each array, searches the smallest table
+ * size and a seed such that hashName maps all names to distinct slots.
+ * Run 'make namehash' and paste the output into xml_parser.c whenever
+ * one of the name arrays changes. The parser asserts that the tables
+ * match the arrays.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xml_parser.h"
+
+#define MAX_BITS 10
+#define MAX_SEED 1000000
+
+// Returns 0 if no seed was found
+static int generate(const char* prefix, const char* table, const char* names[], int n) {
+    signed char slots[1 << MAX_BITS];
+    unsigned int seed;
+    int bits, i;
+    for (bits = 1; (1 << bits) < n; bits++);
+    for (; bits <= MAX_BITS; bits++) {
+        for (seed = 1; seed < MAX_SEED; seed++) {
+            memset(slots, -1, sizeof(slots));
+            for (i = 0; i < n; i++) {
+                unsigned int h = hashName(names[i], seed) & ((1u << bits) - 1);
+                if (slots[h] != -1) break;
+                slots[h] = (signed char)i;
+            }
+            if (i < n) continue;
+            printf("#define %s_HASH_SEED %uu\n", prefix, seed);
+            printf("#define %s_HASH_BITS %d\n", prefix, bits);
+            printf("static const signed char %s[1 << %s_HASH_BITS] = {", table, prefix);
+            for (i = 0; i < (1 << bits); i++) {
+                printf("%s%d", i % 16 ? ", " : (i ? ",\n    " : "\n    "), slots[i]);
+            }
+            printf("\n};\n\n");
+            return 1;
+        }
+    }
+    fprintf(stderr, "No perfect hash found for %s\n", prefix);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int ok = generate("ELM", "elmHash", elmNames, SIZEOF_ELM)
+          && generate("ATT", "attHash", attNames, SIZEOF_ATT)
+          && generate("ENU", "enuHash", enuNames, SIZEOF_ENU);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
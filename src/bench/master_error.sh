@@ -0,0 +1,54 @@
+#!/bin/sh
+# -------------------------------------------------------------------------
+# master_error.sh
+# Speed versus error of the Jacobi and the Gauss-Seidel master. Simulates
+# a graph with both masters at several communication step sizes and
+# reports the wall time of the simulation loop and the mean and largest
+# deviation of the columns of result.csv from a reference run with a 100
+# times smaller step size, compared at the communication points of each
+# run. Discrete switching, as in waterTankCtr, dominates the largest one.
+# Usage: master_error.sh [<graph> [<tEnd> [<step sizes>]]]
+# Run 'make mastererror' in src after 'make'. Not part of 'make test'.
+# -------------------------------------------------------------------------
+
+GRAPH=${1:-componentGraphEnvCtr.xml}
+TEND=${2:-30}
+STEPS=${3:-"0.5 0.2 0.1 0.05"}
+cd "$(dirname "$0")/../.." || exit 1
+trap 'rm -f master_error.csv' EXIT
+
+# Returns the wall time of the simulation loop, see the summary of fmusim_cs
+simulate() {
+    bin/fmusim_cs "$GRAPH" "$TEND" "$2" 0 c --master="$1" | awk '/step threads/ { print $5 }'
+}
+
+echo "$GRAPH, tEnd=$TEND"
+echo "master       h    steps  seconds  mean error  max error"
+for h in $STEPS; do
+    ref=$(awk -v h="$h" 'BEGIN { print h / 100 }')
+    if [ -z "$(simulate gs "$ref")" ]; then
+        echo "error: Reference simulation with h=$ref failed"
+        exit 1
+    fi
+    mv result.csv master_error.csv
+    for master in jacobi gs; do
+        seconds=$(simulate $master "$h")
+        if [ -z "$seconds" ]; then
+            echo "error: Simulation with --master=$master and h=$h failed"
+            exit 1
+        fi
+        # rows are matched by their time, rounded to the reference step size
+        awk -F, -v m=$master -v h="$h" -v r="$ref" -v s="$seconds" '
+            FNR == 1 { next }
+            NR == FNR { key = sprintf("%.0f", $1 / r); for (k=2; k<=NF; k++) v[key, k] = $k; next }
+            {
+                key = sprintf("%.0f", $1 / r); n++
+                for (k=2; k<=NF; k++) {
+                    d = $k - v[key, k]; if (d < 0) d = -d
+                    if (d > e) e = d
+                    sum += d; cells++
+                }
+            }
+            END { printf("%-8s %5g %8d %8.3f %11.4g %10.4g\n", m, h, n, s, sum / cells, e) }' master_error.csv result.csv
+    done
+done
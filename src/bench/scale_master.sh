@@ -0,0 +1,69 @@
+#!/bin/sh
+# -------------------------------------------------------------------------
+# scale_master.sh
+# Scaling of the co-simulation master with the number of step threads.
+# Generates a graph of many waterTankEnv/waterTankCtr pairs, simulates it
+# with --step-threads=1..n and reports the wall time of the simulation
+# loop and the speedup of each run. Checks that each result.csv is
+# identical to the sequential one.
+# The components are isolated, because waterTankEnv keeps global state.
+# Usage: scale_master.sh [<number of pairs> [<max threads> [<tEnd>]]]
+# Run 'make scalemaster' in src after 'make'. Not part of 'make test'.
+# -------------------------------------------------------------------------
+
+PAIRS=${1:-200}
+MAX_THREADS=${2:-$(getconf _NPROCESSORS_ONLN)}
+TEND=${3:-300}
+cd "$(dirname "$0")/../.." || exit 1
+GRAPH=$(mktemp scale_master.XXXXXX) || exit 1
+trap 'rm -f "$GRAPH" scale_master.csv' EXIT
+
+# pair i: the level of tank i controls its pump
+{
+    echo '<?xml version="1.0" encoding="UTF-8"?>'
+    echo '<Graph fmiVersion="1.0">'
+    echo '  <Components>'
+    i=0
+    while [ $i -lt "$PAIRS" ]; do
+        echo "    <Component modelName=\"waterTankEnv\" fmuPath=\"fmu/cs/waterTankEnv.fmu\">"
+        echo "      <Inputs><Port name=\"pump\" type=\"Boolean\" connection=\"p$i\"/></Inputs>"
+        echo "      <Outputs><Port name=\"level\" type=\"Real\" connection=\"l$i\"/></Outputs>"
+        echo "    </Component>"
+        echo "    <Component modelName=\"waterTankCtr\" fmuPath=\"fmu/cs/waterTankCtr.fmu\">"
+        echo "      <Inputs><Port name=\"level\" type=\"Real\" connection=\"l$i\"/></Inputs>"
+        echo "      <Outputs><Port name=\"pump\" type=\"Boolean\" connection=\"p$i\"/></Outputs>"
+        echo "    </Component>"
+        i=$((i + 1))
+    done
+    echo '  </Components>'
+    echo '  <Connections>'
+    i=0
+    while [ $i -lt "$PAIRS" ]; do
+        echo "    <Connection name=\"p$i\"/><Connection name=\"l$i\"/>"
+        i=$((i + 1))
+    done
+    echo '  </Connections>'
+    echo '</Graph>'
+} > "$GRAPH"
+
+echo "$((2 * PAIRS)) components, tEnd=$TEND, h=0.1"
+echo "threads  seconds  speedup"
+t=1
+while [ "$t" -le "$MAX_THREADS" ]; do
+    # the wall time of the simulation loop, see the summary of fmusim_cs
+    seconds=$(bin/fmusim_cs "$GRAPH" "$TEND" 0.1 0 s --isolate --selective --step-threads=$t \
+        | awk '/step threads/ { print $5 }')
+    if [ -z "$seconds" ]; then
+        echo "error: Simulation with $t threads failed"
+        exit 1
+    fi
+    if [ $t -eq 1 ]; then
+        base=$seconds
+        cp result.csv scale_master.csv
+    elif ! cmp -s result.csv scale_master.csv; then
+        echo "error: Results with $t threads differ from the sequential run"
+        exit 1
+    fi
+    awk -v t=$t -v s="$seconds" -v b="$base" 'BEGIN { printf("%7d %8.3f %8.2f\n", t, s, b / s) }'
+    t=$((t + 1))
+done
@@ -0,0 +1,217 @@
+/* -------------------------------------------------------------------------
+ * scale_parser.c
+ * Scalability benchmark of the model description parser. Writes synthetic
+ * modelDescription.xml files with 1k to 1M variables, ten times more for
+ * each size, and parses each in a child process with each tokenizer, so
+ * that the peak RSS of one size is not inherited by the next. Prints the
+ * best parse time, the time per variable and the peak RSS as CSV and as a
+ * bar plot of the time per variable, which is flat if parsing scales
+ * linearly. Also compares the growth of the parser stack with the fixed
+ * increment of 10 elements used before, see stack.c.
+ * Usage: scale_parser [<max number of variables> [<repetitions> [<csv file>]]]
+ * Run 'make scale' in src. Not part of 'make test'.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "xml_parser.h"
+#include "stack.h"
+#include "timings.h"
+
+#define DEFAULT_MAX_VARS 1000000
+#define DEFAULT_REPS 3
+#define MIN_VARS 1000
+#define XML_PATH "scale_parser.xml"
+#define PLOT_WIDTH 50   // chars of the longest bar
+
+static const char* tokenizerNames[] = { "expat", "insitu" };
+
+// Returns 0 to indicate failure
+// Writes the model description directly to the file, so that the
+// benchmark process stays small and its children inherit no large heap.
+static int generate(const char* path, int nVars, long* size) {
+    FILE* file = fopen(path, "wb");
+    struct stat st;
+    int i;
+    if (!file) return 0;
+    fprintf(file,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<fmiModelDescription fmiVersion=\"1.0\" modelName=\"scale\" "
+        "modelIdentifier=\"scale\" guid=\"{00000000-0000-0000-0000-000000000000}\" "
+        "numberOfContinuousStates=\"0\" numberOfEventIndicators=\"0\">\n"
+        "<ModelVariables>\n");
+    for (i = 0; i < nVars; i++) {
+        fprintf(file,
+            "  <ScalarVariable name=\"x%d\" valueReference=\"%d\" description=\"variable %d\" "
+            "variability=\"%s\" causality=\"%s\">\n"
+            "    <Real start=\"%d.5\" fixed=\"true\" unit=\"m\"/>\n"
+            "  </ScalarVariable>\n",
+            i, i, i, i % 3 ? "continuous" : "parameter",
+            i % 4 == 0 ? "input" : (i % 4 == 1 ? "output" : "internal"), i);
+    }
+    fprintf(file, "</ModelVariables>\n</fmiModelDescription>\n");
+    if (fclose(file) || stat(path, &st)) return 0;
+    *size = (long)st.st_size;
+    return 1;
+}
+
+// Child process: parses XML_PATH reps times with the given tokenizer and
+// writes the best time in seconds and the peak RSS in kB to fd.
+// Returns the exit status of the child.
+static int parseChild(Tokenizer tokenizer, int nVars, int reps, int fd) {
+    ParserContext* ctx = parserContextNew();
+    ModelDescription* md = NULL;
+    struct rusage usage;
+    double start, best = 1e30, result[2];
+    int r, n;
+    if (!ctx) return EXIT_FAILURE;
+    parserContextSetTokenizer(ctx, tokenizer);
+    for (r = 0; r < reps; r++) {
+        if (md) freeElement(md);
+        start = monotonicTime();
+        md = parseWithContext(ctx, XML_PATH);
+        start = monotonicTime() - start;
+        if (start < best) best = start;
+        if (!md) return EXIT_FAILURE;
+    }
+    for (n = 0; md->modelVariables[n]; n++);
+    if (n != nVars) return EXIT_FAILURE;
+    getrusage(RUSAGE_SELF, &usage);
+    result[0] = best;
+    result[1] = (double)usage.ru_maxrss; // kB on Linux
+    if (write(fd, result, sizeof(result)) != sizeof(result)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+// Returns 0 to indicate failure
+// Sets *seconds and *peakKB of parsing XML_PATH in a child process
+static int parseInChild(Tokenizer tokenizer, int nVars, int reps, double* seconds, double* peakKB) {
+    double result[2];
+    int fd[2], status, ok;
+    pid_t pid;
+    if (pipe(fd)) return 0;
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) return 0;
+    if (pid == 0) {
+        close(fd[0]);
+        _exit(parseChild(tokenizer, nVars, reps, fd[1]));
+    }
+    close(fd[1]);
+    ok = read(fd[0], result, sizeof(result)) == sizeof(result);
+    close(fd[0]);
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return 0;
+    if (!ok) return 0;
+    *seconds = result[0];
+    *peakKB = result[1];
+    return 1;
+}
+
+// stack growth before stackPush grew geometrically: a fixed increment
+static int linearPush(Stack* s, void* e) {
+    s->stackPos++;
+    if (s->stackPos == s->stackSize) {
+        void** stack;
+        s->stackSize += s->stack ? s->inc : s->initialSize;
+        stack = (void**)realloc(s->stack, s->stackSize * sizeof(void*));
+        if (!stack) return 0;
+        s->stack = stack;
+    }
+    s->stack[s->stackPos] = e;
+    return 1;
+}
+
+// Returns the best seconds of reps to push n elements onto a new stack and
+// pop them as one list, as popList does for the variables of a model description
+static double timePush(int n, int geometric, int reps) {
+    double start, best = 1e30;
+    int i, r, ok = 1;
+    for (r = 0; ok && r < reps; r++) {
+        Stack* s = stackNew(100, 10);
+        start = monotonicTime();
+        ok = s != NULL;
+        for (i = 0; ok && i < n; i++)
+            ok = geometric ? stackPush(s, s) : linearPush(s, s);
+        if (ok) stackPopN(s, n);
+        start = monotonicTime() - start;
+        if (start < best) best = start;
+        if (s) stackFree(s);
+    }
+    return ok ? best : -1;
+}
+
+int main(int argc, char *argv[]) {
+    int maxVars = argc > 1 ? atoi(argv[1]) : DEFAULT_MAX_VARS;
+    int reps = argc > 2 ? atoi(argv[2]) : DEFAULT_REPS;
+    const char* csvPath = argc > 3 ? argv[3] : NULL;
+    double seconds[16][2], peakKB[16][2], nsMax = 0, linear, geometric;
+    int sizes[16];
+    long bytes[16];
+    int nSizes = 0, i, t;
+    FILE* csv = NULL;
+
+    if (maxVars < MIN_VARS || reps <= 0) {
+        printf("usage: %s [<max number of variables> [<repetitions> [<csv file>]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (csvPath && !(csv = fopen(csvPath, "w"))) {
+        printf("error: Could not open %s\n", csvPath);
+        return EXIT_FAILURE;
+    }
+    printf("variables,bytes,parser,ms,ns_per_variable,peak_rss_mb\n");
+    if (csv) fprintf(csv, "variables,bytes,parser,ms,ns_per_variable,peak_rss_mb\n");
+    for (i = MIN_VARS; i <= maxVars && nSizes < 16; i *= 10) {
+        sizes[nSizes] = i;
+        if (!generate(XML_PATH, i, &bytes[nSizes])) {
+            printf("error: Could not write %s\n", XML_PATH);
+            return EXIT_FAILURE;
+        }
+        for (t = tokenizerExpat; t <= tokenizerInSitu; t++) {
+            double ns;
+            if (!parseInChild((Tokenizer)t, i, reps, &seconds[nSizes][t], &peakKB[nSizes][t])) {
+                printf("error: Parsing %s with %d variables failed\n", XML_PATH, i);
+                unlink(XML_PATH);
+                return EXIT_FAILURE;
+            }
+            ns = 1e9 * seconds[nSizes][t] / i;
+            if (ns > nsMax) nsMax = ns;
+            printf("%d,%ld,%s,%.3f,%.1f,%.1f\n", i, bytes[nSizes], tokenizerNames[t],
+                1000 * seconds[nSizes][t], ns, peakKB[nSizes][t] / 1024);
+            if (csv) fprintf(csv, "%d,%ld,%s,%.3f,%.1f,%.1f\n", i, bytes[nSizes], tokenizerNames[t],
+                1000 * seconds[nSizes][t], ns, peakKB[nSizes][t] / 1024);
+        }
+        nSizes++;
+    }
+    unlink(XML_PATH);
+    if (csv) fclose(csv);
+
+    // time per variable, flat if parsing scales linearly
+    printf("\nns per variable, peak RSS per variable\n");
+    for (i = 0; i < nSizes; i++) {
+        for (t = tokenizerExpat; t <= tokenizerInSitu; t++) {
+            double ns = 1e9 * seconds[i][t] / sizes[i];
+            int bar = (int)(PLOT_WIDTH * ns / nsMax + 0.5);
+            printf("  %8d %-6s %7.1f ns %6.0f B |%.*s\n", sizes[i], tokenizerNames[t], ns,
+                1024 * peakKB[i][t] / sizes[i], bar,
+                "##################################################");
+        }
+    }
+
+    // push the variables of the largest model onto the parser stack
+    printf("\npush %d elements  %10s %10s %9s\n", sizes[nSizes - 1], "inc 10", "geometric", "speedup");
+    linear = timePush(sizes[nSizes - 1], 0, reps);
+    geometric = timePush(sizes[nSizes - 1], 1, reps);
+    if (linear < 0 || geometric < 0) {
+        printf("error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    printf("  %-20s %7.3f ms %7.3f ms %8.1fx\n", "stackPush", 1000 * linear, 1000 * geometric,
+        geometric > 0 ? linear / geometric : 0);
+    return EXIT_SUCCESS;
+}
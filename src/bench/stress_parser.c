@@ -0,0 +1,221 @@
+/* -------------------------------------------------------------------------
+ * stress_parser.c
+ * Parses hundreds of model descriptions and graphs concurrently on a
+ * thread pool, one ParserContext per task, and checks that each result
+ * matches the result of parsing the same file sequentially with expat.
+ * Every other task uses the in-situ tokenizer, see xml_scanner.h. A few
+ * of the files are invalid, to exercise the error paths as well.
+ * Usage: stress_parser [<number of files> [<number of threads> [<rounds>]]]
+ * Run 'make stress' in src, which builds this with ThreadSanitizer.
+ * Not part of 'make test'.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "xml_parser.h"
+#include "log_buffer.h"
+#include "thread_pool.h"
+#include "timings.h"
+
+#define DEFAULT_FILES 400
+#define DEFAULT_ROUNDS 3
+#define DEFAULT_THREADS 8  // independent of the number of processors, to provoke races
+#define MAX_PATH 256
+
+typedef enum { fileModel, fileGraph, fileInvalid } FileKind;
+
+typedef struct {
+    char (*paths)[MAX_PATH];
+    FileKind* kinds;
+    unsigned long* expected;  // fingerprint of each file, parsed sequentially
+    unsigned long* found;     // fingerprint of each file, parsed concurrently
+    int nFiles;
+    int nTasks;
+} StressData;
+
+static unsigned long hashString(unsigned long h, const char* s) {
+    for (; s && *s; s++) h = h * 31 + (unsigned char)*s;
+    return h;
+}
+
+// Returns 0 to indicate failure
+static int writeModel(const char* path, int k, int nVars) {
+    int i;
+    FILE* file = fopen(path, "w");
+    if (!file) return 0;
+    fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<fmiModelDescription fmiVersion=\"1.0\" modelName=\"m%d\" modelIdentifier=\"m%d\" "
+        "guid=\"{%d}\" numberOfContinuousStates=\"0\" numberOfEventIndicators=\"0\">\n"
+        "<TypeDefinitions><Type name=\"Length\"><RealType unit=\"m\"/></Type></TypeDefinitions>\n"
+        "<ModelVariables>\n", k, k, k);
+    for (i = 0; i < nVars; i++) {
+        fprintf(file, "<ScalarVariable name=\"m%d.v%d\" valueReference=\"%d\" causality=\"%s\">",
+            k, i, i, i % 2 ? "output" : "input");
+        if (i % 3) fprintf(file, "<Real declaredType=\"Length\" start=\"%d\"/>", i);
+        else fprintf(file, "<Integer start=\"%d\"/>", i);
+        fprintf(file, "</ScalarVariable>\n");
+    }
+    fprintf(file, "</ModelVariables>\n</fmiModelDescription>\n");
+    return fclose(file) == 0;
+}
+
+// Returns 0 to indicate failure
+static int writeGraph(const char* path, int k, int nComponents) {
+    int i;
+    FILE* file = fopen(path, "w");
+    if (!file) return 0;
+    fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Graph fmiVersion=\"1.0\">\n<Components>\n");
+    for (i = 0; i < nComponents; i++) {
+        fprintf(file, "<Component modelName=\"c%d\" fmuPath=\"fmu/g%d/c%d.fmu\">\n"
+            "<Inputs><Port name=\"u\" type=\"Real\" connection=\"x%d\"/></Inputs>\n"
+            "<Outputs><Port name=\"y\" type=\"Real\" connection=\"x%d\"/></Outputs>\n"
+            "</Component>\n", i, k, i, i, (i + 1) % nComponents);
+    }
+    fprintf(file, "</Components>\n<Connections>\n");
+    for (i = 0; i < nComponents; i++) fprintf(file, "<Connection name=\"x%d\"/>\n", i);
+    fprintf(file, "</Connections>\n</Graph>\n");
+    return fclose(file) == 0;
+}
+
+// Returns 0 to indicate failure
+static int writeInvalid(const char* path, int k) {
+    FILE* file = fopen(path, "w");
+    if (!file) return 0;
+    if (k % 2) fprintf(file, "<fmiModelDescription fmiVersion=\"1.0\"><ModelVariables><Bogus/>");
+    else fprintf(file, "<fmiModelDescription fmiVersion=\"1.0\" bogus=\"%d\"/>", k);
+    return fclose(file) == 0;
+}
+
+// 0 if parsing failed, otherwise a hash of the parsed AST
+static unsigned long parseFingerprint(ParserContext* ctx, const char* path, FileKind kind) {
+    unsigned long h = 1;
+    int i;
+    if (kind == fileGraph) {
+        Graph* g = parseGraphWithContext(ctx, path);
+        if (!g) return 0;
+        for (i = 0; g->components[i]; i++) {
+            h = hashString(h, getString(g->components[i], att_fmuPath));
+            h = hashString(h, getString(g->components[i]->outputs[0], att_connection));
+        }
+        for (i = 0; g->connections[i]; i++) h = hashString(h, getName(g->connections[i]));
+        freeElement(g);
+    }
+    else {
+        ModelDescription* md = parseWithContext(ctx, path);
+        if (!md) return 0;
+        h = hashString(h, getModelIdentifier(md));
+        for (i = 0; md->modelVariables[i]; i++) {
+            ScalarVariable* sv = md->modelVariables[i];
+            h = hashString(h, getName(sv)) + getValueReference(sv);
+            h = hashString(h, getString2(md, sv->typeSpec, att_unit));
+            if (getVariableByName(md, getName(sv)) != sv) h++;
+        }
+        freeElement(md);
+    }
+    return h ? h : 1;
+}
+
+// task i parses the files i, i+nTasks, ... with its own context,
+// in situ if i is odd
+static void parseTask(void* data, int i) {
+    StressData* d = (StressData*)data;
+    LogBuffer log = { NULL, 0, 0 };
+    ParserContext* ctx = parserContextNew();
+    int k;
+    if (!ctx) return;
+    if (i % 2) parserContextSetTokenizer(ctx, tokenizerInSitu);
+    logCapture(&log); // discard the messages of the invalid files
+    for (k = i; k < d->nFiles; k += d->nTasks) {
+        d->found[k] = parseFingerprint(ctx, d->paths[k], d->kinds[k]);
+    }
+    logCapture(NULL);
+    free(log.text);
+    parserContextFree(ctx);
+}
+
+int main(int argc, char *argv[]) {
+    int nFiles = argc > 1 ? atoi(argv[1]) : DEFAULT_FILES;
+    int nThreads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+    int rounds = argc > 3 ? atoi(argv[3]) : DEFAULT_ROUNDS;
+    char dir[] = "/tmp/stress_parser.XXXXXX";
+    StressData d;
+    ThreadPool* pool;
+    LogBuffer log = { NULL, 0, 0 };
+    ParserContext* ctx;
+    double start;
+    int i, r, nErrors = 0;
+
+    if (nFiles <= 0 || nThreads < 0 || rounds <= 0) {
+        printf("usage: %s [<number of files> [<number of threads> [<rounds>]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!mkdtemp(dir)) {
+        printf("error: Could not create %s\n", dir);
+        return EXIT_FAILURE;
+    }
+    d.nFiles = nFiles;
+    d.paths = malloc(nFiles * sizeof(*d.paths));
+    d.kinds = (FileKind*)malloc(nFiles * sizeof(FileKind));
+    d.expected = (unsigned long*)calloc(nFiles, sizeof(unsigned long));
+    d.found = (unsigned long*)calloc(nFiles, sizeof(unsigned long));
+    ctx = parserContextNew();
+    pool = threadPoolNew(nThreads);
+    if (!d.paths || !d.kinds || !d.expected || !d.found || !ctx || !pool) {
+        printf("error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // write the files and parse them sequentially, reusing one context
+    logCapture(&log);
+    for (i = 0; i < nFiles; i++) {
+        int ok;
+        sprintf(d.paths[i], "%s/%d.xml", dir, i);
+        d.kinds[i] = i % 10 == 9 ? fileInvalid : (i % 4 == 3 ? fileGraph : fileModel);
+        switch (d.kinds[i]) {
+            case fileModel:   ok = writeModel(d.paths[i], i, 50 + (i * 37) % 500); break;
+            case fileGraph:   ok = writeGraph(d.paths[i], i, 2 + i % 50); break;
+            default:          ok = writeInvalid(d.paths[i], i); break;
+        }
+        if (!ok) {
+            printf("error: Could not write %s\n", d.paths[i]);
+            return EXIT_FAILURE;
+        }
+        d.expected[i] = parseFingerprint(ctx, d.paths[i], d.kinds[i]);
+        if (!d.expected[i] != (d.kinds[i] == fileInvalid)) {
+            logCapture(NULL);
+            logFlush(&log);
+            printf("error: Unexpected result for %s\n", d.paths[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    logCapture(NULL);
+    free(log.text);
+    parserContextFree(ctx);
+
+    // parse them concurrently, several tasks per thread
+    d.nTasks = 4 * threadPoolSize(pool);
+    printf("parsing %d files in %d tasks on %d threads\n", nFiles, d.nTasks, threadPoolSize(pool));
+    for (r = 0; r < rounds; r++) {
+        memset(d.found, 0, nFiles * sizeof(unsigned long));
+        start = monotonicTime();
+        threadPoolRun(pool, parseTask, &d, d.nTasks);
+        for (i = 0; i < nFiles; i++) {
+            if (d.found[i] == d.expected[i]) continue;
+            printf("error: Concurrent result differs for %s\n", d.paths[i]);
+            nErrors++;
+        }
+        printf("  round %d: %.1f ms\n", r + 1, 1000 * (monotonicTime() - start));
+    }
+    threadPoolFree(pool);
+
+    for (i = 0; i < nFiles; i++) unlink(d.paths[i]);
+    rmdir(dir);
+    free(d.paths);
+    free(d.kinds);
+    free(d.expected);
+    free(d.found);
+    printf(nErrors ? "FAILED\n" : "OK\n");
+    return nErrors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
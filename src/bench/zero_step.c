@@ -0,0 +1,60 @@
+/* -------------------------------------------------------------------------
+ * zero_step.c
+ * Checks that a step of length zero of an FMU built from fmuTemplate.c
+ * fires the state event caused by a value set after the last step, see
+ * doStep in fmuTemplate.c. Links the waterTank model directly, steps it
+ * until the level is above 3, lowers the upper threshold H below the level
+ * and expects one fmiDoStep with step size 0 to switch the pump off,
+ * while a step of length zero without a new value changes nothing.
+ * Built and run by bench/event_master.sh. Not part of 'make test'.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include "waterTank/waterTank.c"
+
+static void logger(fmiComponent c, fmiString instanceName, fmiStatus status,
+        fmiString category, fmiString message, ...) {
+    va_list args;
+    va_start(args, message);
+    vprintf(message, args);
+    va_end(args);
+    printf("\n");
+}
+
+// Returns 0 to indicate failure
+static int check(const char* what, int ok) {
+    if (!ok) printf("error: %s\n", what);
+    return ok;
+}
+
+int main() {
+    fmiCallbackFunctions functions = { logger, calloc, free, NULL };
+    fmiValueReference vrH = H_, vrLevel = level_, vrPump = pump_;
+    fmiReal t = 0, h = 0.5, H = 3, level;
+    fmiBoolean pump;
+    fmiComponent c = fmiInstantiateSlave("tank", MODEL_GUID, "", "", 0, fmiFalse, fmiFalse, functions, fmiFalse);
+    int ok;
+    if (!check("Could not instantiate the waterTank", c != NULL)) return EXIT_FAILURE;
+    ok = check("Could not initialize the waterTank", fmiInitializeSlave(c, 0, fmiFalse, 0) == fmiOK);
+    for (level = 0; ok && level <= H; t += h) {
+        ok = check("Could not step the waterTank", fmiDoStep(c, t, h, fmiTrue) == fmiOK)
+            && fmiGetReal(c, &vrLevel, 1, &level) == fmiOK;
+    }
+    if (ok) {
+        fmiDoStep(c, t, 0, fmiTrue);
+        fmiGetBoolean(c, &vrPump, 1, &pump);
+        ok = check("A step of length zero without a new value switched the pump", pump);
+    }
+    if (ok) {
+        H = level - 0.5;
+        fmiSetReal(c, &vrH, 1, &H);
+        fmiDoStep(c, t, 0, fmiTrue);
+        fmiGetBoolean(c, &vrPump, 1, &pump);
+        ok = check("A step of length zero after H was set below the level did not switch the pump off", !pump);
+    }
+    fmiTerminateSlave(c);
+    fmiFreeSlaveInstance(c);
+    if (ok) printf("A step of length zero fires the event of a new value\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -22,6 +22,8 @@ if defined VS80COMNTOOLS (call "%VS80COMNTOOLS%\vsvars32.bat") else ^
 goto noCompiler
 
 set SRC=fmusim_cs\main.c ..\shared\xml_parser.c ..\shared\stack.c ..\shared\sim_support.c
+set SRC=%SRC% ..\shared\log_buffer.c ..\shared\thread_pool.c ..\shared\timings.c ..\shared\arena.c ..\shared\xml_scanner.c
+set SRC=%SRC% fmusim_cs\exchange.c fmusim_cs\schedule.c fmusim_cs\async_steps.c fmusim_cs\signals.c fmusim_cs\events.c fmusim_cs\ensemble.c
 set INC=/Iinclude /I../shared /Ifmusim_cs
 set OPTIONS=/DFMI_COSIMULATION /wd4090 /nologo
 
@@ -22,6 +22,7 @@ if defined VS80COMNTOOLS (call "%VS80COMNTOOLS%\vsvars32.bat") else ^
 goto noCompiler
 
 set SRC=fmusim_me\main.c ..\shared\xml_parser.c ..\shared\stack.c ..\shared\sim_support.c
+set SRC=%SRC% ..\shared\log_buffer.c ..\shared\thread_pool.c ..\shared\timings.c ..\shared\arena.c ..\shared\xml_scanner.c
 set INC=/Iinclude /I../shared /Ifmusim_me
 set OPTIONS=/wd4090 /nologo
 
@@ -0,0 +1,242 @@
+/* -------------------------------------------------------------------------
+ * async_steps.c
+ * Tracks the pending steps of the master, see async_steps.h.
+ * The slaves call stepFinished without a pointer to the master, so the
+ * AsyncSteps of all simulations that run, one per run of an ensemble, are
+ * kept in a list and searched for the instance. Waiting also polls
+ * fmiGetStatus(fmiDoStepStatus) now and then, in case a slave finishes
+ * its step without calling stepFinished. fmiGetStatus is optional, so
+ * slaves without it are only waited for by stepFinished. Without pthreads,
+ * e.g. on Windows, the master only polls, and fmiPending is an error for
+ * slaves without fmiGetStatus.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "async_steps.h"
+
+#define POLL_MS 10          // interval of polling fmiGetStatus while waiting
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+
+struct AsyncSteps {
+    ExchangePlan* plan;
+    char* allowed;           // per component: 1 if its FMU can run asynchronously
+    int* slots;              // hash index of the instances: component index + 1, 0 if empty
+    unsigned int mask;       // number of slots - 1
+    int* pending;            // indexes of the components with a pending step
+    int nPending;
+    fmiStatus* finished;     // per component: result of stepFinished, fmiPending until called
+#ifndef _MSC_VER
+    pthread_mutex_t lock;    // protects pending, nPending and finished
+    pthread_cond_t done;     // signals a call of stepFinished
+#endif
+    AsyncSteps* next;        // the next steps in the list of active steps
+};
+
+static AsyncSteps* active = NULL; // the steps that stepFinished reports to, linked by next
+#ifndef _MSC_VER
+static pthread_mutex_t activeLock = PTHREAD_MUTEX_INITIALIZER; // protects the list of active steps
+#endif
+
+static unsigned int hashPointer(const void* p) {
+    unsigned long long x = (unsigned long long)(size_t)p >> 3;
+    x *= 0x9E3779B97F4A7C15ULL;
+    return (unsigned int)(x >> 32);
+}
+
+// Returns -1 if c is not the instance of a component
+static int componentOf(AsyncSteps* steps, fmiComponent c) {
+    unsigned int h;
+    for (h = hashPointer(c) & steps->mask; steps->slots[h]; h = (h + 1) & steps->mask) {
+        int i = steps->slots[h] - 1;
+        if (steps->plan->components[i].component->instance == c) return i;
+    }
+    return -1;
+}
+
+// Returns NULL to indicate failure
+// To be called after the components have been instantiated.
+AsyncSteps* asyncStepsNew(ExchangePlan* plan) {
+    AsyncSteps* steps = (AsyncSteps*)calloc(1, sizeof(AsyncSteps));
+    unsigned int size = 16, h;
+    int i;
+    if (!steps) return NULL;
+    while (size < 2 * (unsigned int)plan->n) size *= 2;
+    steps->plan = plan;
+    steps->mask = size - 1;
+    steps->slots = (int*)calloc(size, sizeof(int));
+    steps->allowed = (char*)calloc(plan->n + 1, sizeof(char));
+    steps->pending = (int*)calloc(plan->n + 1, sizeof(int));
+    steps->finished = (fmiStatus*)calloc(plan->n + 1, sizeof(fmiStatus));
+    if (!steps->slots || !steps->allowed || !steps->pending || !steps->finished) {
+        free(steps->slots);
+        free(steps->allowed);
+        free(steps->pending);
+        free(steps->finished);
+        free(steps);
+        return NULL;
+    }
+    for (i=0; i<plan->n; i++) {
+        ValueStatus vs;
+        Component* c = plan->components[i].component;
+        CoSimulation* cs = ((FMU*)c->fmu)->modelDescription->cosimulation;
+        steps->allowed[i] = cs && getBoolean(cs->capabilities, att_canRunAsynchronuously, &vs);
+#ifdef _MSC_VER
+        if (!((FMU*)c->fmu)->getStatus) steps->allowed[i] = 0; // could never be polled
+#endif
+        steps->finished[i] = fmiPending;
+        for (h = hashPointer(c->instance) & steps->mask; steps->slots[h]; h = (h + 1) & steps->mask);
+        steps->slots[h] = i + 1;
+    }
+#ifndef _MSC_VER
+    pthread_mutex_init(&steps->lock, NULL);
+    pthread_cond_init(&steps->done, NULL);
+    pthread_mutex_lock(&activeLock);
+#endif
+    steps->next = active;
+    active = steps;
+#ifndef _MSC_VER
+    pthread_mutex_unlock(&activeLock);
+#endif
+    return steps;
+}
+
+void asyncStepsFree(AsyncSteps* steps) {
+    AsyncSteps** p;
+    if (!steps) return;
+#ifndef _MSC_VER
+    pthread_mutex_lock(&activeLock);
+#endif
+    for (p = &active; *p && *p != steps; p = &(*p)->next);
+    if (*p) *p = steps->next;
+#ifndef _MSC_VER
+    pthread_mutex_unlock(&activeLock);
+    pthread_mutex_destroy(&steps->lock);
+    pthread_cond_destroy(&steps->done);
+#endif
+    free(steps->slots);
+    free(steps->allowed);
+    free(steps->pending);
+    free(steps->finished);
+    free(steps);
+}
+
+// true if component i may return fmiPending from fmiDoStep
+int asyncStepsAllowed(AsyncSteps* steps, int i) {
+    return steps->allowed[i];
+}
+
+// fmiDoStep of component i returned fmiPending. Thread-safe.
+void asyncStepPending(AsyncSteps* steps, int i) {
+#ifndef _MSC_VER
+    pthread_mutex_lock(&steps->lock);
+#endif
+    steps->pending[steps->nPending++] = i;
+#ifndef _MSC_VER
+    pthread_mutex_unlock(&steps->lock);
+#endif
+}
+
+// The stepFinished callback of all slaves, called from the thread of the slave.
+// It may be called before fmiDoStep has returned fmiPending.
+void asyncStepFinished(fmiComponent c, fmiStatus status) {
+    AsyncSteps* steps;
+    int i = -1;
+#ifndef _MSC_VER
+    pthread_mutex_lock(&activeLock);
+#endif
+    for (steps = active; steps && (i = componentOf(steps, c)) < 0; steps = steps->next);
+    if (steps) {
+#ifndef _MSC_VER
+        pthread_mutex_lock(&steps->lock);
+#endif
+        steps->finished[i] = status;
+#ifndef _MSC_VER
+        pthread_cond_broadcast(&steps->done);
+        pthread_mutex_unlock(&steps->lock);
+#endif
+    }
+#ifndef _MSC_VER
+    pthread_mutex_unlock(&activeLock);
+#endif
+}
+
+// Returns the number of pending steps that are not finished yet.
+// Asks the slaves that did not call stepFinished yet for their status.
+// To be called without the lock, as the slaves may call stepFinished.
+static int pollSteps(AsyncSteps* steps) {
+    int k, i, open, nOpen = 0;
+    for (k=0; k<steps->nPending; k++) {
+        Component* c;
+        fmiStatus status;
+        i = steps->pending[k];
+        c = steps->plan->components[i].component;
+#ifndef _MSC_VER
+        pthread_mutex_lock(&steps->lock);
+#endif
+        open = steps->finished[i] == fmiPending;
+#ifndef _MSC_VER
+        pthread_mutex_unlock(&steps->lock);
+#endif
+        if (!open) continue;
+        if (!((FMU*)c->fmu)->getStatus) {
+            nOpen++; // wait for stepFinished
+            continue;
+        }
+        if (((FMU*)c->fmu)->getStatus(c->instance, fmiDoStepStatus, &status) > fmiWarning) status = fmiError;
+        if (status == fmiPending) {
+            nOpen++;
+            continue;
+        }
+#ifndef _MSC_VER
+        pthread_mutex_lock(&steps->lock);
+#endif
+        if (steps->finished[i] == fmiPending) steps->finished[i] = status;
+#ifndef _MSC_VER
+        pthread_mutex_unlock(&steps->lock);
+#endif
+    }
+    return nOpen;
+}
+
+// Waits until all pending steps are finished and sets their status in
+// stepStatus, indexed by component. No step is pending afterwards.
+void asyncStepsWait(AsyncSteps* steps, fmiStatus* stepStatus) {
+    int k, nOpen;
+#ifdef _MSC_VER
+    while (pollSteps(steps)) Sleep(POLL_MS);
+#else
+    pthread_mutex_lock(&steps->lock);
+    for (;;) {
+        struct timeval now;
+        struct timespec until;
+        for (k=0, nOpen=0; k<steps->nPending; k++) nOpen += steps->finished[steps->pending[k]] == fmiPending;
+        if (!nOpen) break;
+        gettimeofday(&now, NULL);
+        until.tv_sec = now.tv_sec + (now.tv_usec + POLL_MS * 1000) / 1000000;
+        until.tv_nsec = (now.tv_usec + POLL_MS * 1000) % 1000000 * 1000;
+        if (pthread_cond_timedwait(&steps->done, &steps->lock, &until)) {
+            // no stepFinished within POLL_MS, fmiGetStatus must not be called with the lock held
+            pthread_mutex_unlock(&steps->lock);
+            nOpen = pollSteps(steps);
+            pthread_mutex_lock(&steps->lock);
+            if (!nOpen) break;
+        }
+    }
+#endif
+    for (k=0; k<steps->nPending; k++) {
+        int i = steps->pending[k];
+        stepStatus[i] = steps->finished[i];
+        steps->finished[i] = fmiPending;
+    }
+    steps->nPending = 0;
+#ifndef _MSC_VER
+    pthread_mutex_unlock(&steps->lock);
+#endif
+}
@@ -0,0 +1,24 @@
+/* -------------------------------------------------------------------------
+ * async_steps.h
+ * The steps of the components that run asynchronously. A slave that
+ * declares canRunAsynchronuously="true" may return fmiPending from
+ * fmiDoStep and carry out the step in the background. It then calls the
+ * stepFinished callback of the master, which waits for all pending steps
+ * of a communication step only after it has stepped all other components.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ASYNC_STEPS_H
+#define ASYNC_STEPS_H
+
+#include "exchange.h"
+
+typedef struct AsyncSteps AsyncSteps;
+
+AsyncSteps* asyncStepsNew(ExchangePlan* plan);
+int asyncStepsAllowed(AsyncSteps* steps, int i);
+void asyncStepPending(AsyncSteps* steps, int i);
+void asyncStepsWait(AsyncSteps* steps, fmiStatus* stepStatus);
+void asyncStepFinished(fmiComponent c, fmiStatus status);
+void asyncStepsFree(AsyncSteps* steps);
+
+#endif // ASYNC_STEPS_H
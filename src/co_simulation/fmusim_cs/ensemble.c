@@ -0,0 +1,217 @@
+/* -------------------------------------------------------------------------
+ * ensemble.c
+ * The parameter table of an ensemble, see ensemble.h.
+ * Values are separated by ',' and use '.' as decimal point, independent
+ * of the separator of result.csv. Empty lines are skipped.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ensemble.h"
+
+// Returns NULL to indicate failure
+// The content of the file, terminated by 0
+static char* readFile(const char* fileName) {
+    FILE* file = fopen(fileName, "rb");
+    char* text = NULL;
+    long size;
+    if (!file) return NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0
+            && (text = (char*)malloc(size + 1))) {
+        if (fread(text, 1, size, file) == (size_t)size) text[size] = 0;
+        else {
+            free(text);
+            text = NULL;
+        }
+    }
+    fclose(file);
+    return text;
+}
+
+// Terminates the line at p and returns the start of the next line, NULL at the end
+static char* nextLine(char* p) {
+    char* end = strchr(p, '\n');
+    if (end) *end++ = 0;
+    if (*p && p[strlen(p) - 1] == '\r') p[strlen(p) - 1] = 0;
+    return end;
+}
+
+// true if the line holds only white space
+static int isEmpty(const char* p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return !*p;
+}
+
+// Returns 0 to indicate failure
+// Splits the header line into the column names, trimmed of white space
+static int readHeader(Ensemble* e, char* line) {
+    char* p;
+    int k;
+    for (e->nColumns=1, p=line; *p; p++) e->nColumns += *p == ',';
+    e->names = (const char**)calloc(e->nColumns + 1, sizeof(const char*));
+    if (!e->names) return 0;
+    for (k=0, p=line; k<e->nColumns; k++) {
+        char* end = strchr(p, ',');
+        char* last;
+        if (end) *end = 0;
+        while (*p == ' ' || *p == '\t') p++;
+        for (last = p + strlen(p); last > p && (last[-1] == ' ' || last[-1] == '\t'); last--);
+        *last = 0;
+        e->names[k] = p;
+        p = end ? end + 1 : p + strlen(p);
+    }
+    return 1;
+}
+
+// Returns 0 to indicate failure
+// Reads the values of run r from line n of the file
+static int readRow(Ensemble* e, char* line, int r, int n) {
+    double* values = e->values + (size_t)r * e->nColumns;
+    char* p = line;
+    char* end;
+    int k;
+    for (k=0; k<e->nColumns; k++) {
+        values[k] = strtod(p, &end);
+        while (*end == ' ' || *end == '\t') end++;
+        if (end == p || *end != (k < e->nColumns - 1 ? ',' : 0)) {
+            printf("error: Line %d of the ensemble does not have %d numbers\n", n, e->nColumns);
+            return 0;
+        }
+        p = end + 1;
+    }
+    return 1;
+}
+
+// Returns 0 to indicate failure
+// Finds the variable of each column in the components of the graph
+static int findTargets(Ensemble* e, Graph* graph) {
+    Component** comps = graph->components;
+    int i, k, nComps;
+    for (nComps=0; comps[nComps]; nComps++);
+    e->targets = (EnsembleTarget*)calloc((size_t)e->nColumns * nComps + 1, sizeof(EnsembleTarget));
+    if (!e->targets) {
+        printf("error: Out of memory\n");
+        return 0;
+    }
+    for (k=0; k<e->nColumns; k++) {
+        int n = e->nTargets;
+        for (i=0; i<nComps; i++) {
+            const char* modelName = getString(comps[i], att_modelName);
+            size_t len = strlen(modelName);
+            ScalarVariable* sv;
+            EnsembleTarget* t = &e->targets[e->nTargets];
+            if (strncmp(e->names[k], modelName, len) || e->names[k][len] != '.') continue;
+            sv = getVariableByName(((FMU*)comps[i]->fmu)->modelDescription, e->names[k] + len + 1);
+            if (!sv) continue;
+            t->type = sv->typeSpec->type;
+            if (t->type == elm_String) {
+                printf("error: Variable %s of the ensemble is a String\n", e->names[k]);
+                return 0;
+            }
+            t->component = i;
+            t->column = k;
+            t->vr = getValueReference(sv);
+            e->nTargets++;
+        }
+        if (n == e->nTargets) {
+            printf("error: No component has the variable %s of the ensemble\n", e->names[k]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Returns NULL to indicate failure
+// Reads the parameter table of an ensemble of runs of the given graph.
+// To be called after the ports have been bound to their variables, see loadGraph.
+Ensemble* ensembleRead(const char* fileName, Graph* graph) {
+    Ensemble* e = (Ensemble*)calloc(1, sizeof(Ensemble));
+    char* line;
+    char* next;
+    int n, nLines = 0;
+    if (!e) {
+        printf("error: Out of memory\n");
+        return NULL;
+    }
+    e->text = readFile(fileName);
+    if (!e->text) {
+        printf("error: Could not read %s\n", fileName);
+        ensembleFree(e);
+        return NULL;
+    }
+    for (line=e->text; *line; line++) nLines += *line == '\n';
+
+    // the header is the first line that is not empty
+    for (line=e->text, n=1; line; line=next, n++) {
+        next = nextLine(line);
+        if (!isEmpty(line)) break;
+    }
+    if (!line) {
+        printf("error: The ensemble %s is empty\n", fileName);
+        ensembleFree(e);
+        return NULL;
+    }
+    if (!readHeader(e, line)
+            || !(e->values = (double*)malloc(((size_t)nLines + 1) * e->nColumns * sizeof(double)))) {
+        printf("error: Out of memory\n");
+        ensembleFree(e);
+        return NULL;
+    }
+    for (line=next, n++; line; line=next, n++) {
+        next = nextLine(line);
+        if (isEmpty(line)) continue;
+        if (!readRow(e, line, e->nRuns, n)) {
+            ensembleFree(e);
+            return NULL;
+        }
+        e->nRuns++;
+    }
+    if (!e->nRuns) {
+        printf("error: The ensemble %s has no runs\n", fileName);
+        ensembleFree(e);
+        return NULL;
+    }
+    if (!findTargets(e, graph)) {
+        ensembleFree(e);
+        return NULL;
+    }
+    return e;
+}
+
+// Returns 0 to indicate failure
+// Sets the variables of the given run in the instances of the graph, a
+// copy of the graph of ensembleRead with the same components
+int ensembleApply(Ensemble* e, Graph* graph, int run) {
+    const double* values = e->values + (size_t)run * e->nColumns;
+    int k;
+    for (k=0; k<e->nTargets; k++) {
+        EnsembleTarget* t = &e->targets[k];
+        Component* c = graph->components[t->component];
+        FMU* fmu = (FMU*)c->fmu;
+        double v = values[t->column];
+        fmiStatus status;
+        fmiInteger i = (fmiInteger)floor(v + 0.5);
+        fmiBoolean b = v != 0;
+        switch (t->type) {
+            case elm_Real:    status = fmu->setReal(c->instance, &t->vr, 1, &v); break;
+            case elm_Boolean: status = fmu->setBoolean(c->instance, &t->vr, 1, &b); break;
+            default:          status = fmu->setInteger(c->instance, &t->vr, 1, &i); break;
+        }
+        if (status > fmiWarning) {
+            printf("error: Could not set %s in run %d\n", e->names[t->column], run + 1);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void ensembleFree(Ensemble* e) {
+    if (!e) return;
+    free(e->text);
+    free((void*)e->names);
+    free(e->values);
+    free(e->targets);
+    free(e);
+}
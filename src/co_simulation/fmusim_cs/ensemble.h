@@ -0,0 +1,38 @@
+/* -------------------------------------------------------------------------
+ * ensemble.h
+ * The parameter table of an ensemble, see --ensemble: many runs of the
+ * same graph that differ in parameters and start values. The first line
+ * of the CSV file names a variable per column as <modelName>.<variable>,
+ * each further line gives the values of one run. A column sets the
+ * variable in every component with that modelName, after the component
+ * has been instantiated and before it is initialized.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "fmi_cs.h"
+
+// A variable of a component set by a column of the table
+typedef struct {
+    int component;              // index in graph->components
+    int column;
+    Elm type;                   // elm_Real, elm_Integer, elm_Enumeration or elm_Boolean
+    fmiValueReference vr;
+} EnsembleTarget;
+
+typedef struct {
+    int nRuns;
+    int nColumns;
+    const char** names;         // the header of each column
+    double* values;             // nRuns rows of nColumns values
+    int nTargets;
+    EnsembleTarget* targets;
+    char* text;                 // the content of the file, holds the names
+} Ensemble;
+
+Ensemble* ensembleRead(const char* fileName, Graph* graph);
+int ensembleApply(Ensemble* e, Graph* graph, int run);
+void ensembleFree(Ensemble* e);
+
+#endif // ENSEMBLE_H
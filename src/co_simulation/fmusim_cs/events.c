@@ -0,0 +1,68 @@
+/* -------------------------------------------------------------------------
+ * events.c
+ * The state of the event-aware master, see events.h.
+ * FMI for Co-Simulation 1.0 has no way to save and restore the state of
+ * a slave, so a step that passed an event cannot be repeated. The slaves
+ * that can signal events therefore step first, and only their own steps
+ * may pass the event of another one. Such a slave catches up in the next
+ * communication step.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "events.h"
+
+// Returns NULL to indicate failure
+// All components start at tStart. To be called with the plan of the master.
+EventControl* eventControlNew(ExchangePlan* plan, double tStart) {
+    EventControl* e = (EventControl*)calloc(1, sizeof(EventControl));
+    int i;
+    if (!e) return NULL;
+    e->plan = plan;
+    e->times = (double*)calloc(plan->n + 1, sizeof(double));
+    e->sources = (char*)calloc(plan->n + 1, sizeof(char));
+    e->zeroSteps = (char*)calloc(plan->n + 1, sizeof(char));
+    if (!e->times || !e->sources || !e->zeroSteps) {
+        eventControlFree(e);
+        return NULL;
+    }
+    for (i=0; i<plan->n; i++) {
+        ValueStatus vs;
+        CoSimulation* cs = ((FMU*)plan->components[i].component->fmu)->modelDescription->cosimulation;
+        e->times[i] = tStart;
+        e->sources[i] = cs && getBoolean(cs->capabilities, att_canSignalEvents, &vs);
+        e->zeroSteps[i] = cs && getBoolean(cs->capabilities, att_canHandleEvents, &vs);
+        e->nSources += e->sources[i];
+    }
+    return e;
+}
+
+void eventControlFree(EventControl* e) {
+    if (!e) return;
+    free(e->times);
+    free(e->sources);
+    free(e->zeroSteps);
+    free(e);
+}
+
+// Returns 0 to indicate failure
+// Component i returned fmiDiscard from a step that should end at target:
+// sets its time to the time of the event it stopped at
+int eventStopped(EventControl* e, int i, double target) {
+    Component* c = e->plan->components[i].component;
+    fmiReal time;
+    if (!e->sources[i]) {
+        printf("error: %s stopped its step, but does not declare canSignalEvents\n", getString(c, att_modelName));
+        return 0;
+    }
+    // fmiGetRealStatus is optional, without it the event time is unknown
+    if (!((FMU*)c->fmu)->getRealStatus
+            || ((FMU*)c->fmu)->getRealStatus(c->instance, fmiLastSuccessfulTime, &time) > fmiWarning
+            || time <= e->times[i] || time > target) {
+        printf("error: %s stopped its step, but reports no event time in it\n", getString(c, att_modelName));
+        return 0;
+    }
+    e->times[i] = time;
+    e->nCut++;
+    return 1;
+}
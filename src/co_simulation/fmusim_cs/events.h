@@ -0,0 +1,37 @@
+/* -------------------------------------------------------------------------
+ * events.h
+ * The state of the event-aware master, see --events. Each communication
+ * step first steps the components that declare canSignalEvents="true".
+ * Such a slave may stop at an event inside the step and return fmiDiscard
+ * with the event time as fmiLastSuccessfulTime; the step of the other
+ * components then ends at the earliest event. After a step that was cut
+ * or changed an integer or boolean signal, the components that declare
+ * canHandleEvents="true" take zero-length steps with the new inputs until
+ * no such signal changes, so an event reaches its consumers at its own
+ * time and not one step later.
+ * -------------------------------------------------------------------------*/
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "exchange.h"
+
+#define MAX_EVENT_ITERATIONS 10 // zero-length batches per communication point
+
+typedef struct {
+    ExchangePlan* plan;
+    double* times;              // per component: the time it has reached
+    char* sources;              // per component: 1 if it can signal events
+    char* zeroSteps;            // per component: 1 if it can take zero-length steps
+    int nSources;               // number of components that can signal events
+    int nEvents;                // number of communication points with an event
+    int nCut;                   // number of steps cut at an event
+    long nZeroSteps;            // number of zero-length steps
+    int nUnconverged;           // number of communication points without a converged event iteration
+} EventControl;
+
+EventControl* eventControlNew(ExchangePlan* plan, double tStart);
+int eventStopped(EventControl* e, int i, double target);
+void eventControlFree(EventControl* e);
+
+#endif // EVENTS_H
@@ -0,0 +1,227 @@
+/* -------------------------------------------------------------------------
+ * exchange.c
+ * The exchange plan of the co-simulation master, see exchange.h.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include "exchange.h"
+
+// Returns -1 for variables not exchanged by the master
+static int variableType(ScalarVariable* sv) {
+    switch (sv->typeSpec->type) {
+        case elm_Real:    return portReal;
+        case elm_Integer: return portInteger;
+        case elm_Boolean: return portBoolean;
+        case elm_String:  return portString;
+        default:          return -1;
+    }
+}
+
+// Returns 0 to indicate failure
+// Groups the connected ports by the base type of their variables.
+// Ports without a connection are not exchanged.
+static int compileGroups(Arena* arena, Component* c, Port** ports, PortGroup* groups) {
+    int n, t;
+    for (n=0; ports && ports[n]; n++) {
+        if (!ports[n]->connection) continue;
+        if (!ports[n]->variable) {
+            printf("error: Component %s has no variable %s\n", getString(c, att_modelName), getName(ports[n]));
+            return 0;
+        }
+        t = variableType(ports[n]->variable);
+        if (t >= 0 && t != portType(ports[n]->connection->valueType)) {
+            printf("error: Variable %s of component %s does not have the type of connection %s\n",
+                    getName(ports[n]), getString(c, att_modelName), getName(ports[n]->connection));
+            return 0;
+        }
+        if (t >= 0) groups[t].n++;
+    }
+    for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+        PortGroup* g = &groups[t];
+        if (!g->n) continue;
+        g->vrs = (fmiValueReference*)arenaAlloc(arena, g->n * sizeof(fmiValueReference));
+        g->values = arenaAlloc(arena, g->n * signalSize(t));
+        g->signals = (int*)arenaAlloc(arena, g->n * sizeof(int));
+        if (!g->vrs || !g->values || !g->signals) {
+            printf("error: Out of memory\n");
+            return 0;
+        }
+        g->n = 0;
+    }
+    for (n=0; ports && ports[n]; n++) {
+        PortGroup* g;
+        if (!ports[n]->connection) continue;
+        t = variableType(ports[n]->variable);
+        if (t < 0) continue;
+        g = &groups[t];
+        g->vrs[g->n] = getValueReference(ports[n]->variable);
+        g->signals[g->n] = ports[n]->connection->signal;
+        g->n++;
+    }
+    return 1;
+}
+
+// Returns NULL to indicate failure
+// The plan is allocated in the arena of the graph, except for its signal
+// buffer, see exchangePlanFree. To be called after the ports have been
+// bound to their variables, see loadGraph.
+ExchangePlan* exchangePlanNew(Graph* graph) {
+    ExchangePlan* plan = (ExchangePlan*)arenaAlloc(graph->arena, sizeof(ExchangePlan));
+    int i;
+    if (!plan || !(plan->signals = signalBufferNew(graph))) {
+        printf("error: Out of memory\n");
+        return NULL;
+    }
+    for (plan->n=0; graph->components[plan->n]; plan->n++);
+    plan->components = (ComponentPlan*)arenaAlloc(graph->arena, (plan->n + 1) * sizeof(ComponentPlan));
+    if (!plan->components) {
+        printf("error: Out of memory\n");
+        return NULL;
+    }
+    for (i=0; i<plan->n; i++) {
+        Component* c = graph->components[i];
+        ComponentPlan* p = &plan->components[i];
+        p->component = c;
+        if (!compileGroups(graph->arena, c, c->outputs, p->outputs)
+                || !compileGroups(graph->arena, c, c->inputs, p->inputs)) {
+            signalBufferFree(plan->signals);
+            return NULL;
+        }
+    }
+    return plan;
+}
+
+// Returns NULL to indicate failure
+// A copy of the plan for the given components, copies of those of the
+// plan in the same order, e.g. for a run of an ensemble. The copy has its
+// own signal buffer and values, and shares the value references and
+// signals of the plan. Allocated in the given arena, to be released with
+// exchangePlanFree.
+ExchangePlan* exchangePlanClone(ExchangePlan* plan, Graph* graph, Component** components) {
+    ExchangePlan* copy = (ExchangePlan*)arenaAlloc(graph->arena, sizeof(ExchangePlan));
+    int i, k, t;
+    if (!copy) return NULL;
+    copy->n = plan->n;
+    copy->components = (ComponentPlan*)arenaAlloc(graph->arena, (plan->n + 1) * sizeof(ComponentPlan));
+    if (!copy->components) return NULL;
+    for (i=0; i<plan->n; i++) {
+        copy->components[i] = plan->components[i];
+        copy->components[i].component = components[i];
+        for (k=0; k<2; k++) {
+            PortGroup* g = k ? copy->components[i].inputs : copy->components[i].outputs;
+            for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+                if (g[t].n && !(g[t].values = arenaAlloc(graph->arena, g[t].n * signalSize(t)))) return NULL;
+            }
+        }
+    }
+    copy->signals = signalBufferNew(graph);
+    return copy->signals ? copy : NULL;
+}
+
+void exchangePlanFree(ExchangePlan* plan) {
+    if (plan) signalBufferFree(plan->signals);
+}
+
+// copy the values of the group to the signals of its connections
+static void scatter(PortGroup* g, int t, void* signals) {
+    const int* s = g->signals;
+    int k;
+    switch (t) {
+        case portReal:
+            for (k=0; k<g->n; k++) ((fmiReal*)signals)[s[k]] = ((fmiReal*)g->values)[k];
+            break;
+        case portInteger:
+            for (k=0; k<g->n; k++) ((fmiInteger*)signals)[s[k]] = ((fmiInteger*)g->values)[k];
+            break;
+        case portBoolean:
+            for (k=0; k<g->n; k++) ((fmiBoolean*)signals)[s[k]] = ((fmiBoolean*)g->values)[k];
+            break;
+        case portString:
+            for (k=0; k<g->n; k++) ((fmiString*)signals)[s[k]] = ((fmiString*)g->values)[k];
+            break;
+    }
+}
+
+// copy the signals of the connections of the group to its values
+static void gather(PortGroup* g, int t, const void* signals) {
+    const int* s = g->signals;
+    int k;
+    switch (t) {
+        case portReal:
+            for (k=0; k<g->n; k++) ((fmiReal*)g->values)[k] = ((const fmiReal*)signals)[s[k]];
+            break;
+        case portInteger:
+            for (k=0; k<g->n; k++) ((fmiInteger*)g->values)[k] = ((const fmiInteger*)signals)[s[k]];
+            break;
+        case portBoolean:
+            for (k=0; k<g->n; k++) ((fmiBoolean*)g->values)[k] = ((const fmiBoolean*)signals)[s[k]];
+            break;
+        case portString:
+            for (k=0; k<g->n; k++) ((fmiString*)g->values)[k] = ((const fmiString*)signals)[s[k]];
+            break;
+    }
+}
+
+// Read the outputs of component i and write them to the given signal
+// arrays, the current or the next ones of the signal buffer of the plan.
+// Returns the worst status of the get calls.
+fmiStatus exchangeGetOutputs(ExchangePlan* plan, int i, void** signals) {
+    ComponentPlan* p = &plan->components[i];
+    FMU* fmu = (FMU*)p->component->fmu;
+    fmiComponent c = p->component->instance;
+    fmiStatus status = fmiOK, s = fmiOK;
+    int t;
+    for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+        PortGroup* g = &p->outputs[t];
+        if (!g->n) continue;
+        switch (t) {
+            case portReal:    s = fmu->getReal(c, g->vrs, g->n, (fmiReal*)g->values); break;
+            case portInteger: s = fmu->getInteger(c, g->vrs, g->n, (fmiInteger*)g->values); break;
+            case portBoolean: s = fmu->getBoolean(c, g->vrs, g->n, (fmiBoolean*)g->values); break;
+            case portString:  s = fmu->getString(c, g->vrs, g->n, (fmiString*)g->values); break;
+        }
+        scatter(g, t, signals[t]);
+        if (s > status) status = s;
+    }
+    return status;
+}
+
+// Read the inputs of component i from the given signal arrays and set them.
+// Returns the worst status of the set calls.
+fmiStatus exchangeSetInputs(ExchangePlan* plan, int i, void** signals) {
+    ComponentPlan* p = &plan->components[i];
+    FMU* fmu = (FMU*)p->component->fmu;
+    fmiComponent c = p->component->instance;
+    fmiStatus status = fmiOK, s = fmiOK;
+    int t;
+    for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+        PortGroup* g = &p->inputs[t];
+        if (!g->n) continue;
+        gather(g, t, signals[t]);
+        switch (t) {
+            case portReal:    s = fmu->setReal(c, g->vrs, g->n, (fmiReal*)g->values); break;
+            case portInteger: s = fmu->setInteger(c, g->vrs, g->n, (fmiInteger*)g->values); break;
+            case portBoolean: s = fmu->setBoolean(c, g->vrs, g->n, (fmiBoolean*)g->values); break;
+            case portString:  s = fmu->setString(c, g->vrs, g->n, (fmiString*)g->values); break;
+        }
+        if (s > status) status = s;
+    }
+    return status;
+}
+
+// Copy the current values of the outputs of component i to the next
+// values, for a component that does not read its outputs in this step.
+void exchangeHoldOutputs(ExchangePlan* plan, int i) {
+    ComponentPlan* p = &plan->components[i];
+    void** current = signalsCurrent(plan->signals);
+    void** next = signalsNext(plan->signals);
+    int t, k;
+    for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+        PortGroup* g = &p->outputs[t];
+        size_t size = signalSize(t);
+        for (k=0; k<g->n; k++) {
+            memcpy((char*)next[t] + g->signals[k] * size, (char*)current[t] + g->signals[k] * size, size);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+/* -------------------------------------------------------------------------
+ * exchange.h
+ * The exchange plan of the co-simulation master: the ports of each
+ * component grouped by base type, compiled once after loading the graph.
+ * Per communication step, the master reads the outputs of a component
+ * with one get call per base type and sets its inputs with one set call
+ * per base type, without looking at the AST. The values are exchanged
+ * through the arrays of a signal buffer, see signals.h.
+ * -------------------------------------------------------------------------*/
+
+#ifndef EXCHANGE_H
+#define EXCHANGE_H
+
+#include "fmi_cs.h"
+#include "signals.h"
+
+// The connected ports of one component of one base type
+typedef struct {
+    int n;                      // number of ports
+    fmiValueReference* vrs;     // value reference of the variable of each port
+    void* values;               // n values of the base type, the argument of get/set
+    int* signals;               // the signal of the connection of each port
+} PortGroup;
+
+typedef struct {
+    Component* component;       // its fmu and instance are used for the calls
+    PortGroup outputs[SIZEOF_PORT_TYPE];
+    PortGroup inputs[SIZEOF_PORT_TYPE];
+} ComponentPlan;
+
+typedef struct {
+    int n;                      // number of components
+    ComponentPlan* components;  // in the order of graph->components
+    SignalBuffer* signals;      // the values of all connections
+} ExchangePlan;
+
+ExchangePlan* exchangePlanNew(Graph* graph);
+ExchangePlan* exchangePlanClone(ExchangePlan* plan, Graph* graph, Component** components);
+void exchangePlanFree(ExchangePlan* plan);
+fmiStatus exchangeGetOutputs(ExchangePlan* plan, int i, void** signals);
+fmiStatus exchangeSetInputs(ExchangePlan* plan, int i, void** signals);
+void exchangeHoldOutputs(ExchangePlan* plan, int i);
+
+#endif // EXCHANGE_H
@@ -60,6 +60,9 @@ typedef fmiStatus (*fGetStringStatus) (fmiComponent c, const fmiStatusKind s, fm
 typedef struct {
     ModelDescription* modelDescription;
     HANDLE dllHandle;
+    char* dllPath;       // path of the loaded dll, used to load further instances
+    char* tmpPath;       // private directory to be removed by unloadFMU, or NULL
+    int dllFd;           // in-memory file holding the dll, closed by unloadFMU, -1 if none
     fGetTypesPlatform getTypesPlatform;
     fGetVersion getVersion;
     fSetDebugLogging setDebugLogging;
@@ -30,26 +30,291 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include "fmi_cs.h"
+#include "exchange.h"
+#include "schedule.h"
+#include "async_steps.h"
+#include "events.h"
+#include "ensemble.h"
 #include "sim_support.h"
+#include "log_buffer.h"
+#include "thread_pool.h"
+#include "timings.h"
+
+// The distinct FMUs of the graph. Each FMU is loaded only once and then
+// shared by all components with the same fmuPath.
+typedef struct {
+    const char** fmuPaths;  // fmuPath of each FMU
+    FMU** fmus;             // the loaded FMUs
+    int* nInstances;        // number of components using each FMU
+    int* firstComponent;    // index of the first component using each FMU
+    LogBuffer* logs;        // messages printed while loading each FMU
+    int* loaded;            // 1 if loading succeeded, 0 otherwise
+    const char*** names;    // per FMU: NULL, or the variables to parse with --selective
+    int n;                  // number of distinct FMUs
+    int* fmuIndex;          // per component: index of its FMU
+    FMU** isolated;         // per component: isolated instance of its FMU, or NULL
+    LogBuffer* isolatedLogs; // per component: messages printed while loading its isolated instance
+    int* isolatedLoaded;    // per component: 1 if loading its isolated instance succeeded
+    int* slots;             // hash index of fmuPaths: index + 1 of an FMU, 0 if empty
+    unsigned int mask;      // number of slots - 1
+} FmuRegistry;
+
+static FmuRegistry registry;
+
+static Timings* timings = NULL; // startup timings per component, NULL unless --timings
+static double startTime;        // start of loadGraph, see monotonicTime
+
+// Returns the index of the FMU with the given path, add it on first use
+static int registerFMU(const char* fmuPath, int component) {
+    unsigned int h;
+    for (h = hashName(fmuPath, 0) & registry.mask; registry.slots[h]; h = (h + 1) & registry.mask) {
+        int i = registry.slots[h] - 1;
+        if (!strcmp(registry.fmuPaths[i], fmuPath)) {
+            registry.nInstances[i]++;
+            return i;
+        }
+    }
+    registry.slots[h] = registry.n + 1;
+    registry.fmuPaths[registry.n] = fmuPath;
+    registry.nInstances[registry.n] = 1;
+    registry.firstComponent[registry.n] = component;
+    return registry.n++;
+}
+
+// Task of the thread pool: load FMU i of the registry.
+// Messages are captured and printed after all FMUs are loaded.
+// Timings are recorded for the first component using the FMU.
+static void loadTask(void* data, int i) {
+    logCapture(&registry.logs[i]);
+    if (timings) timingsCapture(&timings[registry.firstComponent[i]]);
+    registry.fmus[i] = (FMU*)calloc(1, sizeof(FMU));
+    if (registry.fmus[i]) {
+        registry.loaded[i] = tryLoadFMU(registry.fmus[i], registry.fmuPaths[i], registry.names[i]);
+    }
+    else logPrintf("error: Out of memory\n");
+    timingsCapture(NULL);
+    logCapture(NULL);
+}
+
+// Task of the thread pool: load an isolated instance for component i.
+// Several components may share the FMU, so the task writes only to the
+// entries of component i, which loadGraph merges into those of the FMU.
+static void loadIsolatedTask(void* data, int i) {
+    int* fmuIndex = (int*)data;
+    if (!registry.isolated[i]) return;
+    logCapture(&registry.isolatedLogs[i]);
+    if (timings) timingsCapture(&timings[i]);
+    registry.isolatedLoaded[i] = loadIsolatedFMU(registry.isolated[i], registry.fmus[fmuIndex[i]]);
+    timingsCapture(NULL);
+    logCapture(NULL);
+}
+
+// true if nConcurrent instances of FMU i need their own copy of its dll.
+// FMUs that keep global state cannot be shared by several components.
+static int needsIsolation(int i, int nConcurrent) {
+    ValueStatus vs;
+    CoSimulation* cs = registry.fmus[i]->modelDescription->cosimulation;
+    if (nConcurrent < 2) return 0;
+    return simOptions.isolate || (cs
+            && getBoolean(cs->capabilities, att_canBeInstantiatedOnlyOncePerProcess, &vs));
+}
+
+// true if all components can step with a variable communication step size.
+// Prints a warning for the first component that cannot, ignoring option.
+static int variableStepSize(Graph* graph, const char* option) {
+    ValueStatus vs;
+    int i;
+    for (i=0; graph->components[i]; i++) {
+        CoSimulation* cs = ((FMU*)graph->components[i]->fmu)->modelDescription->cosimulation;
+        if (!cs || !getBoolean(cs->capabilities, att_canHandleVariableCommunicationStepSize, &vs)) {
+            printf("warning: %s cannot handle a variable communication step size, ignoring %s\n",
+                    getString(graph->components[i], att_modelName), option);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Returns NULL to indicate failure
+// Returns per component the number of communication steps per step of
+// the component, given by its optional stepRatio attribute, allocated in
+// the arena of the graph. With the given option, e.g. --events, all
+// components step together, NULL to use the ratios.
+static int* stepRatios(Graph* graph, const char* option) {
+    ValueStatus vs;
+    int i, n, nRatios = 0;
+    int* ratio;
+    for (n=0; graph->components[n]; n++);
+    ratio = (int*)arenaAlloc(graph->arena, (n + 1) * sizeof(int));
+    if (!ratio) {
+        printf("error: Out of memory\n");
+        return NULL;
+    }
+    for (i=0; i<n; i++) {
+        ratio[i] = getInt(graph->components[i], att_stepRatio, &vs);
+        if (vs != valueDefined) ratio[i] = 1;
+        if (ratio[i] > 1) nRatios++;
+    }
+    if (nRatios && option) {
+        printf("warning: Ignoring the stepRatio of %d component(s) with %s\n", nRatios, option);
+        for (i=0; i<n; i++) ratio[i] = 1;
+    }
+    return ratio;
+}
+
+// number of elements of a null-terminated list, 0 for NULL
+static int listSize(void** list) {
+    int n = 0;
+    if (list) while (list[n]) n++;
+    return n;
+}
+
+// Returns 0 to indicate failure
+// Sets the variables to parse for each FMU k with --selective: the ports
+// of all its components and the variables given by --record. Allocated
+// in the arena of the graph, in one pass over the components.
+static int selectNames(Graph* graph, const int* fmuIndex) {
+    Component** comps = graph->components;
+    int* n = (int*)calloc(registry.n, sizeof(int));
+    int i, j, k, nRecord = listSize((void**)simOptions.record);
+    if (!n && registry.n) return 0;
+    for (i=0; comps[i]; i++) {
+        n[fmuIndex[i]] += listSize((void**)comps[i]->inputs) + listSize((void**)comps[i]->outputs);
+    }
+    for (k=0; k<registry.n; k++) {
+        registry.names[k] = (const char**)arenaAlloc(graph->arena, (n[k] + nRecord + 1) * sizeof(const char*));
+        if (!registry.names[k]) {
+            free(n);
+            return 0;
+        }
+        n[k] = 0;
+    }
+    for (i=0; comps[i]; i++) {
+        const char** names = registry.names[fmuIndex[i]];
+        int* m = &n[fmuIndex[i]];
+        for (j=0; comps[i]->inputs && comps[i]->inputs[j]; j++) names[(*m)++] = getName(comps[i]->inputs[j]);
+        for (j=0; comps[i]->outputs && comps[i]->outputs[j]; j++) names[(*m)++] = getName(comps[i]->outputs[j]);
+    }
+    for (k=0; k<registry.n; k++) {
+        for (j=0; j<nRecord; j++) registry.names[k][n[k]++] = simOptions.record[j];
+    }
+    free(n);
+    return 1;
+}
+
+// Adds sv to the null-terminated list vars unless it is NULL or listed already
+static void addVariable(ScalarVariable** vars, ScalarVariable* sv) {
+    int n;
+    if (!sv) return;
+    for (n=0; vars[n]; n++) {
+        if (vars[n] == sv) return;
+    }
+    vars[n] = sv;
+}
+
+// Returns NULL to indicate failure
+// The variables of component c to write to the result file, see outputRow:
+// the variables given by --record, otherwise the variables of its ports.
+// Allocated in the arena of the graph.
+static ScalarVariable** recordedVariables(Graph* graph, Component* c, ModelDescription* md) {
+    int j, n = simOptions.record ? listSize((void**)simOptions.record)
+            : listSize((void**)c->inputs) + listSize((void**)c->outputs);
+    ScalarVariable** vars = (ScalarVariable**)arenaAlloc(graph->arena, (n + 1) * sizeof(ScalarVariable*));
+    if (!vars) return NULL;
+    if (simOptions.record) {
+        for (j=0; simOptions.record[j]; j++) addVariable(vars, getVariableByName(md, simOptions.record[j]));
+        return vars;
+    }
+    for (j=0; c->inputs && c->inputs[j]; j++) addVariable(vars, c->inputs[j]->variable);
+    for (j=0; c->outputs && c->outputs[j]; j++) addVariable(vars, c->outputs[j]->variable);
+    return vars;
+}
 
 static Graph* loadGraph(const char* graphFileName) {
     Graph* graph;           // component graph
     Component** comps;      // list of components
     Port** ports;           // list of ports (input/output)
+    int* fmuIndex;          // registry index of the FMU of each component, kept in the registry
+    int nComps;             // number of components
+    int nFailed = 0;        // number of FMUs that could not be loaded
+    int nIsolated = 0;      // number of isolated instances
     int i,n;                // helpers
+    unsigned int size;      // number of slots of the registry index
+    ThreadPool* pool;
 
     // parse component graph xml
+    startTime = monotonicTime();
     graph = parseGraph(graphFileName);
     if (!graph) exit(EXIT_FAILURE);
 
-    // load fmu and set ports
+    // allocate the registry for the worst case of one FMU per component
     comps = graph->components;
+    for (nComps=0; comps[nComps]; nComps++);
+    registry.fmuPaths = (const char**)calloc(nComps, sizeof(const char*));
+    registry.fmus = (FMU**)calloc(nComps, sizeof(FMU*));
+    registry.nInstances = (int*)calloc(nComps, sizeof(int));
+    registry.firstComponent = (int*)calloc(nComps, sizeof(int));
+    registry.logs = (LogBuffer*)calloc(nComps, sizeof(LogBuffer));
+    registry.loaded = (int*)calloc(nComps, sizeof(int));
+    registry.isolated = (FMU**)calloc(nComps, sizeof(FMU*));
+    registry.isolatedLogs = (LogBuffer*)calloc(nComps, sizeof(LogBuffer));
+    registry.isolatedLoaded = (int*)calloc(nComps, sizeof(int));
+    registry.names = (const char***)calloc(nComps, sizeof(const char**));
+    fmuIndex = registry.fmuIndex = (int*)calloc(nComps, sizeof(int));
+    for (size = 16; size < 2 * (unsigned int)nComps; size *= 2);
+    registry.slots = (int*)calloc(size, sizeof(int));
+    registry.mask = size - 1;
+    if (!registry.slots || (nComps && (!registry.fmuPaths || !registry.fmus || !registry.nInstances || !registry.firstComponent
+            || !registry.logs || !registry.loaded || !registry.isolated || !registry.isolatedLogs || !registry.isolatedLoaded
+            || !registry.names || !fmuIndex))) return NULL;
+    registry.n = 0;
+    if (simOptions.timingsFile) {
+        timings = (Timings*)calloc(nComps, sizeof(Timings));
+        if (nComps && !timings) return NULL;
+    }
+
+    // group components by FMU
+    for (i=0; comps[i]; i++) {
+        fmuIndex[i] = registerFMU(getString(comps[i], att_fmuPath), i);
+    }
+    if (simOptions.selective && !selectNames(graph, fmuIndex)) return NULL;
+
+    // unzip, parse and dlopen all distinct FMUs in parallel
+    pool = threadPoolNew(simOptions.nThreads);
+    if (!pool) return NULL;
+    threadPoolRun(pool, loadTask, NULL, registry.n);
+
+    // load the dll once more for each further component of an FMU that needs isolation
     for (i=0; comps[i]; i++) {
-        FMU* fmu = (FMU*)calloc(1, sizeof(FMU));
-        if (!fmu) return NULL; //TODO add proper error handling
-        char* fmuFileName = getString(comps[i], att_fmuPath);
-        loadFMU(fmu, fmuFileName);
+        int k = fmuIndex[i];
+        if (registry.firstComponent[k] == i) continue; // uses the FMU itself
+        if (!registry.loaded[k] || !needsIsolation(k, registry.nInstances[k])) continue;
+        registry.isolated[i] = (FMU*)calloc(1, sizeof(FMU));
+        if (!registry.isolated[i]) return NULL;
+        nIsolated++;
+    }
+    if (nIsolated) threadPoolRun(pool, loadIsolatedTask, fmuIndex, nComps);
+    threadPoolFree(pool);
+
+    // report in registry order, then in component order, independent of the order of completion
+    for (i=0; i<registry.n; i++) logFlush(&registry.logs[i]);
+    for (i=0; i<nComps; i++) {
+        logFlush(&registry.isolatedLogs[i]);
+        if (registry.isolated[i] && !registry.isolatedLoaded[i]) registry.loaded[fmuIndex[i]] = 0;
+    }
+    for (i=0; i<registry.n; i++) {
+        if (!registry.loaded[i]) {
+            printf("error: Could not load %s\n", registry.fmuPaths[i]);
+            nFailed++;
+        }
+    }
+    if (nFailed) exit(EXIT_FAILURE);
+
+    // set ports
+    for (i=0; comps[i]; i++) {
+        FMU* fmu = registry.isolated[i] ? registry.isolated[i] : registry.fmus[fmuIndex[i]];
 
         // input ports
         if (comps[i]->inputs) {
@@ -69,18 +334,357 @@ static Graph* loadGraph(const char* graphFileName) {
         }
 
         comps[i]->fmu = (void*)fmu;
+        if (simOptions.record || simOptions.selective) {
+            comps[i]->recorded = recordedVariables(graph, comps[i], fmu->modelDescription);
+            if (!comps[i]->recorded) return NULL;
+        }
+        if (timings) {
+            timings[i].name = getString(comps[i], att_modelName);
+            timings[i].fmuPath = registry.fmuPaths[fmuIndex[i]];
+            timings[i].loadedBy = registry.isolated[i] ? "isolated"
+                    : registry.firstComponent[fmuIndex[i]] == i ? "self" : "shared";
+        }
+    }
+    for (n=0; simOptions.record && simOptions.record[n]; n++) {
+        for (i=0; comps[i]; i++) {
+            if (getVariableByName(((FMU*)comps[i]->fmu)->modelDescription, simOptions.record[n])) break;
+        }
+        if (!comps[i]) printf("warning: No component has a variable %s to record\n", simOptions.record[n]);
     }
 
+    printf("Loaded %d distinct FMUs for %d components\n", registry.n, nComps);
+    if (nIsolated) printf("Loaded %d isolated instances\n", nIsolated);
+
     return graph;
 }
 
+// Print the startup timings and write them to the timings file
+static void reportTimings(Graph* graph) {
+    int n;
+    double wallTime = monotonicTime() - startTime;
+    for (n=0; graph->components[n]; n++);
+    timingsPrint(timings, n, wallTime);
+    if (timingsWriteJson(simOptions.timingsFile, timings, n, wallTime))
+        printf("Timings written to %s\n", simOptions.timingsFile);
+    else printf("warning: Could not write %s\n", simOptions.timingsFile);
+}
+
+// The state of one communication step of the master, shared by the tasks
+// of the step pool. In one batch, each component sets its inputs from the
+// current signals, steps and writes its outputs to the next signals, see
+// signals.h. No component writes a signal another one reads in the same
+// batch, so the components are independent and the results do not depend
+// on the number of threads. Components that share the dll of an FMU are
+// stepped by the same task, see stepTasks.
+typedef struct {
+    ExchangePlan* plan;
+    int* tasks;              // the components in the order of the tasks, see stepTasks
+    int* taskStart;          // per task: its first entry in tasks, followed by the end of the last task
+    double time;             // the current communication point
+    double h;                // the communication step size
+    long tick;               // index of the current communication point with a fixed h
+    long nTicks;             // number of communication steps to tEnd with a fixed h
+    const int* ratio;        // per component: number of communication steps per step of the component
+    double tEnd;             // the end of the simulation
+    EventControl* events;    // cuts steps at events with --events, else NULL
+    double target;           // with --events: the end of the current step
+    int phase;               // with --events: the components of the current batch, see eventBatch
+    long nDoSteps;           // number of doStep calls with a step size > 0
+    AsyncSteps* async;       // the components whose doStep returned fmiPending
+    fmiStatus* getStatus;    // per component, status of reading its outputs
+    fmiStatus* setStatus;    // per component, status of setting its inputs
+    fmiStatus* stepStatus;   // per component, status of doStep
+} StepData;
+
+#define TASKS_PER_THREAD 4   // more tasks than threads balance uneven components
+
+// true if component i starts a step at the current communication point.
+// Between its steps, its outputs hold the values of the end of its last step.
+#define due(d, i) ((d)->tick % (d)->ratio[i] == 0)
+
+// the size of the step of component i from the current communication point,
+// the last step ends at tEnd
+static double stepSize(StepData* d, int i) {
+    long n = d->nTicks - d->tick;
+    if (d->ratio[i] == 1) return d->h;
+    return (d->ratio[i] < n ? d->ratio[i] : n) * d->h;
+}
+
+// Write the outputs of component i after its step to the next signals:
+// read them if its step ends at the next communication point, else hold them
+static fmiStatus publishOutputs(StepData* d, int i) {
+    if ((d->tick + 1) % d->ratio[i] == 0 || d->tick + 1 == d->nTicks) {
+        return exchangeGetOutputs(d->plan, i, signalsNext(d->plan->signals));
+    }
+    exchangeHoldOutputs(d->plan, i);
+    return fmiOK;
+}
+
+// A component and the address of its FMU, see stepTasks
+typedef struct {
+    size_t fmu;
+    int component;
+} FmuUse;
+
+static int compareFmuUse(const void* a, const void* b) {
+    const FmuUse* x = (const FmuUse*)a;
+    const FmuUse* y = (const FmuUse*)b;
+    if (x->fmu != y->fmu) return x->fmu < y->fmu ? -1 : 1;
+    return x->component - y->component;
+}
+
+// Returns 0 to indicate failure
+// Distributes the components to nTasks tasks of about the same size. All
+// components that share a loaded FMU go to the same task, in the order of
+// the graph, since its dll may keep global state that doStep changes, as
+// waterTankEnv does. Components of isolated instances are independent.
+static int stepTasks(StepData* d, int nTasks) {
+    int n = d->plan->n;
+    int size = nTasks ? (n + nTasks - 1) / nTasks : 0;
+    int i, k, m = 0, j = 0;
+    FmuUse* uses = (FmuUse*)malloc((n + 1) * sizeof(FmuUse));
+    int* next = (int*)malloc(2 * (n + 1) * sizeof(int)); // next component with the same FMU, -1 after the last
+    int* first = next + n + 1;                              // 1 for the first component of each FMU
+    d->tasks = (int*)malloc((n + nTasks + 2) * sizeof(int));
+    d->taskStart = d->tasks + n + 1;
+    if (!uses || !next || !d->tasks) {
+        free(uses);
+        free(next);
+        return 0; // failure
+    }
+    for (i=0; i<n; i++) {
+        uses[i].fmu = (size_t)d->plan->components[i].component->fmu;
+        uses[i].component = i;
+    }
+    qsort(uses, n, sizeof(FmuUse), compareFmuUse);
+    for (k=0; k<n; k++) {
+        i = uses[k].component;
+        next[i] = k + 1 < n && uses[k + 1].fmu == uses[k].fmu ? uses[k + 1].component : -1;
+        first[i] = k == 0 || uses[k - 1].fmu != uses[k].fmu;
+    }
+    d->taskStart[0] = 0;
+    for (i=0; i<n; i++) {
+        if (!first[i]) continue;
+        for (k=i; k>=0; k=next[k]) d->tasks[m++] = k;
+        if (m >= (j + 1) * size && j + 1 < nTasks) d->taskStart[++j] = m;
+    }
+    while (j < nTasks) d->taskStart[++j] = m;
+    free(uses);
+    free(next);
+    return 1; // success
+}
+
+// Task of the step pool: step the components of task j and publish their outputs
+static void doStepTask(void* data, int j) {
+    StepData* d = (StepData*)data;
+    int k;
+    for (k = d->taskStart[j]; k < d->taskStart[j + 1]; k++) {
+        int i = d->tasks[k];
+        Component* c = d->plan->components[i].component;
+        d->setStatus[i] = d->stepStatus[i] = d->getStatus[i] = fmiOK;
+        if (due(d, i)) {
+            d->setStatus[i] = exchangeSetInputs(d->plan, i, signalsCurrent(d->plan->signals));
+            d->stepStatus[i] = d->setStatus[i] > fmiWarning ? fmiError
+                    : ((FMU*)c->fmu)->doStep(c->instance, d->time, stepSize(d, i), fmiTrue);
+            if (d->stepStatus[i] == fmiPending && asyncStepsAllowed(d->async, i)) {
+                asyncStepPending(d->async, i);
+                d->getStatus[i] = fmiPending; // its outputs are published after asyncStepsWait
+                continue;
+            }
+        }
+        if (d->stepStatus[i] == fmiOK) d->getStatus[i] = publishOutputs(d, i);
+    }
+}
+
+// Returns 0 to indicate failure
+// One communication step of all components on the given pool
+static int doCommunicationStep(ThreadPool* pool, StepData* d, int nTasks) {
+    int i;
+    threadPoolRun(pool, doStepTask, d, nTasks);
+    asyncStepsWait(d->async, d->stepStatus);
+    for (i=0; i<d->plan->n; i++) {
+        if (d->getStatus[i] == fmiPending)
+            d->getStatus[i] = d->stepStatus[i] == fmiOK ? publishOutputs(d, i) : fmiOK;
+        if (d->setStatus[i] > fmiWarning) return error("could not set inputs of the model");
+        if (d->stepStatus[i] != fmiOK) return error("could not complete simulation of the model");
+        if (d->getStatus[i] > fmiWarning) return error("could not get outputs of the model");
+    }
+    signalBufferSwap(d->plan->signals);
+    return 1; // success
+}
+
+// Returns 0 to indicate failure
+// One communication step of the Gauss-Seidel master: in the given order,
+// each component sets its inputs, steps and then provides its outputs to
+// the components after it. The components before it provide the outputs
+// of the last step, see schedule.h. All use the current signals.
+static int gaussSeidelStep(StepData* d, const int* order) {
+    int k;
+    for (k=0; k<d->plan->n; k++) {
+        int i = order[k];
+        Component* c = d->plan->components[i].component;
+        if (!due(d, i)) continue;
+        if (exchangeSetInputs(d->plan, i, signalsCurrent(d->plan->signals)) > fmiWarning)
+            return error("could not set inputs of the model");
+        d->stepStatus[i] = ((FMU*)c->fmu)->doStep(c->instance, d->time, stepSize(d, i), fmiTrue);
+        if (d->stepStatus[i] == fmiPending && asyncStepsAllowed(d->async, i)) {
+            // the components after it may read its outputs
+            asyncStepPending(d->async, i);
+            asyncStepsWait(d->async, d->stepStatus);
+        }
+        if (d->stepStatus[i] != fmiOK) return error("could not complete simulation of the model");
+        if (exchangeGetOutputs(d->plan, i, signalsCurrent(d->plan->signals)) > fmiWarning)
+            return error("could not get outputs of the model");
+    }
+    return 1; // success
+}
+
+// the batches of a step of the event-aware master, see eventStep
+enum { stepSources, stepOthers, stepZero };
+
+// true if component i steps in the current batch of the event-aware master
+static int eventStepping(StepData* d, int i) {
+    EventControl* e = d->events;
+    if (d->phase == stepZero) return e->zeroSteps[i] && e->times[i] == d->target;
+    return e->sources[i] == (d->phase == stepSources) && e->times[i] < d->target;
+}
+
+// Write the outputs of component i to the next signals: read them if it
+// reached the end of the step, else hold them
+static fmiStatus publishEventOutputs(StepData* d, int i) {
+    if (d->events->times[i] == d->target) return exchangeGetOutputs(d->plan, i, signalsNext(d->plan->signals));
+    exchangeHoldOutputs(d->plan, i);
+    return fmiOK;
+}
+
+// Task of the step pool: step the components of task j in the current
+// batch of the event-aware master to the end of the step. After the first
+// batch, all components publish their outputs.
+static void eventTask(void* data, int j) {
+    StepData* d = (StepData*)data;
+    int k;
+    for (k = d->taskStart[j]; k < d->taskStart[j + 1]; k++) {
+        int i = d->tasks[k];
+        Component* c = d->plan->components[i].component;
+        double from = d->events->times[i];
+        d->setStatus[i] = d->stepStatus[i] = d->getStatus[i] = fmiOK;
+        if (eventStepping(d, i)) {
+            d->setStatus[i] = exchangeSetInputs(d->plan, i, signalsCurrent(d->plan->signals));
+            d->stepStatus[i] = d->setStatus[i] > fmiWarning ? fmiError
+                    : ((FMU*)c->fmu)->doStep(c->instance, from, d->target - from, fmiTrue);
+            if (d->stepStatus[i] == fmiPending && asyncStepsAllowed(d->async, i)) {
+                asyncStepPending(d->async, i);
+                d->getStatus[i] = fmiPending; // its outputs are published after asyncStepsWait
+                continue;
+            }
+            if (d->stepStatus[i] == fmiOK) d->events->times[i] = d->target;
+        }
+        if (d->phase != stepSources && d->stepStatus[i] == fmiOK) d->getStatus[i] = publishEventOutputs(d, i);
+    }
+}
+
+// Returns 0 to indicate failure
+// One batch of the event-aware master on the given pool. In the first
+// batch, a component may stop at an event, the step then ends there.
+static int eventBatch(ThreadPool* pool, StepData* d, int nTasks, int phase) {
+    double target = d->target;
+    int i;
+    d->phase = phase;
+    threadPoolRun(pool, eventTask, d, nTasks);
+    asyncStepsWait(d->async, d->stepStatus);
+    for (i=0; i<d->plan->n; i++) {
+        if (d->stepStatus[i] == fmiDiscard && phase == stepSources) {
+            if (!eventStopped(d->events, i, d->target)) return 0;
+            if (d->events->times[i] < target) target = d->events->times[i];
+            d->stepStatus[i] = fmiOK;
+        }
+        else if (d->getStatus[i] == fmiPending && d->stepStatus[i] == fmiOK) d->events->times[i] = d->target;
+        if (d->getStatus[i] == fmiPending)
+            d->getStatus[i] = phase != stepSources && d->stepStatus[i] == fmiOK ? publishEventOutputs(d, i) : fmiOK;
+        if (d->setStatus[i] > fmiWarning) return error("could not set inputs of the model");
+        if (d->stepStatus[i] != fmiOK) return error("could not complete simulation of the model");
+        if (d->getStatus[i] > fmiWarning) return error("could not get outputs of the model");
+    }
+    d->target = target;
+    return 1; // success
+}
+
+// true if an integer or a boolean signal changed in the last batch
+#define discreteChanged(d) (signalBufferChanged((d)->plan->signals, portInteger) \
+        || signalBufferChanged((d)->plan->signals, portBoolean))
+
+// Returns 0 to indicate failure
+// One communication step of the event-aware master, see events.h. Sets
+// d->target to the communication point it ends at.
+static int eventStep(ThreadPool* pool, StepData* d, int nTasks) {
+    EventControl* e = d->events;
+    int i, k, nCut = e->nCut, changed;
+    d->target = d->time + d->h;
+    if (d->tEnd - d->target < 1e-9 * d->h) d->target = d->tEnd; // the last step ends at tEnd
+    for (i=0; i<d->plan->n; i++) d->nDoSteps += e->times[i] < d->target;
+    if (e->nSources && !eventBatch(pool, d, nTasks, stepSources)) return 0;
+    if (!eventBatch(pool, d, nTasks, stepOthers)) return 0;
+    changed = e->nCut > nCut || discreteChanged(d);
+    signalBufferSwap(d->plan->signals);
+    e->nEvents += changed;
+
+    // event iteration: zero-length steps until no discrete signal changes
+    for (k=0; changed && k<MAX_EVENT_ITERATIONS; k++) {
+        if (!eventBatch(pool, d, nTasks, stepZero)) return 0;
+        for (i=0; i<d->plan->n; i++) e->nZeroSteps += eventStepping(d, i);
+        changed = discreteChanged(d);
+        signalBufferSwap(d->plan->signals);
+    }
+    if (changed) e->nUnconverged++;
+    return 1; // success
+}
+
+// The master algorithm and its settings, the same for all runs of an ensemble
+typedef struct {
+    const int* order;        // the order of the Gauss-Seidel master, NULL for Jacobi
+    int events;              // 1 to cut the steps at events, see events.h
+    const int* ratio;        // per component: its stepRatio, see stepRatios
+    double tEnd;
+    double h;
+    fmiBoolean loggingOn;
+    char separator;
+    int stepThreads;         // number of threads of the step pool, see --step-threads
+} Master;
+
+// Release the step pool and the state of the steps of simulate
+static void freeSteps(ThreadPool* pool, StepData* step) {
+    threadPoolFree(pool);
+    free(step->getStatus);
+    free(step->tasks);
+    asyncStepsFree(step->async);
+    eventControlFree(step->events);
+}
+
+// Release the instances of the components, terminate them first if the
+// simulation ended
+static void freeInstances(Graph* graph, int terminate) {
+    int i;
+    for (i=0; graph->components[i]; i++) {
+        FMU* fmu = (FMU*)graph->components[i]->fmu;
+        fmiComponent c = graph->components[i]->instance;
+        if (!c) continue;
+        if (terminate) fmu->terminateSlave(c);
+        fmu->freeSlaveInstance(c);
+        graph->components[i]->instance = NULL;
+    }
+}
+
 // simulate the given FMU using the forward euler method.
 // time events are processed by reducing step size to exactly hit tNext.
 // state events are checked and fired only at the end of an Euler step. 
 // the simulator may therefore miss state events and fires state events typically too late.
-static int simulate(Graph* graph, double tEnd, double h, fmiBoolean loggingOn, char separator) {
+// Writes the results to file. With an ensemble, sets the variables of the
+// given run before the components are initialized and prints no summary.
+static int simulate(Graph* graph, ExchangePlan* plan, const Master* m, FILE* file, Ensemble* ensemble, int run) {
     double time;
     double tStart = 0;               // start time
+    double tEnd = m->tEnd;
+    double h = m->h;
     const char* guid;                // global unique id of the fmu
     fmiComponent c;                  // instance of the fmu
     fmiStatus fmiFlag;               // return code of the fmu functions
@@ -93,140 +697,317 @@ static int simulate(Graph* graph, double tEnd, double h, fmiBoolean loggingOn, c
     ModelDescription* md;            // handle to the parsed XML file   
     FMU* fmu;                        // handle to fmu
     int nSteps = 0;
-    FILE* file;
-    int i,n;
-    Port** ports;
+    double start;                    // start of a timed phase
+    int i;
+    ThreadPool* pool;                // steps the components, see doCommunicationStep
+    StepData step;                   // the state of the current step
+    int nTasks;                      // number of tasks per batch of the pool
+    int nThreads;                    // number of threads of the pool
+    double stepTime;                 // wall time of the simulation loop
 
     // set callback functions
     callbacks.logger = fmuLogger;
     callbacks.allocateMemory = calloc;
     callbacks.freeMemory = free;
-    callbacks.stepFinished = NULL; // fmiDoStep has to be carried out synchronously
+    callbacks.stepFinished = asyncStepFinished; // see async_steps.h
 
     // instantiate slaves
     for (i=0; graph->components[i]; i++) {
         fmu = (FMU*) graph->components[i]->fmu;
         md = fmu->modelDescription;
         guid = getString(md, att_guid);
+        start = monotonicTime();
         c = fmu->instantiateSlave(getModelIdentifier(md), guid, fmuLocation, mimeType, 
-                              timeout, visible, interactive, callbacks, loggingOn);
-        if (!c) return error("could not instantiate model");
+                              timeout, visible, interactive, callbacks, m->loggingOn);
+        if (timings) timings[i].seconds[phase_instantiate] = monotonicTime() - start;
+        if (!c) {
+            freeInstances(graph, 0);
+            return error("could not instantiate model");
+        }
         graph->components[i]->instance = c;
         c = NULL;
     }
-
-    // open result file
-    if (!(file=fopen(RESULT_FILE, "w"))) {
-        printf("could not write %s because:\n", RESULT_FILE);
-        printf("    %s\n", strerror(errno));
+    if (ensemble && !ensembleApply(ensemble, graph, run)) {
+        freeInstances(graph, 0);
         return 0; // failure
     }
-    
+
     // initialise slaves
     // StopTimeDefined=fmiFalse means: ignore value of tEnd
     for (i=0; graph->components[i]; i++) {
         fmu = (FMU*) graph->components[i]->fmu;
         c = graph->components[i]->instance;
+        start = monotonicTime();
         fmiFlag = fmu->initializeSlave(c, tStart, fmiTrue, tEnd);
-        if (fmiFlag > fmiWarning)  return error("could not initialize model");
+        if (timings) timings[i].seconds[phase_initialize] = monotonicTime() - start;
+        if (fmiFlag > fmiWarning) {
+            freeInstances(graph, 0);
+            return error("could not initialize model");
+        }
     }
+    if (timings) reportTimings(graph);
 
     // output solution for time t0
-    outputRow(graph, tStart, file, separator, TRUE);  // output column names
-    outputRow(graph, tStart, file, separator, FALSE); // output values
+    outputRow(graph, tStart, file, m->separator, TRUE);  // output column names
+    outputRow(graph, tStart, file, m->separator, FALSE); // output values
 
     // enter the simulation loop
-    time = tStart;
-    while (time < tEnd) {
-        // read outputs
-        for (i=0; graph->components[i]; i++) {
-            fmu = (FMU*) graph->components[i]->fmu;
-            c = graph->components[i]->instance;
-            ports = graph->components[i]->outputs;
-            if (!ports) continue;
-
-            for (n=0; ports[n]; n++) {
-                ScalarVariable* sv = ports[n]->variable;
-                fmiValueReference vr = getValueReference(sv);
-                void* value = ports[n]->connection->value;
-                switch (sv->typeSpec->type) {
-                    case elm_Real:
-                        fmu->getReal(c, &vr, 1, (fmiReal*) value);
-                        break;
-                    case elm_Integer:
-                        fmu->getInteger(c, &vr, 1, (fmiInteger*) value);
-                        break;
-                    case elm_Boolean:
-                        fmu->getBoolean(c, &vr, 1, (fmiBoolean*) value);
-                        break;
-                    case elm_String:
-                        fmu->getString(c, &vr, 1, (fmiString*) value);
-                        break;
-                }
-            }
+    pool = threadPoolNew(m->order ? 1 : m->stepThreads);
+    signalBufferReset(plan->signals);
+    step.plan = plan;
+    step.h = h;
+    step.tEnd = tEnd;
+    step.events = m->events ? eventControlNew(plan, tStart) : NULL;
+    step.nDoSteps = 0;
+    step.ratio = m->ratio;
+    step.tick = 0;
+    step.nTicks = (long)ceil((tEnd - tStart) / h - 1e-9);
+    step.async = asyncStepsNew(plan);
+    step.getStatus = (fmiStatus*)calloc(3 * (plan->n + 1), sizeof(fmiStatus));
+    step.setStatus = step.getStatus + plan->n + 1;
+    step.stepStatus = step.setStatus + plan->n + 1;
+    step.tasks = NULL;
+    if (!pool || !step.getStatus || !step.async || (m->events && !step.events)) {
+        freeSteps(pool, &step);
+        freeInstances(graph, 0);
+        return error("out of memory");
+    }
+    nThreads = threadPoolSize(pool);
+    nTasks = nThreads == 1 ? 1 : nThreads * TASKS_PER_THREAD;
+    if (nTasks > plan->n) nTasks = plan->n;
+    if (!stepTasks(&step, nTasks)) {
+        freeSteps(pool, &step);
+        freeInstances(graph, 0);
+        return error("out of memory");
+    }
+    stepTime = monotonicTime();
+    // the outputs at tStart
+    for (i=0; i<plan->n; i++) {
+        if (exchangeGetOutputs(plan, i, signalsCurrent(plan->signals)) > fmiWarning) {
+            freeSteps(pool, &step);
+            freeInstances(graph, 0);
+            return error("could not get outputs of the model");
         }
-
-        // set inputs
-        for (i=0; graph->components[i]; i++) {
-            fmu = (FMU*) graph->components[i]->fmu;
-            c = graph->components[i]->instance;
-            ports = graph->components[i]->inputs;
-            if (!ports) continue;
-
-            for (n=0; ports[n]; n++) {
-                ScalarVariable* sv = ports[n]->variable;
-                fmiValueReference vr = getValueReference(sv);
-                void* value = ports[n]->connection->value;
-                switch (sv->typeSpec->type) {
-                    case elm_Real:
-                        fmu->setReal(c, &vr, 1, (fmiReal*) value);
-                        break;
-                    case elm_Integer:
-                        fmu->setInteger(c, &vr, 1, (fmiInteger*) value);
-                        break;
-                    case elm_Boolean:
-                        fmu->setBoolean(c, &vr, 1, (fmiBoolean*) value);
-                        break;
-                    case elm_String:
-                        fmu->setString(c, &vr, 1, (fmiString*) value);
-                        break;
-                }
-            }
+    }
+    time = tStart;
+    while (step.events ? time < tEnd : step.tick < step.nTicks) {
+        int ok;
+        step.time = time;
+        if (step.events) ok = eventStep(pool, &step, nTasks);
+        else {
+            for (i=0; i<plan->n; i++) step.nDoSteps += due(&step, i);
+            ok = m->order ? gaussSeidelStep(&step, m->order) : doCommunicationStep(pool, &step, nTasks);
         }
-    
-        for (i=0; graph->components[i]; i++) {
-            fmu = (FMU*) graph->components[i]->fmu;
-            c = graph->components[i]->instance;
-
-            // do simulation step
-            fmiFlag = fmu->doStep(c, time, h, fmiTrue);
-            if (fmiFlag != fmiOK)  return error("could not complete simulation of the model");
+        if (!ok) {
+            freeSteps(pool, &step);
+            freeInstances(graph, 0);
+            return 0; // failure
         }
 
-        // increment master time
-        time += h;
-        outputRow(graph, time, file, separator, FALSE); // output values for this step
+        // increment master time, with a fixed h by counting ticks so that rounding errors do not accumulate
+        step.tick++;
+        if (step.events) time = step.target;
+        else time = tStart + step.tick * h;
+        outputRow(graph, time, file, m->separator, FALSE); // output values for this step
         nSteps++;
     }
+    stepTime = monotonicTime() - stepTime;
     
     // end simulation
-    for (i=0; graph->components[i]; i++) {
-        fmu = (FMU*)graph->components[i]->fmu;
-        c = graph->components[i]->instance;
-        fmiFlag = fmu->terminateSlave(c);
-        fmu->freeSlaveInstance(c);
+    freeInstances(graph, 1);
+    if (ensemble) {
+        freeSteps(pool, &step);
+        return 1; // success
     }
   
     // print simulation summary 
     printf("Simulation from %g to %g terminated successful\n", tStart, tEnd);
     printf("  steps ............ %d\n", nSteps);
-    printf("  fixed step size .. %g\n", h);
+    printf("  doStep calls ..... %ld\n", step.nDoSteps);
+    if (step.events) {
+        printf("  step size ........ %g, %d step(s) cut at events\n", h, step.events->nCut);
+        printf("  events ........... %d, %ld zero-length steps\n", step.events->nEvents, step.events->nZeroSteps);
+        if (step.events->nUnconverged) printf("  warning: %d event iteration(s) did not converge in %d zero-length steps\n",
+                step.events->nUnconverged, MAX_EVENT_ITERATIONS);
+    }
+    else printf("  fixed step size .. %g\n", h);
+    printf("  step threads ..... %d, %.3f s\n", nThreads, stepTime);
+    freeSteps(pool, &step);
     return 1; // success
 }
 
+// The runs of an ensemble, shared by the tasks of the ensemble pool.
+// Worker j simulates runs j, j+nWorkers... one after the other, with its
+// own copies of the components and of the exchange plan, and writes their
+// rows to a temporary file of its own, see mergeRuns.
+typedef struct {
+    Graph* graph;
+    const Master* master;
+    Ensemble* ensemble;
+    int nWorkers;
+    int nComps;
+    Graph* graphs;           // per worker: the graph with its own components
+    ExchangePlan** plans;    // per worker: the exchange plan of its components
+    FMU** isolated;          // per worker and component: its own copy of the FMU, or NULL
+    FILE** files;            // per worker: the rows of its runs
+    long* start;             // per run: offset of its rows in the file of its worker
+    long* end;               // per run: end of its rows, -1 if it failed
+} EnsembleData;
+
+// Task of the ensemble pool: worker j loads its own copies of the FMUs,
+// then simulates its runs. Worker 0 uses the FMUs of the graph. The dlls
+// may keep global state, so the workers must not share them.
+static void ensembleTask(void* data, int j) {
+    EnsembleData* d = (EnsembleData*)data;
+    Graph* graph = &d->graphs[j];
+    int i, r, ok = 1;
+    for (i=0; j && i<d->nComps; i++) {
+        int k = registry.fmuIndex[i];
+        FMU* fmu = d->isolated[j * d->nComps + i] = (FMU*)calloc(1, sizeof(FMU));
+        if (!fmu || !loadIsolatedFMU(fmu, registry.fmus[k])) {
+            printf("error: Could not load a copy of %s\n", registry.fmuPaths[k]);
+            ok = 0;
+            break;
+        }
+        graph->components[i]->fmu = fmu;
+    }
+    for (r=j; r<d->ensemble->nRuns; r+=d->nWorkers) {
+        d->start[r] = ftell(d->files[j]);
+        if (ok && simulate(graph, d->plans[j], d->master, d->files[j], d->ensemble, r)) {
+            d->end[r] = ftell(d->files[j]);
+            continue;
+        }
+        printf("error: Run %d of the ensemble failed\n", r + 1);
+        fseek(d->files[j], d->start[r], SEEK_SET);
+        d->end[r] = -1;
+    }
+}
+
+#define MERGE_BUFFER 65536     // bytes read at once from the file of a worker
+
+// Returns the number of the runs written
+// Writes the rows of the runs to file in the order of the runs, each with
+// the number of its run, from 1, in a first column. The header is written once.
+static int mergeRuns(EnsembleData* d, FILE* file) {
+    char separator = d->master->separator;
+    char* buffer = (char*)malloc(MERGE_BUFFER);
+    int r, nWritten = 0;
+    if (!buffer) return 0;
+    for (r=0; r<d->ensemble->nRuns; r++) {
+        FILE* rows = d->files[r % d->nWorkers];
+        long left = d->end[r] - d->start[r];
+        int line = 0, lineStart = 1;
+        size_t n;
+        if (d->end[r] < 0) continue;
+        fseek(rows, d->start[r], SEEK_SET);
+        while (left > 0 && (n = fread(buffer, 1, left < MERGE_BUFFER ? left : MERGE_BUFFER, rows)) > 0) {
+            char* p;
+            char* next;
+            left -= (long)n;
+            for (p=buffer; p<buffer + n; p=next) {
+                char* newline = (char*)memchr(p, '\n', buffer + n - p);
+                next = newline ? newline + 1 : buffer + n;
+                if (lineStart && line > 0) fprintf(file, "%d%c", r + 1, separator);
+                else if (lineStart && !nWritten) fprintf(file, "run%c", separator);
+                if (line > 0 || !nWritten) fwrite(p, 1, next - p, file);
+                lineStart = newline != NULL;
+                line += lineStart;
+            }
+        }
+        nWritten++;
+    }
+    free(buffer);
+    return nWritten;
+}
+
+// Returns 0 to indicate failure
+// Simulates all runs of the ensemble on a pool of --step-threads workers,
+// each run steps its components on one thread, and writes the rows of all
+// runs to file
+static int simulateEnsemble(Graph* graph, ExchangePlan* plan, const Master* master, Ensemble* ensemble, FILE* file) {
+    EnsembleData d;
+    Master m = *master;
+    ThreadPool* pool = threadPoolNew(simOptions.stepThreads);
+    double wallTime;
+    int i, j, nWritten, ok = 1;
+
+    memset(&d, 0, sizeof(d));
+    m.stepThreads = 1;
+    d.graph = graph;
+    d.master = &m;
+    d.ensemble = ensemble;
+    for (d.nComps=0; graph->components[d.nComps]; d.nComps++);
+    d.nWorkers = pool ? threadPoolSize(pool) : 0;
+    if (d.nWorkers > ensemble->nRuns) d.nWorkers = ensemble->nRuns;
+    d.graphs = (Graph*)calloc(d.nWorkers + 1, sizeof(Graph));
+    d.plans = (ExchangePlan**)calloc(d.nWorkers + 1, sizeof(ExchangePlan*));
+    d.isolated = (FMU**)calloc((size_t)d.nWorkers * d.nComps + 1, sizeof(FMU*));
+    d.files = (FILE**)calloc(d.nWorkers + 1, sizeof(FILE*));
+    d.start = (long*)calloc(ensemble->nRuns, sizeof(long));
+    d.end = (long*)calloc(ensemble->nRuns, sizeof(long));
+    if (!pool || !d.graphs || !d.plans || !d.isolated || !d.files || !d.start || !d.end) ok = 0;
+
+    // the copies of the components of each worker, they start without instances
+    for (j=0; ok && j<d.nWorkers; j++) {
+        Component* copies = (Component*)arenaAlloc(graph->arena, (d.nComps + 1) * sizeof(Component));
+        d.graphs[j] = *graph;
+        d.graphs[j].components = (Component**)arenaAlloc(graph->arena, (d.nComps + 1) * sizeof(Component*));
+        if (!copies || !d.graphs[j].components) {
+            ok = 0;
+            break;
+        }
+        for (i=0; i<d.nComps; i++) {
+            copies[i] = *graph->components[i];
+            copies[i].instance = NULL;
+            d.graphs[j].components[i] = &copies[i];
+        }
+        d.graphs[j].components[d.nComps] = NULL;
+        d.plans[j] = exchangePlanClone(plan, graph, d.graphs[j].components);
+        d.files[j] = tmpfile();
+        if (!d.plans[j] || !d.files[j]) ok = 0;
+    }
+    if (!ok) printf("error: Out of memory\n");
+    else {
+        printf("Ensemble of %d runs on %d worker(s)\n", ensemble->nRuns, d.nWorkers);
+        wallTime = monotonicTime();
+        threadPoolRun(pool, ensembleTask, &d, d.nWorkers);
+        wallTime = monotonicTime() - wallTime;
+        nWritten = mergeRuns(&d, file);
+        printf("Ensemble from 0 to %g terminated %s\n", master->tEnd, nWritten == ensemble->nRuns ? "successful" : "with errors");
+        printf("  runs ............. %d, %d failed\n", ensemble->nRuns, ensemble->nRuns - nWritten);
+        printf("  workers .......... %d, %.3f s, %.1f runs/s\n", d.nWorkers, wallTime, ensemble->nRuns / wallTime);
+        ok = nWritten == ensemble->nRuns;
+    }
+
+    threadPoolFree(pool);
+    for (j=0; j<d.nWorkers; j++) {
+        if (d.plans && d.plans[j]) exchangePlanFree(d.plans[j]);
+        if (d.files && d.files[j]) fclose(d.files[j]);
+        for (i=0; d.isolated && i<d.nComps; i++) {
+            if (!d.isolated[j * d.nComps + i]) continue;
+            unloadFMU(d.isolated[j * d.nComps + i], 0);
+            free(d.isolated[j * d.nComps + i]);
+        }
+    }
+    free(d.graphs);
+    free(d.plans);
+    free(d.isolated);
+    free(d.files);
+    free(d.start);
+    free(d.end);
+    return ok;
+}
+
 int main(int argc, char *argv[]) {
     Graph* graph;
+    ExchangePlan* plan;     // the ports to exchange per step, grouped by type
+    int* order = NULL;      // the order of the Gauss-Seidel master, NULL for Jacobi
+    int nDelayed;           // number of connections delayed to break cycles
+    Master master;          // the master algorithm and its settings
+    Ensemble* ensemble = NULL; // the runs of --ensemble, NULL for a single run
+    int* ratio;             // per component: its stepRatio, see stepRatios
     char* graphFileName;
+    FILE* file;
     
     // parse command line arguments and load the FMU
     double tEnd = 1.0;
@@ -234,26 +1015,80 @@ int main(int argc, char *argv[]) {
     int loggingOn = 0;
     char csv_separator = ';';
     parseArguments(argc, argv, &graphFileName, &tEnd, &h, &loggingOn, &csv_separator);
+    if (simOptions.events && simOptions.gaussSeidel) {
+        printf("error: --events cannot be combined with --master=gs\n");
+        exit(EXIT_FAILURE);
+    }
+    if (simOptions.ensemble && simOptions.timingsFile) {
+        printf("error: --ensemble cannot be combined with --timings\n");
+        exit(EXIT_FAILURE);
+    }
     graph = loadGraph(graphFileName);
+    plan = graph ? exchangePlanNew(graph) : NULL;
+    if (!plan) exit(EXIT_FAILURE);
+    if (simOptions.gaussSeidel) {
+        order = gaussSeidelOrder(graph, &nDelayed);
+        if (!order) exit(EXIT_FAILURE);
+        printf("Gauss-Seidel master, %d connection(s) delayed to break cycles\n", nDelayed);
+    }
+    ratio = stepRatios(graph, simOptions.events ? "--events" : NULL);
+    if (!ratio) exit(EXIT_FAILURE);
+    memset(&master, 0, sizeof(master));
+    master.order = order;
+    master.events = simOptions.events && variableStepSize(graph, "--events");
+    master.ratio = ratio;
+    master.tEnd = tEnd;
+    master.h = h;
+    master.loggingOn = loggingOn;
+    master.separator = csv_separator;
+    master.stepThreads = simOptions.stepThreads;
+    if (simOptions.ensemble) {
+        ensemble = ensembleRead(simOptions.ensemble, graph);
+        if (!ensemble) exit(EXIT_FAILURE);
+    }
+
+    // open result file
+    if (!(file=fopen(RESULT_FILE, "w"))) {
+        printf("could not write %s because:\n", RESULT_FILE);
+        printf("    %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 
     // run the simulation
     printf("FMU Simulator: run configuration '%s' from t=0..%g with step size h=%g, loggingOn=%d, csv separator='%c'\n", 
             graphFileName, tEnd, h, loggingOn, csv_separator);
-    simulate(graph, tEnd, h, loggingOn, csv_separator);
+    if (ensemble) simulateEnsemble(graph, plan, &master, ensemble, file);
+    else simulate(graph, plan, &master, file, NULL, 0);
+    fclose(file);
     printf("CSV file '%s' written\n", RESULT_FILE);
 
-    // release FMU 
+    // release FMUs, each is shared by all components with the same fmuPath
+    // that do not have an isolated instance
     int i;
-    Component** comps = graph->components;
-    for (i=0; comps[i]; i++) {
-#ifdef _MSC_VER
-        FreeLibrary(((FMU*)comps[i]->fmu)->dllHandle);
-#else
-        dlclose(((FMU*)comps[i]->fmu)->dllHandle);
-#endif
-        freeElement(((FMU*)comps[i]->fmu)->modelDescription);
-        free(comps[i]->fmu);
+    for (i=0; graph->components[i]; i++) {
+        if (!registry.isolated[i]) continue;
+        unloadFMU(registry.isolated[i], 0);
+        free(registry.isolated[i]);
+    }
+    for (i=0; i<registry.n; i++) {
+        unloadFMU(registry.fmus[i], 1);
+        free(registry.fmus[i]);
     }
+    free(registry.fmuPaths);
+    free(registry.slots);
+    free(registry.fmus);
+    free(registry.nInstances);
+    free(registry.firstComponent);
+    free(registry.logs);
+    free(registry.loaded);
+    free(registry.isolated);
+    free(registry.fmuIndex);
+    free(registry.isolatedLogs);
+    free(registry.isolatedLoaded);
+    free(registry.names);
+    free(timings);
+    ensembleFree(ensemble);
+    exchangePlanFree(plan);
     freeElement(graph);
     return EXIT_SUCCESS;
 }
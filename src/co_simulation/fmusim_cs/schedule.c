@@ -0,0 +1,306 @@
+/* -------------------------------------------------------------------------
+ * schedule.c
+ * The order of the Gauss-Seidel master, see schedule.h.
+ * The connections define a graph with an edge from the producer to the
+ * consumer of each connection. Its strongly connected components are
+ * ordered topologically, acyclic parts need no delayed connection. Inside
+ * a cycle, components are placed greedily: next is a component whose
+ * inputs are all produced already, or else the one whose pending inputs
+ * have the least direct feedthrough, and these inputs are delayed.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schedule.h"
+
+// The component graph: edge e goes from component from[e] to to[e].
+// The edges out of and into component i are listed from outStart[i] and
+// inStart[i] to outStart[i+1] and inStart[i+1] in outEdges and inEdges.
+typedef struct {
+    int n;                   // number of components
+    int nEdges;
+    int* from;
+    int* to;
+    int* weight;             // direct feedthrough of the output of each edge
+    int* outStart;
+    int* outEdges;
+    int* inStart;
+    int* inEdges;
+} ComponentGraph;
+
+// number of elements of a null-terminated list, 0 for NULL
+static int listSize(void** list) {
+    int n = 0;
+    if (list) while (list[n]) n++;
+    return n;
+}
+
+static unsigned int hashPointer(const void* p) {
+    unsigned long long x = (unsigned long long)(size_t)p >> 3;
+    x *= 0x9E3779B97F4A7C15ULL;
+    return (unsigned int)(x >> 32);
+}
+
+// The direct feedthrough of output port p of component c: the number of
+// inputs of c its variable depends on directly. Without a DirectDependency
+// element, the output may depend on all inputs.
+static int feedthrough(Component* c, Port* p) {
+    ScalarVariable* sv = (ScalarVariable*)p->variable;
+    int i, k, n = 0;
+    if (!sv || !sv->directDependencies) return listSize((void**)c->inputs);
+    for (k=0; sv->directDependencies[k]; k++) {
+        const char* name = getString(sv->directDependencies[k], att_input);
+        for (i=0; name && c->inputs && c->inputs[i]; i++) {
+            if (!strcmp(name, getName(c->inputs[i]))) {
+                n++;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+// Returns 0 to indicate failure
+// Sets the edges of g and counts the connections of a component to itself
+// in *nDelayed. The producer of a connection is its first output port.
+static int buildGraph(Graph* graph, ComponentGraph* g, int* nDelayed) {
+    Component** comps = graph->components;
+    Connection** keys;
+    int* producer;           // per slot of keys: component index
+    int* port;               // per slot of keys: output port index
+    unsigned int size = 16, h;
+    int i, k, e, nOutputs = 0, nInputs = 0;
+
+    for (g->n=0; comps[g->n]; g->n++) {
+        nOutputs += listSize((void**)comps[g->n]->outputs);
+        nInputs += listSize((void**)comps[g->n]->inputs);
+    }
+    while (size < 2 * (unsigned int)nOutputs) size *= 2;
+    keys = (Connection**)calloc(size, sizeof(Connection*));
+    producer = (int*)malloc(size * sizeof(int));
+    port = (int*)malloc(size * sizeof(int));
+    g->from = (int*)malloc((nInputs + 1) * sizeof(int));
+    g->to = (int*)malloc((nInputs + 1) * sizeof(int));
+    g->weight = (int*)malloc((nInputs + 1) * sizeof(int));
+    g->outStart = (int*)calloc(g->n + 1, sizeof(int));
+    g->inStart = (int*)calloc(g->n + 1, sizeof(int));
+    g->outEdges = (int*)malloc((nInputs + 1) * sizeof(int));
+    g->inEdges = (int*)malloc((nInputs + 1) * sizeof(int));
+    if (!keys || !producer || !port || !g->from || !g->to || !g->weight
+            || !g->outStart || !g->inStart || !g->outEdges || !g->inEdges) {
+        free(keys);
+        free(producer);
+        free(port);
+        return 0;
+    }
+
+    // index the producer of each connection
+    for (i=0; i<g->n; i++) {
+        for (k=0; comps[i]->outputs && comps[i]->outputs[k]; k++) {
+            Connection* con = comps[i]->outputs[k]->connection;
+            if (!con) continue;
+            for (h = hashPointer(con) & (size - 1); keys[h] && keys[h] != con; h = (h + 1) & (size - 1));
+            if (keys[h]) continue;
+            keys[h] = con;
+            producer[h] = i;
+            port[h] = k;
+        }
+    }
+
+    // one edge per input port with a producer
+    g->nEdges = 0;
+    for (i=0; i<g->n; i++) {
+        for (k=0; comps[i]->inputs && comps[i]->inputs[k]; k++) {
+            Connection* con = comps[i]->inputs[k]->connection;
+            if (!con) continue;
+            for (h = hashPointer(con) & (size - 1); keys[h] && keys[h] != con; h = (h + 1) & (size - 1));
+            if (!keys[h]) continue;
+            if (producer[h] == i) {
+                (*nDelayed)++; // the output of a component can only reach itself with a delay
+                continue;
+            }
+            e = g->nEdges++;
+            g->from[e] = producer[h];
+            g->to[e] = i;
+            g->weight[e] = feedthrough(comps[producer[h]], comps[producer[h]]->outputs[port[h]]);
+            g->outStart[producer[h] + 1]++;
+            g->inStart[i + 1]++;
+        }
+    }
+    free(keys);
+    free(producer);
+    free(port);
+
+    // sort the edges by from and by to
+    for (i=0; i<g->n; i++) {
+        g->outStart[i + 1] += g->outStart[i];
+        g->inStart[i + 1] += g->inStart[i];
+    }
+    for (e=0; e<g->nEdges; e++) {
+        g->outEdges[g->outStart[g->from[e]]++] = e;
+        g->inEdges[g->inStart[g->to[e]]++] = e;
+    }
+    for (i=g->n; i>0; i--) {
+        g->outStart[i] = g->outStart[i - 1];
+        g->inStart[i] = g->inStart[i - 1];
+    }
+    g->outStart[0] = 0;
+    g->inStart[0] = 0;
+    return 1;
+}
+
+// Returns -1 to indicate failure
+// Returns the number of strongly connected components of g and sets
+// scc[i] of each component i, using Tarjan's algorithm without recursion.
+// A strongly connected component is numbered after all it has edges to.
+static int strongComponents(ComponentGraph* g, int* scc) {
+    int* index = (int*)malloc((g->n + 1) * sizeof(int));
+    int* low = (int*)malloc((g->n + 1) * sizeof(int));
+    int* next = (int*)malloc((g->n + 1) * sizeof(int));   // next out edge to visit
+    int* stack = (int*)malloc((g->n + 1) * sizeof(int));  // visited, not yet assigned
+    int* call = (int*)malloc((g->n + 1) * sizeof(int));   // the depth-first path
+    char* onStack = (char*)calloc(g->n + 1, sizeof(char));
+    int counter = 0, sp = 0, cp = 0, nScc = 0;
+    int s, v, w;
+    if (!index || !low || !next || !stack || !call || !onStack) nScc = -1;
+    for (s=0; nScc >= 0 && s<g->n; s++) index[s] = -1;
+    for (s=0; nScc >= 0 && s<g->n; s++) {
+        if (index[s] >= 0) continue;
+        index[s] = low[s] = counter++;
+        next[s] = g->outStart[s];
+        stack[sp++] = s;
+        onStack[s] = 1;
+        call[cp++] = s;
+        while (cp) {
+            v = call[cp - 1];
+            if (next[v] < g->outStart[v + 1]) {
+                w = g->to[g->outEdges[next[v]++]];
+                if (index[w] < 0) {
+                    index[w] = low[w] = counter++;
+                    next[w] = g->outStart[w];
+                    stack[sp++] = w;
+                    onStack[w] = 1;
+                    call[cp++] = w;
+                }
+                else if (onStack[w] && index[w] < low[v]) low[v] = index[w];
+                continue;
+            }
+            cp--;
+            if (cp && low[v] < low[call[cp - 1]]) low[call[cp - 1]] = low[v];
+            if (low[v] == index[v]) {
+                do {
+                    w = stack[--sp];
+                    onStack[w] = 0;
+                    scc[w] = nScc;
+                } while (w != v);
+                nScc++;
+            }
+        }
+    }
+    free(index);
+    free(low);
+    free(next);
+    free(stack);
+    free(call);
+    free(onStack);
+    return nScc;
+}
+
+// Place the m components of one strongly connected component, given in
+// graph order in order[0..m-1], greedily, see above. pending[i] counts
+// the edges into component i from unplaced components of its cycle and
+// feed[i] sums their direct feedthrough. Returns the number of delayed edges.
+static int placeCycle(ComponentGraph* g, int* scc, int* order, int m, int* pending, int* feed, char* placed) {
+    int i, k, e, v, best, nDelayed = 0;
+    for (i=0; i<m; i++) {
+        v = order[i];
+        for (k=g->inStart[v]; k<g->inStart[v + 1]; k++) {
+            e = g->inEdges[k];
+            if (scc[g->from[e]] != scc[v]) continue;
+            pending[v]++;
+            feed[v] += g->weight[e];
+        }
+    }
+    for (i=0; i<m; i++) {
+        // the first unplaced component without pending inputs, or else with the least feedthrough
+        best = -1;
+        for (k=i; k<m; k++) {
+            v = order[k];
+            if (best < 0 || feed[v] < feed[order[best]]
+                    || (feed[v] == feed[order[best]] && pending[v] < pending[order[best]])) best = k;
+            if (!pending[v]) break;
+        }
+        v = order[best];
+        memmove(order + i + 1, order + i, (best - i) * sizeof(int));
+        order[i] = v;
+        placed[v] = 1;
+        nDelayed += pending[v];
+        for (k=g->outStart[v]; k<g->outStart[v + 1]; k++) {
+            e = g->outEdges[k];
+            if (scc[g->to[e]] != scc[v] || placed[g->to[e]]) continue;
+            pending[g->to[e]]--;
+            feed[g->to[e]] -= g->weight[e];
+        }
+    }
+    return nDelayed;
+}
+
+// Returns NULL to indicate failure
+// Returns the indexes of the components of the graph in the order the
+// Gauss-Seidel master steps them, allocated in the arena of the graph.
+// Sets *nDelayed to the number of connections that are read before their
+// producer is stepped. To be called after the ports have been bound to
+// their variables, see loadGraph.
+int* gaussSeidelOrder(Graph* graph, int* nDelayed) {
+    ComponentGraph g;
+    int* order = NULL;
+    int* scc = NULL;
+    int* start = NULL;       // per strongly connected component: its first index in order
+    int* pending = NULL;
+    int* feed = NULL;
+    char* placed = NULL;
+    int i, nScc = -1;
+
+    memset(&g, 0, sizeof(g));
+    *nDelayed = 0;
+    if (buildGraph(graph, &g, nDelayed)) {
+        order = (int*)arenaAlloc(graph->arena, (g.n + 1) * sizeof(int));
+        scc = (int*)malloc((g.n + 1) * sizeof(int));
+        pending = (int*)calloc(g.n + 1, sizeof(int));
+        feed = (int*)calloc(g.n + 1, sizeof(int));
+        placed = (char*)calloc(g.n + 1, sizeof(char));
+        if (order && scc && pending && feed && placed) nScc = strongComponents(&g, scc);
+    }
+    if (nScc >= 0) start = (int*)calloc(nScc + 1, sizeof(int));
+    if (start) {
+        // topological order: strongly connected components with higher numbers first,
+        // the components of each in graph order
+        for (i=0; i<g.n; i++) start[nScc - scc[i]]++;
+        for (i=1; i<=nScc; i++) start[i] += start[i - 1];
+        for (i=0; i<g.n; i++) order[start[nScc - 1 - scc[i]]++] = i;
+        for (i=nScc; i>0; i--) start[i] = start[i - 1];
+        start[0] = 0;
+        for (i=0; i<nScc; i++) {
+            int m = start[i + 1] - start[i];
+            if (m > 1) *nDelayed += placeCycle(&g, scc, order + start[i], m, pending, feed, placed);
+        }
+    }
+    else {
+        printf("error: Out of memory\n");
+        order = NULL;
+    }
+    free(start);
+    free(scc);
+    free(pending);
+    free(feed);
+    free(placed);
+    free(g.from);
+    free(g.to);
+    free(g.weight);
+    free(g.outStart);
+    free(g.outEdges);
+    free(g.inStart);
+    free(g.inEdges);
+    return order;
+}
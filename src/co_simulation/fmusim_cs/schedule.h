@@ -0,0 +1,17 @@
+/* -------------------------------------------------------------------------
+ * schedule.h
+ * The order in which the Gauss-Seidel master steps the components of a
+ * graph: each component right after the producers of its inputs. Cycles
+ * of the connection graph are broken at the connections with the least
+ * direct feedthrough; such a connection is read before its producer is
+ * stepped, i.e. with a delay of one step as by the Jacobi master.
+ * -------------------------------------------------------------------------*/
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "fmi_cs.h"
+
+int* gaussSeidelOrder(Graph* graph, int* nDelayed);
+
+#endif // SCHEDULE_H
@@ -0,0 +1,86 @@
+/* -------------------------------------------------------------------------
+ * signals.c
+ * The signal buffer of the co-simulation master, see signals.h.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "signals.h"
+
+// Returns -1 for types not exchanged by the master
+int portType(Enu type) {
+    switch (type) {
+        case enu_Real:    return portReal;
+        case enu_Integer: return portInteger;
+        case enu_Boolean: return portBoolean;
+        case enu_String:  return portString;
+        default:          return -1;
+    }
+}
+
+size_t signalSize(int t) {
+    switch (t) {
+        case portReal:    return sizeof(fmiReal);
+        case portInteger: return sizeof(fmiInteger);
+        case portBoolean: return sizeof(fmiBoolean);
+        default:          return sizeof(fmiString);
+    }
+}
+
+// size of an array of n values of type t, rounded up to whole cache lines
+static size_t arraySize(int t, int n) {
+    return (n * signalSize(t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+// Returns NULL to indicate failure
+// All values are 0, NULL for strings. To be called after validateGraph.
+SignalBuffer* signalBufferNew(Graph* graph) {
+    SignalBuffer* b = (SignalBuffer*)calloc(1, sizeof(SignalBuffer));
+    size_t size = CACHE_LINE;
+    char* p;
+    int i, k, t;
+    if (!b) return NULL;
+    for (i=0; graph->connections && graph->connections[i]; i++) {
+        Connection* con = graph->connections[i];
+        t = portType(con->valueType);
+        if (t >= 0 && con->signal >= b->n[t]) b->n[t] = con->signal + 1;
+    }
+    for (t=0; t<SIZEOF_PORT_TYPE; t++) size += 2 * arraySize(t, b->n[t]);
+    b->block = calloc(1, size);
+    if (!b->block) {
+        free(b);
+        return NULL;
+    }
+    p = (char*)b->block + (CACHE_LINE - (size_t)b->block % CACHE_LINE) % CACHE_LINE;
+    for (k=0; k<2; k++) {
+        for (t=0; t<SIZEOF_PORT_TYPE; t++) {
+            b->values[k][t] = p;
+            p += arraySize(t, b->n[t]);
+        }
+    }
+    return b;
+}
+
+void signalBufferSwap(SignalBuffer* b) {
+    b->current = 1 - b->current;
+}
+
+// Set all values to 0, e.g. before the next run of an ensemble
+void signalBufferReset(SignalBuffer* b) {
+    int k, t;
+    for (k=0; k<2; k++)
+        for (t=0; t<SIZEOF_PORT_TYPE; t++) memset(b->values[k][t], 0, b->n[t] * signalSize(t));
+    b->current = 0;
+}
+
+// true if a next value of type t differs from its current value
+int signalBufferChanged(SignalBuffer* b, int t) {
+    return memcmp(signalsCurrent(b)[t], signalsNext(b)[t], b->n[t] * signalSize(t)) != 0;
+}
+
+void signalBufferFree(SignalBuffer* b) {
+    if (!b) return;
+    free(b->block);
+    free(b);
+}
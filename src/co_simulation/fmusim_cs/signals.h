@@ -0,0 +1,44 @@
+/* -------------------------------------------------------------------------
+ * signals.h
+ * The values of all connections of a graph, one array per base type,
+ * indexed by the signal number of the connection, see validateGraph.
+ * Each array is aligned to a cache line and exists twice: during a
+ * communication step of the Jacobi master, the components read their
+ * inputs from the current values and write their outputs to the next
+ * values, so they can run in parallel. signalBufferSwap then makes the
+ * next values current.
+ * -------------------------------------------------------------------------*/
+
+#ifndef SIGNALS_H
+#define SIGNALS_H
+
+#include "fmi_cs.h"
+
+#define CACHE_LINE 64
+
+// base types of the signals, in the order of the get/set calls
+typedef enum {
+    portReal, portInteger, portBoolean, portString,
+    SIZEOF_PORT_TYPE
+} PortType;
+
+typedef struct {
+    int n[SIZEOF_PORT_TYPE];               // number of signals of each base type
+    void* values[2][SIZEOF_PORT_TYPE];     // two arrays of n values of each base type
+    int current;                           // values[current] are current, the others next
+    void* block;                           // holds all arrays
+} SignalBuffer;
+
+// the arrays of the current and of the next values, indexed by PortType
+#define signalsCurrent(b) ((b)->values[(b)->current])
+#define signalsNext(b) ((b)->values[1 - (b)->current])
+
+int portType(Enu type);
+size_t signalSize(int t);
+SignalBuffer* signalBufferNew(Graph* graph);
+void signalBufferSwap(SignalBuffer* b);
+void signalBufferReset(SignalBuffer* b);
+int signalBufferChanged(SignalBuffer* b, int t);
+void signalBufferFree(SignalBuffer* b);
+
+#endif // SIGNALS_H
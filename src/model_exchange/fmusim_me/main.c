@@ -37,12 +37,14 @@
 #include <stdio.h>
 #include "fmi_me.h"
 #include "sim_support.h"
+#include "timings.h"
 
-#ifdef __APPLE__
 #include <string.h> //strerror()
-#endif
+#include <errno.h>
 
 FMU fmu; // the fmu to simulate
+static Timings timings;          // startup timings, reported if --timings is given
+static double startTime;         // start of loading the FMU, see monotonicTime
 
 // simulate the given FMU using the forward euler method.
 // time events are processed by reducing step size to exactly hit tNext.
@@ -71,7 +73,11 @@ static int simulate(FMU* fmu, double tEnd, double h, fmiBoolean loggingOn, char
     int nTimeEvents = 0;
     int nStepEvents = 0;
     int nStateEvents = 0;
+    double start;                    // start of a timed phase
     FILE* file;
+    Component component;             // the fmu as the only component of a graph, see outputRow
+    Component* components[2];
+    Graph graph;
 
     // instantiate the fmu
     md = fmu->modelDescription;
@@ -79,8 +85,17 @@ static int simulate(FMU* fmu, double tEnd, double h, fmiBoolean loggingOn, char
     callbacks.logger = fmuLogger;
     callbacks.allocateMemory = calloc;
     callbacks.freeMemory = free;
+    start = monotonicTime();
     c = fmu->instantiateModel(getModelIdentifier(md), guid, callbacks, loggingOn);
+    timingsAdd(phase_instantiate, start);
     if (!c) return error("could not instantiate model");
+    memset(&component, 0, sizeof(component));
+    component.fmu = fmu;
+    component.instance = c;
+    components[0] = &component;
+    components[1] = NULL;
+    memset(&graph, 0, sizeof(graph));
+    graph.components = components;
     
     // allocate memory 
     nx = getNumberOfStates(md);
@@ -104,16 +119,24 @@ static int simulate(FMU* fmu, double tEnd, double h, fmiBoolean loggingOn, char
     time = t0;
     fmiFlag =  fmu->setTime(c, t0);
     if (fmiFlag > fmiWarning) return error("could not set time");
+    start = monotonicTime();
     fmiFlag =  fmu->initialize(c, toleranceControlled, t0, &eventInfo);
+    timingsAdd(phase_initialize, start);
     if (fmiFlag > fmiWarning)  return error("could not initialize model");
+    if (simOptions.timingsFile) {
+        timingsCapture(NULL);
+        timingsPrint(&timings, 1, monotonicTime() - startTime);
+        if (!timingsWriteJson(simOptions.timingsFile, &timings, 1, monotonicTime() - startTime))
+            printf("warning: Could not write %s\n", simOptions.timingsFile);
+    }
     if (eventInfo.terminateSimulation) {
         printf("model requested termination at init");
         tEnd = time;
     }
   
     // output solution for time t0
-    outputRow(fmu, c, t0, file, separator, TRUE);  // output column names
-    outputRow(fmu, c, t0, file, separator, FALSE); // output values
+    outputRow(&graph, t0, file, separator, TRUE);  // output column names
+    outputRow(&graph, t0, file, separator, FALSE); // output values
 
     // enter the simulation loop
     while (time < tEnd) {
@@ -189,7 +212,7 @@ static int simulate(FMU* fmu, double tEnd, double h, fmiBoolean loggingOn, char
         }
        
      } // if event
-     outputRow(fmu, c, time, file, separator, FALSE); // output values for this step
+     outputRow(&graph, time, file, separator, FALSE); // output values for this step
      nSteps++;
   } // while  
 
@@ -227,7 +250,12 @@ int main(int argc, char *argv[]) {
     int loggingOn = 0;
     char csv_separator = ';';
     parseArguments(argc, argv, &fmuFileName, &tEnd, &h, &loggingOn, &csv_separator);
-    loadFMU(fmuFileName);
+    startTime = monotonicTime();
+    timings.name = fmuFileName;
+    timings.fmuPath = fmuFileName;
+    timings.loadedBy = "self";
+    if (simOptions.timingsFile) timingsCapture(&timings);
+    loadFMU(&fmu, fmuFileName);
 
     // run the simulation
     printf("FMU Simulator: run '%s' from t=0..%g with step size h=%g, loggingOn=%d, csv separator='%c'\n", 
@@ -236,11 +264,6 @@ int main(int argc, char *argv[]) {
     printf("CSV file '%s' written\n", RESULT_FILE);
 
     // release FMU 
-#ifdef _MSC_VER
-    FreeLibrary(fmu.dllHandle);
-#else
-    dlclose(fmu.dllHandle);
-#endif
-    freeElement(fmu.modelDescription);
+    unloadFMU(&fmu, 1);
     return EXIT_SUCCESS;
 }
@@ -372,12 +372,38 @@ const char* fmiGetTypesPlatform() {
     return fmiPlatform;
 }
 
+#ifdef RUN_ASYNCHRONOUSLY
+// Waits for the thread of the last asynchronous fmiDoStep, if any
+static void joinStep(ModelInstance* comp) {
+    if (!comp->stepStarted) return;
+    pthread_join(comp->stepThread, NULL);
+    comp->stepStarted = fmiFalse;
+}
+#endif
+
 fmiComponent fmiInstantiateSlave(fmiString  instanceName, fmiString  GUID,
     fmiString  fmuLocation, fmiString  mimeType, fmiReal timeout, fmiBoolean visible,
     fmiBoolean interactive, fmiCallbackFunctions functions, fmiBoolean loggingOn) {
     // ignoring arguments: fmuLocation, mimeType, timeout, visible, interactive
+#ifdef RUN_ASYNCHRONOUSLY
+    ModelInstance* comp = (ModelInstance *)
+        instantiateModel("fmiInstantiateSlave", instanceName, GUID, functions, loggingOn);
+    if (comp) pthread_mutex_init(&comp->stepLock, NULL);
+    return comp;
+#else
     return instantiateModel("fmiInstantiateSlave", instanceName, GUID, functions, loggingOn);
+#endif
+}
+
+#if NUMBER_OF_EVENT_INDICATORS>0
+// keeps the event indicators at the end of a step, for the next step of length zero
+static void storeEventIndicators(ModelInstance* comp) {
+    int i;
+    for (i=0; i<NUMBER_OF_EVENT_INDICATORS; i++) {
+        comp->eventIndicators[i] = getEventIndicator(comp, i);
+    }
 }
+#endif
 
 fmiStatus fmiInitializeSlave(fmiComponent c, fmiReal tStart, fmiBoolean StopTimeDefined, fmiReal tStop) {
     ModelInstance* comp = (ModelInstance *)c;
@@ -389,10 +415,16 @@ fmiStatus fmiInitializeSlave(fmiComponent c, fmiReal tStart, fmiBoolean StopTime
         // ignoring arguments: tStart, StopTimeDefined, tStop
         flag = init("fmiInitializeSlave", c, toleranceControlled, relativeTolerance, &comp->eventInfo);
     }
+#if NUMBER_OF_EVENT_INDICATORS>0
+    storeEventIndicators(comp);
+#endif
     return flag;
 }
 
 fmiStatus fmiTerminateSlave(fmiComponent c) {
+#ifdef RUN_ASYNCHRONOUSLY
+    joinStep((ModelInstance *)c);
+#endif
     return terminate("fmiTerminateSlave", c);
 }
 
@@ -410,6 +442,10 @@ void fmiFreeSlaveInstance(fmiComponent c) {
     ModelInstance* comp = (ModelInstance *)c;
     if (invalidState(comp, "fmiFreeSlaveInstance", modelTerminated))
          return;
+#ifdef RUN_ASYNCHRONOUSLY
+    joinStep(comp);
+    pthread_mutex_destroy(&comp->stepLock);
+#endif
     freeInstance("fmiFreeSlaveInstance", c);
 }
 
@@ -451,7 +487,8 @@ fmiStatus fmiCancelStep(fmiComponent c) {
     return fmiError;
 }
 
-fmiStatus fmiDoStep(fmiComponent c, fmiReal currentCommunicationPoint, 
+// carries out the Euler steps of doStep
+static fmiStatus doEulerSteps(fmiComponent c, fmiReal currentCommunicationPoint, 
     fmiReal communicationStepSize, fmiBoolean newStep) {
     ModelInstance* comp = (ModelInstance *)c;
     fmiCallbackLogger log = comp->functions.logger;
@@ -468,21 +505,23 @@ fmiStatus fmiDoStep(fmiComponent c, fmiReal currentCommunicationPoint,
     double prevEventIndicators[max(NUMBER_OF_EVENT_INDICATORS, 1)];
     int stateEvent = 0;
 #endif
+#ifdef STOP_AT_EVENTS
+    fmiBoolean atTimeEvent;
+#endif
 
-    if (invalidState(comp, "fmiDoStep", modelInitialized))
-         return fmiError;
-
+#ifdef DO_STEP_DELAY_US
+    usleep(DO_STEP_DELAY_US);
+#endif
     if (comp->loggingOn) log(c, comp->instanceName, fmiOK, "log", "fmiDoStep: "
        "currentCommunicationPoint = %g, ", 
        "communicationStepSize = %g, ", 
        "newStep = fmi%s", 
        currentCommunicationPoint, communicationStepSize, newStep ? "True" : "False");
     
-    // Treat also case of zero step, i.e. during an event iteration
-    if (communicationStepSize == 0) {
-        return fmiOK;
-    }
-           
+#ifdef STOP_AT_EVENTS
+    comp->stepDiscarded = fmiFalse;
+#endif
+
 #if NUMBER_OF_EVENT_INDICATORS>0
     // initialize previous event indcators with current values
     for (i=0; i<NUMBER_OF_EVENT_INDICATORS; i++) {
@@ -490,10 +529,41 @@ fmiStatus fmiDoStep(fmiComponent c, fmiReal currentCommunicationPoint,
     }
 #endif
 
+    // Treat also case of zero step, i.e. during an event iteration:
+    // fire the state events caused by the inputs set since the last step,
+    // without advancing time. The indicators are compared with those at the
+    // end of the last step, and with those at the start of this call for
+    // models whose indicators report a change since their last evaluation,
+    // such as waterTankEnv.
+    if (communicationStepSize == 0) {
+#if NUMBER_OF_EVENT_INDICATORS>0
+        comp->time = currentCommunicationPoint;
+        for (i=0; i<NUMBER_OF_EVENT_INDICATORS; i++) {
+            double ei = getEventIndicator(comp, i);
+            if (ei * comp->eventIndicators[i] < 0 || ei * prevEventIndicators[i] < 0) {
+                if (comp->loggingOn) comp->functions.logger(c, comp->instanceName, fmiOK, "log", 
+                    "fmiDoStep: state event at %g, z%d crosses zero -%c-", comp->time, i, ei<0 ? '\\' : '/');
+                stateEvent++;
+            }
+        }
+        if (stateEvent) eventUpdate(comp, &comp->eventInfo);
+#endif
+        return fmiOK;
+    }
+
     // break the step into n steps and do forward Euler. 
     comp->time = currentCommunicationPoint;
     for (k=0; k<n; k++) {
+#ifdef STOP_AT_EVENTS
+        // end this Euler step at the next time event
+        atTimeEvent = comp->eventInfo.upcomingTimeEvent && comp->eventInfo.nextEventTime > comp->time
+                && comp->eventInfo.nextEventTime < comp->time + h;
+        if (atTimeEvent) h = comp->eventInfo.nextEventTime - comp->time;
+#endif
         comp->time += h;
+#ifdef STOP_AT_EVENTS
+        if (atTimeEvent) comp->time = comp->eventInfo.nextEventTime;
+#endif
 
 #if NUMBER_OF_REALS>0
         for (i=0; i<NUMBER_OF_STATES; i++) {
@@ -519,13 +589,23 @@ fmiStatus fmiDoStep(fmiComponent c, fmiReal currentCommunicationPoint,
         if (stateEvent) {
             eventUpdate(comp, &comp->eventInfo);
             stateEvent = 0;
+#ifdef STOP_AT_EVENTS
+            comp->stepDiscarded = fmiTrue;
+#endif
         } 
 #endif
         // check for time event
+#ifdef STOP_AT_EVENTS
+        if (comp->eventInfo.upcomingTimeEvent && comp->time >= comp->eventInfo.nextEventTime) {
+#else
         if (comp->eventInfo.upcomingTimeEvent && comp->time > comp->eventInfo.nextEventTime) {
+#endif
             if (comp->loggingOn) comp->functions.logger(c, comp->instanceName, fmiOK, "log", 
                 "fmiDoStep: time event detected at %g", comp->time);
             eventUpdate(comp, &comp->eventInfo);
+#ifdef STOP_AT_EVENTS
+            comp->stepDiscarded = fmiTrue;
+#endif
         }
 
         // terminate simulation, if requested by the model
@@ -534,10 +614,76 @@ fmiStatus fmiDoStep(fmiComponent c, fmiReal currentCommunicationPoint,
               "fmiDoStep: model requested termination at t=%g", comp->time);
             return fmiError; // enforce termination of the simulation loop
         }        
+#ifdef STOP_AT_EVENTS
+        // the rest of the step is left to the master, see fmiGetRealStatus
+        if (comp->stepDiscarded) {
+            if (k == n - 1 && !atTimeEvent) {
+                comp->stepDiscarded = fmiFalse; // the event ends the step
+                return fmiOK;
+            }
+            comp->lastSuccessfulTime = comp->time;
+            return fmiDiscard;
+        }
+#endif
     }
     return fmiOK;
 }
 
+// carries out fmiDoStep after its checks, see below
+static fmiStatus doStep(fmiComponent c, fmiReal currentCommunicationPoint,
+    fmiReal communicationStepSize, fmiBoolean newStep) {
+    fmiStatus status = doEulerSteps(c, currentCommunicationPoint, communicationStepSize, newStep);
+#if NUMBER_OF_EVENT_INDICATORS>0
+    storeEventIndicators((ModelInstance *)c);
+#endif
+    return status;
+}
+
+#ifdef RUN_ASYNCHRONOUSLY
+static void* stepThread(void* c) {
+    ModelInstance* comp = (ModelInstance *)c;
+    fmiStatus status = doStep(c, comp->stepTime, comp->stepSize, fmiTrue);
+    pthread_mutex_lock(&comp->stepLock);
+    comp->stepStatus = status;
+    comp->stepPending = fmiFalse;
+    pthread_mutex_unlock(&comp->stepLock);
+    comp->functions.stepFinished(c, status);
+    return NULL;
+}
+#endif
+
+fmiStatus fmiDoStep(fmiComponent c, fmiReal currentCommunicationPoint, 
+    fmiReal communicationStepSize, fmiBoolean newStep) {
+    ModelInstance* comp = (ModelInstance *)c;
+    if (invalidState(comp, "fmiDoStep", modelInitialized))
+         return fmiError;
+#ifdef RUN_ASYNCHRONOUSLY
+    // without the stepFinished callback, fmiDoStep has to be carried out synchronously
+    if (comp->functions.stepFinished && communicationStepSize != 0) {
+        fmiBoolean pending;
+        pthread_mutex_lock(&comp->stepLock);
+        pending = comp->stepPending;
+        pthread_mutex_unlock(&comp->stepLock);
+        if (pending) {
+            comp->functions.logger(c, comp->instanceName, fmiError, "error",
+                "fmiDoStep: The previous step is pending.");
+            return fmiError;
+        }
+        joinStep(comp);
+        comp->stepTime = currentCommunicationPoint;
+        comp->stepSize = communicationStepSize;
+        comp->stepPending = fmiTrue;
+        if (pthread_create(&comp->stepThread, NULL, stepThread, c)) {
+            comp->stepPending = fmiFalse;
+            return doStep(c, currentCommunicationPoint, communicationStepSize, newStep);
+        }
+        comp->stepStarted = fmiTrue;
+        return fmiPending;
+    }
+#endif
+    return doStep(c, currentCommunicationPoint, communicationStepSize, newStep);
+}
+
 static fmiStatus getStatus(char* fname, fmiComponent c, const fmiStatusKind s) {
     const char* statusKind[3] = {"fmiDoStepStatus","fmiPendingStatus","fmiLastSuccessfulTime"};
     ModelInstance* comp = (ModelInstance *)c;
@@ -563,10 +709,26 @@ static fmiStatus getStatus(char* fname, fmiComponent c, const fmiStatusKind s) {
 }
 
 fmiStatus fmiGetStatus(fmiComponent c, const fmiStatusKind s, fmiStatus* value) {
+#ifdef RUN_ASYNCHRONOUSLY
+    ModelInstance* comp = (ModelInstance *)c;
+    if (s == fmiDoStepStatus && comp->stepStarted) {
+        pthread_mutex_lock(&comp->stepLock);
+        *value = comp->stepPending ? fmiPending : comp->stepStatus;
+        pthread_mutex_unlock(&comp->stepLock);
+        return fmiOK;
+    }
+#endif
     return getStatus("fmiGetStatus", c, s);
 }
 
 fmiStatus fmiGetRealStatus(fmiComponent c, const fmiStatusKind s, fmiReal* value){
+#ifdef STOP_AT_EVENTS
+    ModelInstance* comp = (ModelInstance *)c;
+    if (s == fmiLastSuccessfulTime && comp->stepDiscarded) {
+        *value = comp->lastSuccessfulTime;
+        return fmiOK;
+    }
+#endif
     return getStatus("fmiGetRealStatus", c, s);
 }
 
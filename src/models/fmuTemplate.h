@@ -10,6 +10,21 @@
 
 #ifdef FMI_COSIMULATION
 #include "fmiFunctions.h"
+// Define RUN_ASYNCHRONOUSLY to carry out fmiDoStep in a thread of its own
+// when the simulator provides the stepFinished callback. The model
+// description must then declare canRunAsynchronuously="true".
+// Define DO_STEP_DELAY_US to let each fmiDoStep wait for the given number
+// of microseconds, e.g. to simulate waiting for a coupled tool.
+// Define STOP_AT_EVENTS to end fmiDoStep at the first state or time event
+// within the step, returning fmiDiscard with the event time as
+// fmiLastSuccessfulTime. The model description must then declare
+// canSignalEvents="true".
+#ifdef RUN_ASYNCHRONOUSLY
+#include <pthread.h>
+#endif
+#ifdef DO_STEP_DELAY_US
+#include <unistd.h>
+#endif
 #else
 #include "fmiModelFunctions.h"
 #endif
@@ -37,5 +52,21 @@ typedef struct {
     ModelState state;
 #ifdef FMI_COSIMULATION
     fmiEventInfo eventInfo;
+#ifdef RUN_ASYNCHRONOUSLY
+    pthread_t stepThread;         // carries out the last asynchronous fmiDoStep
+    pthread_mutex_t stepLock;     // protects the two fields below
+    fmiBoolean stepPending;       // fmiTrue while the thread steps
+    fmiStatus stepStatus;         // the result of the last asynchronous fmiDoStep
+    fmiBoolean stepStarted;       // fmiTrue if stepThread has to be joined
+    fmiReal stepTime;             // the arguments of the asynchronous fmiDoStep
+    fmiReal stepSize;
+#endif
+#if NUMBER_OF_EVENT_INDICATORS>0
+    fmiReal eventIndicators[NUMBER_OF_EVENT_INDICATORS]; // at the end of the last fmiDoStep
+#endif
+#ifdef STOP_AT_EVENTS
+    fmiBoolean stepDiscarded;     // fmiTrue if the last fmiDoStep stopped at an event
+    fmiReal lastSuccessfulTime;   // the time of that event
+#endif
 #endif
 } ModelInstance;
@@ -0,0 +1,97 @@
+/* -------------------------------------------------------------------------
+ * arena.c
+ * A bump allocator, see arena.h
+ * Block sizes double from ARENA_MIN_BLOCK up to ARENA_MAX_BLOCK, so small
+ * documents need little memory and large ones few blocks. Requests that
+ * do not fit into a block of the current size get a block of their own.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#endif
+#include "arena.h"
+
+#define ARENA_MIN_BLOCK (16 * 1024)
+#define ARENA_MAX_BLOCK (1024 * 1024)
+#define ARENA_ALIGN 16   // alignment of all allocations
+
+struct ArenaBlock {
+    ArenaBlock* next;    // the previous block, NULL for the first
+    size_t size;         // number of usable bytes of this block
+    size_t pos;          // offset of the first free byte
+};
+
+// size of the block header, rounded up to the alignment
+#define HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+// Returns NULL to indicate failure
+Arena* arenaNew() {
+    Arena* arena = (Arena*)calloc(1, sizeof(Arena));
+    if (arena) arena->blockSize = ARENA_MIN_BLOCK;
+    return arena;
+}
+
+// Returns NULL to indicate failure
+// Zeroed memory, so arenaAlloc never needs to clear
+static ArenaBlock* newBlock(size_t size) {
+    ArenaBlock* b = (ArenaBlock*)calloc(1, HEADER_SIZE + size);
+    if (b) b->size = size;
+    return b;
+}
+
+// Returns NULL to indicate failure
+// Otherwise size zeroed bytes, aligned to ARENA_ALIGN
+void* arenaAlloc(Arena* arena, size_t size) {
+    ArenaBlock* b = arena->blocks;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (b && b->pos + size > b->size && size > arena->blockSize / 4) {
+        // a large request gets a block of its own, the current block
+        // remains in use for the following small requests
+        ArenaBlock* nb = newBlock(size);
+        if (!nb) return NULL;
+        nb->next = b->next;
+        b->next = nb;
+        b = nb;
+    }
+    else if (!b || b->pos + size > b->size) {
+        b = newBlock(size > arena->blockSize ? size : arena->blockSize);
+        if (!b) return NULL;
+        b->next = arena->blocks;
+        arena->blocks = b;
+        if (arena->blockSize < ARENA_MAX_BLOCK) arena->blockSize *= 2;
+    }
+    b->pos += size;
+    arena->used += size;
+    return (char*)b + HEADER_SIZE + b->pos - size;
+}
+
+// Returns NULL to indicate failure
+// Otherwise a copy of the first n chars of s, terminated by '\0'
+char* arenaStrndup(Arena* arena, const char* s, size_t n) {
+    char* copy = (char*)arenaAlloc(arena, n + 1);
+    if (copy) memcpy(copy, s, n); // already terminated, memory is zeroed
+    return copy;
+}
+
+// Returns NULL to indicate failure
+char* arenaStrdup(Arena* arena, const char* s) {
+    return arenaStrndup(arena, s, strlen(s));
+}
+
+// Release the arena and all memory allocated from it
+void arenaFree(Arena* arena) {
+    ArenaBlock* b;
+    if (!arena) return;
+    b = arena->blocks;
+    while (b) {
+        ArenaBlock* next = b->next;
+        free(b);
+        b = next;
+    }
+#ifndef _MSC_VER
+    if (arena->mapped) munmap(arena->mapped, arena->mappedSize);
+#endif
+    free(arena);
+}
@@ -0,0 +1,29 @@
+/* -------------------------------------------------------------------------
+ * arena.h
+ * A bump allocator. Memory is taken from large blocks in order of
+ * allocation and released all at once by arenaFree. Used for the AST
+ * built by the XML parser, see xml_parser.h.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;  // the current block, linked to the previous ones
+    size_t blockSize;    // size of the next block to allocate
+    size_t used;         // number of bytes handed out, including padding
+    void* mapped;        // NULL or a file mapping released with the arena, see md_image.c
+    size_t mappedSize;   // size of the mapping
+} Arena;
+
+Arena* arenaNew();
+void* arenaAlloc(Arena* arena, size_t size);
+char* arenaStrdup(Arena* arena, const char* s);
+char* arenaStrndup(Arena* arena, const char* s, size_t n);
+void arenaFree(Arena* arena);
+
+#endif // ARENA_H
@@ -0,0 +1,387 @@
+/* -------------------------------------------------------------------------
+ * fmu_cache.c
+ * A persistent cache of extracted FMUs, shared by all simulator processes
+ * of a user. The cache holds the dlls that are loaded, so its root must be
+ * owned by the user and is accessible to the user only: otherwise anyone
+ * who could write an entry or index file could have their code loaded.
+ * The cache root contains
+ *   <key>/       one entry per FMU content, with the extracted files
+ *   index/<p>    "size inode mtime ctime key" of the .fmu file with path hash p
+ *   tmp.XXXXXX/  entries under construction
+ * The key is a FNV-1a hash of the content of the .fmu file and its size.
+ * Hashing is skipped if the index records the same size, inode, mtime and
+ * ctime, both with nanoseconds, for the file. Users can set back the mtime
+ * but not the ctime, so a changed file is always hashed again.
+ * New entries are built in a private directory and then published using
+ * rename(), which is atomic. Concurrent processes therefore either see a
+ * complete entry or none. When the cache exceeds its size limit,
+ * the least recently used entries are removed. Stage directories left
+ * behind by processes that died are removed when they are stale.
+ * All functions may be called from several threads at the same time.
+ * -------------------------------------------------------------------------*/
+
+#define _XOPEN_SOURCE 700 // nftw()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "fmu_cache.h"
+#include "log_buffer.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+#define HASH_BUFSIZE 65536
+#define KEY_SIZE 40
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+
+static char* cacheRoot = NULL;   // cache root ending with '/', NULL if disabled
+static pthread_once_t cacheRootOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t evictLock = PTHREAD_MUTEX_INITIALIZER; // serializes fmuCacheEvict
+
+static unsigned long long fnv1a(unsigned long long h, const unsigned char* p, size_t n) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static char* concat(const char* a, const char* b) {
+    char* s = (char*)malloc(strlen(a) + strlen(b) + 1);
+    if (s) sprintf(s, "%s%s", a, b);
+    return s;
+}
+
+// create directory path, including all missing parents
+static int makeDirs(const char* path) {
+    char* p;
+    char* dir = strdup(path);
+    if (!dir) return 0;
+    for (p = dir + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(dir, 0700);
+        *p = '/';
+    }
+    mkdir(dir, 0700);
+    free(dir);
+    return access(path, W_OK) == 0;
+}
+
+// true if the directory is owned by the user, removes the access of others
+static int isPrivate(const char* dir) {
+    struct stat st;
+    if (stat(dir, &st) || st.st_uid != geteuid()) return 0;
+    return !(st.st_mode & 077) || !chmod(dir, st.st_mode & 0700);
+}
+
+static void initCacheRoot() {
+    const char* dir;
+    char* root;
+    dir = getenv(FMU_CACHE_DIR_ENV);
+    if (dir) {
+        root = *dir ? concat(dir, "/") : NULL;
+    }
+    else if ((dir = getenv("XDG_CACHE_HOME")) && *dir) {
+        root = concat(dir, "/fmusim/");
+    }
+    else if ((dir = getenv("HOME")) && *dir) {
+        root = concat(dir, "/.cache/fmusim/");
+    }
+    else root = NULL;
+    if (root) {
+        char* index = concat(root, "index");
+        if (!index || !makeDirs(index)) {
+            logPrintf("warning: Could not create FMU cache %s\n", root);
+            free(root);
+            root = NULL;
+        }
+        else if (!isPrivate(root)) {
+            logPrintf("warning: FMU cache %s is not owned by the user, not used\n", root);
+            free(root);
+            root = NULL;
+        }
+        free(index);
+    }
+    cacheRoot = root;
+}
+
+// Returns NULL if the cache is disabled or cannot be created.
+// Otherwise the cache root directory, ending with '/'.
+const char* fmuCacheRoot() {
+    pthread_once(&cacheRootOnce, initCacheRoot);
+    return cacheRoot;
+}
+
+// hash of the content and size of the given file, 0 on error
+static unsigned long long hashFile(const char* path) {
+    unsigned char* buffer;
+    size_t n;
+    unsigned long long h = FNV_OFFSET;
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+    buffer = (unsigned char*)malloc(HASH_BUFSIZE);
+    if (!buffer) {
+        fclose(file);
+        return 0;
+    }
+    while ((n = fread(buffer, 1, HASH_BUFSIZE, file)) > 0)
+        h = fnv1a(h, buffer, n);
+    free(buffer);
+    fclose(file);
+    return h;
+}
+
+// Returns NULL to indicate failure.
+// Computes the cache key of the given .fmu file. The content is hashed only
+// if the stat of the file differs from the one recorded in the index for
+// this path.
+// The receiver must free the returned key.
+char* fmuCacheKey(const char* fmuPath) {
+    struct stat st;
+    char absPath[PATH_MAX];
+    char name[KEY_SIZE];
+    char key[KEY_SIZE];
+    char stamp[128];
+    char recorded[128];
+    char* indexPath;
+    char* tmpPath;
+    unsigned long long h;
+    FILE* file;
+    if (!fmuCacheRoot()) return NULL;
+    if (stat(fmuPath, &st) || !realpath(fmuPath, absPath)) return NULL;
+
+    // fast pre-check: same path and stat as recorded in the index
+    sprintf(stamp, "%ld %lu %ld.%09ld %ld.%09ld", (long)st.st_size, (unsigned long)st.st_ino,
+        (long)st.st_mtime, (long)st.st_mtim.tv_nsec, (long)st.st_ctime, (long)st.st_ctim.tv_nsec);
+    h = fnv1a(FNV_OFFSET, (const unsigned char*)absPath, strlen(absPath));
+    sprintf(name, "index/%016llx", h);
+    indexPath = concat(cacheRoot, name);
+    if (!indexPath) return NULL;
+    file = fopen(indexPath, "r");
+    if (file) {
+        int ok = fgets(recorded, sizeof(recorded), file)
+            && !strncmp(recorded, stamp, strlen(stamp)) && recorded[strlen(stamp)] == ' '
+            && sscanf(recorded + strlen(stamp), "%39s", key) == 1;
+        fclose(file);
+        if (ok) {
+            free(indexPath);
+            return strdup(key);
+        }
+    }
+
+    // hash the content and record the result in the index
+    h = hashFile(fmuPath);
+    if (!h) {
+        free(indexPath);
+        return NULL;
+    }
+    sprintf(key, "%016llx-%lx", h, (long)st.st_size);
+    tmpPath = concat(indexPath, ".XXXXXX");
+    if (tmpPath) {
+        int fd = mkstemp(tmpPath);
+        if (fd >= 0 && (file = fdopen(fd, "w"))) {
+            fprintf(file, "%s %s\n", stamp, key);
+            fclose(file);
+            if (rename(tmpPath, indexPath)) unlink(tmpPath);
+        }
+        free(tmpPath);
+    }
+    free(indexPath);
+    return strdup(key);
+}
+
+// Returns NULL if the cache has no entry for key.
+// Otherwise the path of the entry, ending with '/'. The entry is marked
+// as recently used. The receiver must free the returned path.
+char* fmuCacheFind(const char* key) {
+    char* path;
+    struct stat st;
+    if (!fmuCacheRoot()) return NULL;
+    path = (char*)malloc(strlen(cacheRoot) + strlen(key) + 2);
+    if (!path) return NULL;
+    sprintf(path, "%s%s", cacheRoot, key);
+    if (stat(path, &st) || !S_ISDIR(st.st_mode)) {
+        free(path);
+        return NULL;
+    }
+    utime(path, NULL); // mark as recently used
+    return strcat(path, "/");
+}
+
+// Returns NULL to indicate failure.
+// Creates a private directory to build a new entry, ending with '/'.
+char* fmuCacheStage() {
+    char* path;
+    if (!fmuCacheRoot()) return NULL;
+    path = concat(cacheRoot, "tmp.XXXXXX/");
+    if (!path) return NULL;
+    path[strlen(path) - 1] = '\0';
+    if (!mkdtemp(path)) {
+        free(path);
+        return NULL;
+    }
+    return strcat(path, "/");
+}
+
+// Returns NULL to indicate failure.
+// Publishes the completed stage directory as entry for key and
+// returns the path of the entry, ending with '/'. If another process
+// published the same entry first, the stage directory is discarded.
+// stagePath is released in any case.
+char* fmuCacheCommit(char* stagePath, const char* key) {
+    char* entry;
+    stagePath[strlen(stagePath) - 1] = '\0'; // remove trailing '/'
+    entry = (char*)malloc(strlen(cacheRoot) + strlen(key) + 2);
+    if (entry) {
+        sprintf(entry, "%s%s", cacheRoot, key);
+        if (rename(stagePath, entry) == 0) {
+            free(stagePath);
+            return strcat(entry, "/");
+        }
+        free(entry);
+    }
+    // lost the race against another process, or failed
+    removeTree(stagePath);
+    free(stagePath);
+    return fmuCacheFind(key);
+}
+
+static int removeFile(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    return remove(path);
+}
+
+// Returns 0 to indicate error
+// Remove the given file or directory including all its content
+int removeTree(const char* path) {
+    return nftw(path, removeFile, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+static unsigned long long treeSize; // used by addFileSize, protected by evictLock
+
+static int addFileSize(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    if (flag == FTW_F) treeSize += st->st_size;
+    return 0;
+}
+
+typedef struct {
+    char* name;
+    time_t used;
+    unsigned long long size;
+} CacheEntry;
+
+static int compareUsed(const void* a, const void* b) {
+    time_t ta = ((const CacheEntry*)a)->used;
+    time_t tb = ((const CacheEntry*)b)->used;
+    return ta < tb ? -1 : ta > tb;
+}
+
+// true if name has the format of a key, see fmuCacheKey
+static int isKey(const char* name) {
+    size_t n = strspn(name, "0123456789abcdef");
+    return n == 16 && name[n] == '-' && name[n + 1]
+        && strspn(name + n + 1, "0123456789abcdef") == strlen(name + n + 1);
+}
+
+// Remove the tmp.* directories not changed for FMU_CACHE_STALE_AGE sec.
+// These are stages and evicted entries left behind by processes that
+// died. Stages still in use by other processes are changed more recently.
+static void removeStaleStages(time_t now) {
+    DIR* dir;
+    struct dirent* d;
+    if (!(dir = opendir(cacheRoot))) return;
+    while ((d = readdir(dir))) {
+        struct stat st;
+        char* path;
+        if (strncmp(d->d_name, "tmp.", 4)) continue;
+        path = concat(cacheRoot, d->d_name);
+        if (!path) break;
+        if (!lstat(path, &st) && S_ISDIR(st.st_mode) && now - st.st_ctime > FMU_CACHE_STALE_AGE)
+            removeTree(path);
+        free(path);
+    }
+    closedir(dir);
+}
+
+// Remove least recently used entries until the cache is below its size
+// limit. Never removes keepKey and entries used in the last minute,
+// which may still be loaded by other processes.
+void fmuCacheEvict(const char* keepKey) {
+    DIR* dir;
+    struct dirent* d;
+    CacheEntry* entries = NULL;
+    int n = 0, size = 0, i;
+    unsigned long long total = 0, limit = FMU_CACHE_SIZE_DEFAULT;
+    const char* s = getenv(FMU_CACHE_SIZE_ENV);
+    time_t now = time(NULL);
+    if (s) sscanf(s, "%llu", &limit);
+    limit *= 1024 * 1024;
+    if (!fmuCacheRoot()) return;
+    pthread_mutex_lock(&evictLock);
+    removeStaleStages(now);
+    if (!(dir = opendir(cacheRoot))) {
+        pthread_mutex_unlock(&evictLock);
+        return;
+    }
+    while ((d = readdir(dir))) {
+        struct stat st;
+        char* path;
+        if (!isKey(d->d_name)) continue;
+        path = concat(cacheRoot, d->d_name);
+        if (!path) break;
+        if (!stat(path, &st) && S_ISDIR(st.st_mode)) {
+            if (n == size) {
+                CacheEntry* e;
+                size = size ? 2 * size : 16;
+                e = (CacheEntry*)realloc(entries, size * sizeof(CacheEntry));
+                if (!e) {
+                    free(path);
+                    break;
+                }
+                entries = e;
+            }
+            treeSize = 0;
+            nftw(path, addFileSize, 16, FTW_PHYS);
+            entries[n].name = strdup(d->d_name);
+            entries[n].used = st.st_mtime;
+            entries[n].size = treeSize;
+            total += treeSize;
+            n++;
+        }
+        free(path);
+    }
+    closedir(dir);
+    qsort(entries, n, sizeof(CacheEntry), compareUsed);
+    for (i = 0; i < n && total > limit; i++) {
+        char* path;
+        char* trash;
+        if (!entries[i].name || now - entries[i].used < FMU_CACHE_MIN_AGE) continue;
+        if (keepKey && !strcmp(entries[i].name, keepKey)) continue;
+        // hide the entry from other processes first, then delete it
+        path = concat(cacheRoot, entries[i].name);
+        trash = (char*)malloc(strlen(cacheRoot) + strlen("tmp.evicted.") + strlen(entries[i].name) + 1);
+        if (trash) sprintf(trash, "%stmp.evicted.%s", cacheRoot, entries[i].name);
+        if (path && trash && !rename(path, trash)) {
+            removeTree(trash);
+            total -= entries[i].size;
+        }
+        free(path);
+        free(trash);
+    }
+    for (i = 0; i < n; i++) free(entries[i].name);
+    free(entries);
+    pthread_mutex_unlock(&evictLock);
+}
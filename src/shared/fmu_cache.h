@@ -0,0 +1,26 @@
+/* -------------------------------------------------------------------------
+ * fmu_cache.h
+ * A persistent cache of extracted FMUs, shared by all simulator processes
+ * of a user.
+ * Entries are keyed by a hash of the content of the .fmu file.
+ * -------------------------------------------------------------------------*/
+
+#ifndef FMU_CACHE_H
+#define FMU_CACHE_H
+
+// Environment variables used to configure the cache
+#define FMU_CACHE_DIR_ENV  "FMUSIM_CACHE_DIR"  // cache root, empty to disable the cache
+#define FMU_CACHE_SIZE_ENV "FMUSIM_CACHE_SIZE" // size limit in MB
+#define FMU_CACHE_SIZE_DEFAULT 256             // default size limit in MB
+#define FMU_CACHE_MIN_AGE 60                   // never evict entries used in the last 60 sec
+#define FMU_CACHE_STALE_AGE 3600               // remove stages not changed in the last hour
+
+const char* fmuCacheRoot();
+char* fmuCacheKey(const char* fmuPath);
+char* fmuCacheFind(const char* key);
+char* fmuCacheStage();
+char* fmuCacheCommit(char* stagePath, const char* key);
+void fmuCacheEvict(const char* keepKey);
+int removeTree(const char* path);
+
+#endif // FMU_CACHE_H
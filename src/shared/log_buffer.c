@@ -0,0 +1,59 @@
+/* -------------------------------------------------------------------------
+ * log_buffer.c
+ * Messages printed while loading FMUs, see log_buffer.h
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "log_buffer.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static THREAD_LOCAL LogBuffer* capture = NULL; // NULL to print messages immediately
+
+// Print like printf, or append to the buffer of the calling thread
+void logPrintf(const char* format, ...) {
+    va_list args;
+    int n;
+    if (!capture) {
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+    va_start(args, format);
+    n = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (n < 0) return;
+    if (capture->length + n + 1 > capture->size) {
+        size_t size = 2 * (capture->length + n + 1);
+        char* text = (char*)realloc(capture->text, size);
+        if (!text) return; // drop the message
+        capture->text = text;
+        capture->size = size;
+    }
+    va_start(args, format);
+    vsnprintf(capture->text + capture->length, n + 1, format, args);
+    va_end(args);
+    capture->length += n;
+}
+
+// Capture all messages of the calling thread in buffer, NULL to stop capturing
+void logCapture(LogBuffer* buffer) {
+    capture = buffer;
+}
+
+// Print and release the captured messages
+void logFlush(LogBuffer* buffer) {
+    if (buffer->text) fputs(buffer->text, stdout);
+    free(buffer->text);
+    buffer->text = NULL;
+    buffer->length = 0;
+    buffer->size = 0;
+}
@@ -0,0 +1,23 @@
+/* -------------------------------------------------------------------------
+ * log_buffer.h
+ * Messages printed while loading FMUs. A thread can capture its messages
+ * in a buffer, which is printed later. This keeps the output of loaders
+ * running in parallel in a deterministic order.
+ * -------------------------------------------------------------------------*/
+
+#ifndef LOG_BUFFER_H
+#define LOG_BUFFER_H
+
+#include <stddef.h>
+
+typedef struct {
+    char* text;      // captured messages, NULL if empty
+    size_t length;   // length of text
+    size_t size;     // allocated size of text
+} LogBuffer;
+
+void logPrintf(const char* format, ...);
+void logCapture(LogBuffer* buffer);
+void logFlush(LogBuffer* buffer);
+
+#endif // LOG_BUFFER_H
@@ -0,0 +1,512 @@
+/* -------------------------------------------------------------------------
+ * md_image.c
+ * A binary image of a validated ModelDescription, see md_image.h
+ * The image consists of
+ *   ImageHeader
+ *   nodes        all AST nodes, the ScalarVariables as one flat array,
+ *                followed by the VariableIndex of the model description
+ *   strings      string table, holds each distinct string once
+ *   relocations  a bitmap with one bit per pointer sized word of the
+ *                nodes, set for pointer slots and attribute name slots
+ * In the file, a pointer slot holds the offset of its target in the
+ * image, 0 for NULL, and an attribute name slot holds the Att of the
+ * name, tagged with ATT_TAG. mapModelDescriptionImage maps the file
+ * privately and turns both into pointers. Nothing is parsed, and the
+ * string table is shared with the page cache. An image is only used by
+ * a simulator built with the same AST layout and name arrays, see
+ * imageLayout.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "md_image.h"
+
+#define IMAGE_MAGIC "FMUMDI\n"   // 8 bytes including the terminating '\0'
+#define IMAGE_VERSION 2
+#define IMAGE_ALIGN 16
+#define PTR_SIZE sizeof(void*)
+#define ATT_TAG ((size_t)1 << (8 * PTR_SIZE - 1))  // marks attribute name slots
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int layout;      // see imageLayout
+    unsigned int size;        // size of the image in bytes
+    unsigned int root;        // offset of the ModelDescription
+    unsigned int strings;     // offset of the string table
+    unsigned int relocs;      // offset of the relocation bitmap, bit i is for word i
+} ImageHeader;
+
+// a growing array of slot offsets
+typedef struct {
+    unsigned int* offsets;
+    int n;
+    int size;
+} Relocs;
+
+// a variable of the model description and the offset of its image
+typedef struct {
+    const ScalarVariable* sv;
+    size_t offset;
+} VariableRef;
+
+typedef struct {
+    char* nodes;              // the image under construction, starting with the header
+    size_t nodesSize;         // bytes used in nodes
+    size_t nodesCap;          // bytes allocated for nodes
+    char* strings;            // the string table under construction
+    size_t stringsSize;
+    size_t stringsCap;
+    unsigned int* stringSlots; // hash table of the offsets + 1 of the strings, 0 if empty
+    unsigned int stringMask;   // number of stringSlots - 1
+    int nStrings;
+    Relocs ptrRelocs;         // pointer slots with an offset into nodes
+    Relocs strRelocs;         // pointer slots with an offset into strings
+    Relocs attRelocs;         // attribute name slots
+    VariableRef* vars;        // the variables, sorted by sv
+    int nVars;
+    int failed;               // 1 if out of memory
+} ImageWriter;
+
+// Hash of everything an image depends on besides its content:
+// the size of pointers and AST nodes, and the element and attribute names.
+static unsigned int imageLayout() {
+    size_t sizes[8];
+    unsigned int h = 0;
+    int i;
+    sizes[0] = PTR_SIZE;
+    sizes[1] = sizeof(Element);
+    sizes[2] = sizeof(ListElement);
+    sizes[3] = sizeof(Type);
+    sizes[4] = sizeof(ScalarVariable);
+    sizes[5] = sizeof(CoSimulation);
+    sizes[6] = sizeof(ModelDescription);
+    sizes[7] = sizeof(VariableIndex);
+    for (i = 0; i < 8; i++) h = h * 31 + (unsigned int)sizes[i];
+    for (i = 0; i < SIZEOF_ELM; i++) h = h * 31 + hashName(elmNames[i], 0);
+    for (i = 0; i < SIZEOF_ATT; i++) h = h * 31 + hashName(attNames[i], 0);
+    return h;
+}
+
+// -------------------------------------------------------------------------
+// Writing an image
+
+static void pushReloc(ImageWriter* w, Relocs* r, size_t slot) {
+    if (r->n == r->size) {
+        int size = r->size ? 2 * r->size : 1024;
+        unsigned int* offsets = (unsigned int*)realloc(r->offsets, size * sizeof(unsigned int));
+        if (!offsets) {
+            w->failed = 1;
+            return;
+        }
+        r->offsets = offsets;
+        r->size = size;
+    }
+    r->offsets[r->n++] = (unsigned int)slot;
+}
+
+// Returns 0 to indicate failure
+// Otherwise the offset of size zeroed bytes in nodes, aligned to IMAGE_ALIGN
+static size_t reserve(ImageWriter* w, size_t size) {
+    size_t offset = (w->nodesSize + IMAGE_ALIGN - 1) & ~(size_t)(IMAGE_ALIGN - 1);
+    if (w->failed) return 0;
+    if (offset + size > w->nodesCap) {
+        size_t cap = 2 * (offset + size);
+        char* nodes = (char*)realloc(w->nodes, cap);
+        if (!nodes) {
+            w->failed = 1;
+            return 0;
+        }
+        memset(nodes + w->nodesCap, 0, cap - w->nodesCap);
+        w->nodes = nodes;
+        w->nodesCap = cap;
+    }
+    w->nodesSize = offset + size;
+    return offset;
+}
+
+// Let the pointer at offset slot of nodes refer to offset target of nodes
+static void setPtr(ImageWriter* w, size_t slot, size_t target) {
+    if (w->failed || !target) return;
+    *(size_t*)(w->nodes + slot) = target;
+    pushReloc(w, &w->ptrRelocs, slot);
+}
+
+// Returns the offset of s in the string table, adds s on first use
+static size_t addString(ImageWriter* w, const char* s) {
+    unsigned int h;
+    size_t n = strlen(s) + 1;
+    if (2 * (w->nStrings + 1) > (int)w->stringMask + 1) {
+        // grow and rehash the hash table
+        unsigned int i, size = w->stringMask ? 2 * (w->stringMask + 1) : 1024;
+        unsigned int* slots = (unsigned int*)calloc(size, sizeof(unsigned int));
+        if (!slots) {
+            w->failed = 1;
+            return 0;
+        }
+        for (i = 0; w->stringMask && i <= w->stringMask; i++) {
+            unsigned int offset = w->stringSlots[i];
+            if (!offset) continue;
+            for (h = hashName(w->strings + offset - 1, 0) & (size - 1); slots[h]; h = (h + 1) & (size - 1));
+            slots[h] = offset;
+        }
+        free(w->stringSlots);
+        w->stringSlots = slots;
+        w->stringMask = size - 1;
+    }
+    for (h = hashName(s, 0) & w->stringMask; w->stringSlots[h]; h = (h + 1) & w->stringMask) {
+        if (!strcmp(w->strings + w->stringSlots[h] - 1, s)) return w->stringSlots[h] - 1;
+    }
+    if (w->stringsSize + n > w->stringsCap) {
+        size_t cap = 2 * (w->stringsSize + n);
+        char* strings = (char*)realloc(w->strings, cap);
+        if (!strings) {
+            w->failed = 1;
+            return 0;
+        }
+        w->strings = strings;
+        w->stringsCap = cap;
+    }
+    memcpy(w->strings + w->stringsSize, s, n);
+    w->stringSlots[h] = (unsigned int)w->stringsSize + 1;
+    w->nStrings++;
+    w->stringsSize += n;
+    return w->stringsSize - n;
+}
+
+// Let the pointer at offset slot of nodes refer to a copy of s
+static void setString(ImageWriter* w, size_t slot, const char* s) {
+    size_t offset;
+    if (w->failed || !s) return;
+    offset = addString(w, s);
+    if (w->failed) return;
+    *(size_t*)(w->nodes + slot) = offset;
+    pushReloc(w, &w->strRelocs, slot);
+}
+
+// Copy the attributes of e into the node at offset node
+static void writeAttributes(ImageWriter* w, size_t node, const Element* e) {
+    size_t array;
+    int i;
+    if (w->failed) return;
+    ((Element*)(w->nodes + node))->type = e->type;
+    ((Element*)(w->nodes + node))->n = e->n;
+    ((Element*)(w->nodes + node))->attMask = e->attMask;
+    if (!e->n) return;
+    array = reserve(w, e->n * PTR_SIZE);
+    if (w->failed) return;
+    for (i = 0; i < e->n; i += 2) {
+        *(size_t*)(w->nodes + array + i * PTR_SIZE) = getAttIndex(e->attributes[i]) | ATT_TAG;
+        pushReloc(w, &w->attRelocs, array + i * PTR_SIZE);
+        setString(w, array + (i + 1) * PTR_SIZE, e->attributes[i+1]);
+    }
+    setPtr(w, node + offsetof(Element, attributes), array);
+}
+
+static size_t writeNode(ImageWriter* w, const void* element);
+
+// Returns 0 for NULL, otherwise the offset of a copy of the null-terminated list
+static size_t writeList(ImageWriter* w, void** list) {
+    size_t array;
+    int i, n;
+    if (!list) return 0;
+    for (n = 0; list[n]; n++);
+    array = reserve(w, (n + 1) * PTR_SIZE);
+    for (i = 0; i < n && !w->failed; i++) {
+        setPtr(w, array + i * PTR_SIZE, writeNode(w, list[i]));
+    }
+    return array;
+}
+
+static size_t nodeSize(const Element* e) {
+    switch (getAstNodeType(e->type)) {
+        case astListElement:    return sizeof(ListElement);
+        case astType:           return sizeof(Type);
+        case astScalarVariable: return sizeof(ScalarVariable);
+        case astCoSimulation:   return sizeof(CoSimulation);
+        default:                return sizeof(Element);
+    }
+}
+
+// Copy element e into the node at offset node, which has the size of e
+static void fillNode(ImageWriter* w, size_t node, const Element* e) {
+    writeAttributes(w, node, e);
+    switch (getAstNodeType(e->type)) {
+        case astListElement:
+            setPtr(w, node + offsetof(ListElement, list),
+                writeList(w, (void**)((ListElement*)e)->list));
+            break;
+        case astType:
+            setPtr(w, node + offsetof(Type, typeSpec), writeNode(w, ((Type*)e)->typeSpec));
+            break;
+        case astScalarVariable: {
+            const ScalarVariable* sv = (const ScalarVariable*)e;
+            if (!w->failed) ((ScalarVariable*)(w->nodes + node))->vr = sv->vr;
+            setPtr(w, node + offsetof(ScalarVariable, typeSpec), writeNode(w, sv->typeSpec));
+            setPtr(w, node + offsetof(ScalarVariable, directDependencies),
+                writeList(w, (void**)sv->directDependencies));
+            break;
+        }
+        case astCoSimulation:
+            setPtr(w, node + offsetof(CoSimulation, capabilities),
+                writeNode(w, ((CoSimulation*)e)->capabilities));
+            setPtr(w, node + offsetof(CoSimulation, model), writeNode(w, ((CoSimulation*)e)->model));
+            break;
+        default:
+            break;
+    }
+}
+
+// Returns 0 for NULL, otherwise the offset of a copy of element
+static size_t writeNode(ImageWriter* w, const void* element) {
+    size_t node;
+    if (!element) return 0;
+    node = reserve(w, nodeSize((const Element*)element));
+    if (!w->failed) fillNode(w, node, (const Element*)element);
+    return node;
+}
+
+static int compareVariableRefs(const void* a, const void* b) {
+    const ScalarVariable* sa = ((const VariableRef*)a)->sv;
+    const ScalarVariable* sb = ((const VariableRef*)b)->sv;
+    return sa < sb ? -1 : sa > sb;
+}
+
+// Returns the offset of the image of sv, 0 for NULL
+static size_t variableOffset(ImageWriter* w, const ScalarVariable* sv) {
+    VariableRef key;
+    VariableRef* ref;
+    if (!sv) return 0;
+    key.sv = sv;
+    ref = (VariableRef*)bsearch(&key, w->vars, w->nVars, sizeof(VariableRef), compareVariableRefs);
+    return ref ? ref->offset : 0;
+}
+
+// Write the variables as one flat array, followed by the list modelVariables
+static size_t writeVariables(ImageWriter* w, ScalarVariable** vars) {
+    size_t flat, list;
+    int i;
+    if (!vars) return 0;
+    for (w->nVars = 0; vars[w->nVars]; w->nVars++);
+    w->vars = (VariableRef*)malloc((w->nVars + 1) * sizeof(VariableRef));
+    if (!w->vars) {
+        w->failed = 1;
+        return 0;
+    }
+    flat = reserve(w, w->nVars * sizeof(ScalarVariable));
+    for (i = 0; i < w->nVars && !w->failed; i++) {
+        w->vars[i].sv = vars[i];
+        w->vars[i].offset = flat + i * sizeof(ScalarVariable);
+        fillNode(w, w->vars[i].offset, (Element*)vars[i]);
+    }
+    list = reserve(w, (w->nVars + 1) * PTR_SIZE);
+    for (i = 0; i < w->nVars && !w->failed; i++) {
+        setPtr(w, list + i * PTR_SIZE, w->vars[i].offset);
+    }
+    qsort(w->vars, w->nVars, sizeof(VariableRef), compareVariableRefs);
+    return list;
+}
+
+static void writeVariableTable(ImageWriter* w, size_t table, const VariableTable* t) {
+    size_t slots = reserve(w, (t->mask + 1) * PTR_SIZE);
+    unsigned int i;
+    if (w->failed) return;
+    ((VariableTable*)(w->nodes + table))->mask = t->mask;
+    for (i = 0; i <= t->mask; i++) {
+        setPtr(w, slots + i * PTR_SIZE, variableOffset(w, t->slots[i]));
+    }
+    setPtr(w, table + offsetof(VariableTable, slots), slots);
+}
+
+static size_t writeIndex(ImageWriter* w, const VariableIndex* index) {
+    size_t node;
+    int b;
+    if (!index) return 0;
+    node = reserve(w, sizeof(VariableIndex));
+    if (w->failed) return 0;
+    writeVariableTable(w, node + offsetof(VariableIndex, byName), &index->byName);
+    for (b = 0; b < 4; b++) {
+        writeVariableTable(w, node + offsetof(VariableIndex, byVr) + b * sizeof(VariableTable),
+            &index->byVr[b]);
+    }
+    return node;
+}
+
+// Returns 0 to indicate failure
+static int writeAll(int fd, const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t k = write(fd, data, n);
+        if (k <= 0) return 0;
+        data += k;
+        n -= k;
+    }
+    return 1;
+}
+
+// Returns 0 to indicate failure
+// Writes the image of the validated md to path. The file is replaced
+// atomically, concurrent readers see either the old or the new image.
+int writeModelDescriptionImage(ModelDescription* md, const char* path) {
+    ImageWriter w;
+    ImageHeader* header;
+    size_t root, strings, relocs, size;
+    unsigned int* bitmap;
+    char* tmpPath;
+    int i, fd, ok = 0;
+
+    memset(&w, 0, sizeof(w));
+    reserve(&w, sizeof(ImageHeader));
+    root = reserve(&w, sizeof(ModelDescription));
+    if (w.failed) return 0;
+    writeAttributes(&w, root, (Element*)md);
+    setPtr(&w, root + offsetof(ModelDescription, unitDefinitions),
+        writeList(&w, (void**)md->unitDefinitions));
+    setPtr(&w, root + offsetof(ModelDescription, typeDefinitions),
+        writeList(&w, (void**)md->typeDefinitions));
+    setPtr(&w, root + offsetof(ModelDescription, defaultExperiment), writeNode(&w, md->defaultExperiment));
+    setPtr(&w, root + offsetof(ModelDescription, vendorAnnotations),
+        writeList(&w, (void**)md->vendorAnnotations));
+    setPtr(&w, root + offsetof(ModelDescription, modelVariables), writeVariables(&w, md->modelVariables));
+    setPtr(&w, root + offsetof(ModelDescription, cosimulation), writeNode(&w, md->cosimulation));
+    setPtr(&w, root + offsetof(ModelDescription, index), writeIndex(&w, md->index));
+
+    // append the string table and the relocation bitmap
+    strings = reserve(&w, w.stringsSize);
+    relocs = reserve(&w, (strings / PTR_SIZE + 31) / 32 * sizeof(unsigned int));
+    size = w.nodesSize;
+    if (w.failed || size > UINT_MAX) goto done;
+    memcpy(w.nodes + strings, w.strings, w.stringsSize);
+    bitmap = (unsigned int*)(w.nodes + relocs);
+    for (i = 0; i < w.strRelocs.n; i++) {
+        unsigned int slot = w.strRelocs.offsets[i] / PTR_SIZE;
+        *(size_t*)(w.nodes + w.strRelocs.offsets[i]) += strings;
+        bitmap[slot / 32] |= 1u << slot % 32;
+    }
+    for (i = 0; i < w.ptrRelocs.n; i++) {
+        unsigned int slot = w.ptrRelocs.offsets[i] / PTR_SIZE;
+        bitmap[slot / 32] |= 1u << slot % 32;
+    }
+    for (i = 0; i < w.attRelocs.n; i++) {
+        unsigned int slot = w.attRelocs.offsets[i] / PTR_SIZE;
+        bitmap[slot / 32] |= 1u << slot % 32;
+    }
+    header = (ImageHeader*)w.nodes;
+    memcpy(header->magic, IMAGE_MAGIC, sizeof(header->magic));
+    header->version = IMAGE_VERSION;
+    header->layout = imageLayout();
+    header->size = (unsigned int)size;
+    header->root = (unsigned int)root;
+    header->strings = (unsigned int)strings;
+    header->relocs = (unsigned int)relocs;
+
+    // write a private file and publish it using rename(), which is atomic
+    tmpPath = (char*)malloc(strlen(path) + 8);
+    if (!tmpPath) goto done;
+    sprintf(tmpPath, "%s.XXXXXX", path);
+    fd = mkstemp(tmpPath);
+    if (fd >= 0) {
+        ok = fchmod(fd, 0644) == 0 && writeAll(fd, w.nodes, size);
+        ok = close(fd) == 0 && ok;
+        ok = ok && rename(tmpPath, path) == 0;
+        if (!ok) unlink(tmpPath);
+    }
+    free(tmpPath);
+
+done:
+    free(w.nodes);
+    free(w.strings);
+    free(w.stringSlots);
+    free(w.ptrRelocs.offsets);
+    free(w.strRelocs.offsets);
+    free(w.attRelocs.offsets);
+    free(w.vars);
+    return ok;
+}
+
+// -------------------------------------------------------------------------
+// Mapping an image
+
+// index of the lowest set bit of bits, which is not 0
+static int lowestBit(unsigned int bits) {
+#ifdef __GNUC__
+    return __builtin_ctz(bits);
+#else
+    int k = 0;
+    for (; !(bits & 1); bits >>= 1) k++;
+    return k;
+#endif
+}
+
+// Returns NULL if there is no usable image at path, e.g. none was written
+// yet or it was written by a simulator with a different AST layout.
+// Otherwise the root node md of the mapped AST.
+// The receiver must call freeElement(md) to release the mapping.
+ModelDescription* mapModelDescriptionImage(const char* path) {
+    struct stat st;
+    ImageHeader* header;
+    unsigned int* bitmap;
+    char* base;
+    Arena* arena;
+    ModelDescription* md;
+    size_t size, nWords, bad = 0;
+    unsigned int i;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(ImageHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size = (size_t)st.st_size;
+    base = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    // check the header, the relocations are checked below
+    header = (ImageHeader*)base;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic))
+            || header->version != IMAGE_VERSION
+            || header->layout != imageLayout()
+            || header->size != size
+            || header->root + sizeof(ModelDescription) > header->strings
+            || header->strings > header->relocs
+            || header->strings % PTR_SIZE
+            || header->relocs % sizeof(unsigned int)
+            || (size - header->relocs) / sizeof(unsigned int) < (header->strings / PTR_SIZE + 31) / 32) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    // turn offsets into pointers, the bitmap covers the nodes only
+    bitmap = (unsigned int*)(base + header->relocs);
+    nWords = header->strings / PTR_SIZE;
+    for (i = 0; i < (nWords + 31) / 32 && !bad; i++) {
+        unsigned int bits = bitmap[i];
+        while (bits) {
+            size_t* slot = (size_t*)base + 32 * (size_t)i + lowestBit(bits);
+            bits &= bits - 1;
+            if (*slot & ATT_TAG) {
+                if ((*slot & ~ATT_TAG) >= SIZEOF_ATT) bad = 1;
+                else *(const char**)slot = attNames[*slot & ~ATT_TAG];
+            }
+            else if (*slot == 0 || *slot >= header->relocs) bad = 1;
+            else *(char**)slot = base + *slot;
+        }
+        if (32 * (size_t)i + 32 > nWords && bitmap[i] >> nWords % 32) bad = 1;
+    }
+    arena = bad ? NULL : arenaNew();
+    if (!arena) {
+        munmap(base, size);
+        return NULL;
+    }
+    arena->mapped = base;
+    arena->mappedSize = size;
+    md = (ModelDescription*)(base + header->root);
+    md->arena = arena;
+    return md;
+}
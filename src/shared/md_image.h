@@ -0,0 +1,20 @@
+/* -------------------------------------------------------------------------
+ * md_image.h
+ * A binary image of a validated ModelDescription. The image is written
+ * next to the extracted FMU in the FMU cache, later runs map it into
+ * memory instead of parsing modelDescription.xml again. The mapped AST
+ * is used through the usual accessors, e.g. getName or getValueReference,
+ * and released with freeElement.
+ * -------------------------------------------------------------------------*/
+
+#ifndef MD_IMAGE_H
+#define MD_IMAGE_H
+
+#include "xml_parser.h"
+
+#define MD_IMAGE_FILE "modelDescription.bin"
+
+int writeModelDescriptionImage(ModelDescription* md, const char* path);
+ModelDescription* mapModelDescriptionImage(const char* path);
+
+#endif // MD_IMAGE_H
@@ -6,6 +6,9 @@
  * Copyright 2011 QTronic GmbH. All rights reserved. 
  * -------------------------------------------------------------------------*/ 
 
+#ifndef _MSC_VER
+#define _GNU_SOURCE  // dlmopen()
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,11 +22,17 @@
 #endif
 
 #include "sim_support.h"
+#include "log_buffer.h"
+#include "timings.h"
 
 #ifndef _MSC_VER
 #define MAX_PATH 1024
 #include <unistd.h>  // mkdtemp()
 #include <dlfcn.h> //dlsym()
+#include <sys/mman.h> // memfd_create()
+#include "zip_reader.h"
+#include "fmu_cache.h"
+#include "md_image.h"
 #endif
 
 #if WINDOWS
@@ -60,7 +69,6 @@ int unzip(const char *zipPath, const char *outPath) {
     // run the unzip command
     // remove "> NUL" to see the unzip protocol
     sprintf(cmd, "%s%s \"%s\" > NUL", UNZIP_CMD_WIN, outPath, zipPath); 
-    // printf("cmd='%s'\n", cmd);
     code = system(cmd);
     free(cmd);
     if (code!=SEVEN_ZIP_NO_ERROR) {
@@ -82,41 +90,43 @@ int unzip(const char *zipPath, const char *outPath) {
 }
 #else /* WINDOWS */
 
-int unzip(const char *zipPath, const char *outPath) {
-    int code;
-    char cwd[BUFSIZE];
-    int n;
-    char* cmd;
+// true if name is a file in one of the binaries directories of this platform
+static int isPlatformBinary(const char* name) {
+    if (!strncmp(name, "./", 2)) name += 2;
+    return (!strncmp(name, DLL_DIR, strlen(DLL_DIR)) || !strncmp(name, DLL_DIR2, strlen(DLL_DIR2)))
+        && name[strlen(name) - 1] != '/';
+}
 
-    // remember current directory
-    if (!getcwd(cwd, BUFSIZE)) {
-      printf ("error: Could not get current directory\n");
-      return 0; // error
+// Extract only modelDescription.xml and the binaries for this platform.
+// All other files of the FMU, e.g. sources and documentation, are skipped.
+int unzip(const char *zipPath, const char *outPath) {
+    int i;
+    int nFiles = 0;           // number of files extracted from the FMU
+    unsigned long nBytes = 0; // number of bytes extracted from the FMU
+    ZipEntry* entry;
+    ZipEntry* xmlEntry;
+    ZipArchive* zip = zipOpen(zipPath);
+    if (!zip) return 0; // error
+    xmlEntry = zipFindEntry(zip, XML_FILE);
+    if (!xmlEntry) {
+        logPrintf("error: No %s found in %s\n", XML_FILE, zipPath);
+        zipClose(zip);
+        return 0; // error
     }
-        
-    // run the unzip command
-    n = strlen(UNZIP_CMD) + 1 + strlen(outPath) + 4 +  strlen(zipPath) + 16;
-    cmd = (char*)calloc(sizeof(char), n);
-    sprintf(cmd, "%s %s -d \"%s\" > /dev/null", UNZIP_CMD, zipPath, outPath); 
-    printf("cmd='%s'\n", cmd);
-    code = system(cmd);
-    free(cmd);
-    if (code!=SEVEN_ZIP_NO_ERROR) {
-        switch (code) {
-            printf("7z: ");
-            case SEVEN_ZIP_WARNING:            printf("warning\n"); break;
-            case SEVEN_ZIP_ERROR:              printf("error\n"); break;
-            case SEVEN_ZIP_COMMAND_LINE_ERROR: printf("command line error\n"); break;
-            case SEVEN_ZIP_OUT_OF_MEMORY:      printf("out of memory\n"); break;
-            case SEVEN_ZIP_STOPPED_BY_USER:    printf("stopped by user\n"); break;
-            default: printf("unknown problem\n");
+    for (i=0; i<zip->nEntries; i++) {
+        entry = &zip->entries[i];
+        if (entry != xmlEntry && !isPlatformBinary(entry->name)) continue;
+        if (!zipExtractEntry(zip, entry, outPath)) {
+            zipClose(zip);
+            return 0; // error
         }
+        nFiles++;
+        nBytes += entry->size;
     }
-    
-    // restore current directory
-    chdir(cwd);
-    
-    return (code==SEVEN_ZIP_NO_ERROR || code==SEVEN_ZIP_WARNING) ? 1 : 0;  
+    logPrintf("  unzip ........... %d of %d files, %lu bytes\n", 
+            nFiles, zip->nEntries, nBytes);
+    zipClose(zip);
+    return 1; // success
 }
 #endif /* WINDOWS */
 
@@ -157,8 +167,8 @@ static char* getTmpPath() {
   //char *tmp = mkdtemp(strdup("fmuTmpXXXXXX"));
   char *tmp = mkdtemp(template);
   if (tmp==NULL) {
-    fprintf(stderr, "Couldn't create temporary directory\n");
-    exit(1);
+    logPrintf("error: Couldn't create temporary directory\n");
+    return NULL;
   }
   char * results = calloc(sizeof(char), strlen(tmp) + 2);
   strncat(results, tmp, strlen(tmp));
@@ -176,41 +186,119 @@ static void* getAdr(int* s, FMU *fmu, const char* functionName){
     fp = dlsym(fmu->dllHandle, name);
 #endif
     if (!fp) {
-        printf ("warning: Function %s not found in %s\n", name, DLL_SUFFIX);
+        logPrintf ("warning: Function %s not found in %s\n", name, DLL_SUFFIX);
 #ifdef __APPLE__
-        printf ("Error was: %s\n", dlerror());
+        logPrintf ("Error was: %s\n", dlerror());
 #endif 
-        printf ("If some symbols are found, but not others, check LD_LIBRARY_PATH or DYLD_LIBRARYPATH\n");
+        logPrintf ("If some symbols are found, but not others, check LD_LIBRARY_PATH or DYLD_LIBRARYPATH\n");
         *s = 0; // mark dll load as 'failed'        
     }
     return fp;
 }
 
+#ifndef _MSC_VER
+// Returns 0 to indicate failure
+static int writeAll(int fd, const void* data, size_t n) {
+    const char* p = (const char*)data;
+    while (n > 0) {
+        ssize_t k = write(fd, p, n);
+        if (k <= 0) return 0; // failure
+        p += k;
+        n -= k;
+    }
+    return 1; // success
+}
+
+// Returns NULL to indicate failure
+// Load a private copy of the given dll. The copy is a different file,
+// so the dynamic loader maps it again instead of reusing the handle
+// of the original. If supported, the copy is an in-memory file that
+// must stay open while loaded, to keep its /proc path unique. It is
+// returned in *fd. Otherwise the copy is a temporary file, removed
+// when loaded, and *fd is not changed.
+static HANDLE openPrivateCopy(const char* dllPath, int* fd) {
+    char path[BUFSIZE];
+    char buffer[BUFSIZE];
+    size_t n;
+    int ok = 1;
+    HANDLE h = NULL;
+    FILE* in;
+    int out;
+#ifdef MFD_CLOEXEC
+    out = memfd_create("fmu", MFD_CLOEXEC);
+    sprintf(path, MEMFD_PATH, out);
+#else
+    const char* dir = getenv("TMPDIR");
+    sprintf(path, "%.*s/fmusimXXXXXX", BUFSIZE - 20, dir && *dir ? dir : "/tmp");
+    out = mkstemp(path);
+#endif
+    if (out < 0) return NULL;
+    in = fopen(dllPath, "rb");
+    if (!in) ok = 0;
+    while (ok && (n = fread(buffer, 1, BUFSIZE, in)) > 0) {
+        ok = writeAll(out, buffer, n);
+    }
+    if (in) fclose(in);
+    if (ok) h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#ifdef MFD_CLOEXEC
+    if (h) *fd = out;
+    else close(out);
+#else
+    close(out);
+    unlink(path);
+#endif
+    return h;
+}
+#endif
+
+// Returns NULL to indicate failure
+// Open the given dll. If isolate is 1, the dll gets its own copy of all
+// global variables, even if it is already loaded by this process: it is
+// loaded into a new link-map namespace, or as a private copy when the
+// namespaces of the dynamic loader are used up, see openPrivateCopy.
+static HANDLE openDll(const char* dllPath, int isolate, int* fd) {
+#ifdef _MSC_VER
+    if (isolate) {
+        logPrintf("error: Isolated instances are not supported on this platform\n");
+        return NULL;
+    }
+    return LoadLibrary(dllPath);
+#else
+    HANDLE h;
+    if (!isolate) return dlopen(dllPath, RTLD_LAZY);
+#ifdef LM_ID_NEWLM
+    h = dlmopen(LM_ID_NEWLM, dllPath, RTLD_NOW | RTLD_LOCAL);
+    if (h) return h;
+#endif
+    return openPrivateCopy(dllPath, fd);
+#endif
+}
+
 // Load the given dll and set function pointers in fmu
 // Return 0 to indicate failure
-static int loadDll(const char* dllPath, FMU *fmu) {
+static int loadDll(const char* dllPath, FMU *fmu, int isolate) {
     int s = 1;
 #ifdef FMI_COSIMULATION
     int x = 1;
 #endif
-#ifdef _MSC_VER
-    HANDLE h = LoadLibrary(dllPath);
-#else
-    printf("dllPath = %s\n", dllPath);
-    HANDLE h = dlopen(dllPath, RTLD_LAZY);
-#endif
+    HANDLE h;
+    double start = monotonicTime();
+    h = openDll(dllPath, isolate, &fmu->dllFd);
+    timingsAdd(phase_dlopen, start);
     if (!h) {
-        printf("error: Could not load %s\n", dllPath);
+        logPrintf("error: Could not load %s\n", dllPath);
         return 0; // failure
     }
     fmu->dllHandle = h;
 
+    start = monotonicTime();
+
 #ifdef FMI_COSIMULATION   
     fmu->getTypesPlatform        = (fGetTypesPlatform)   getAdr(&s, fmu, "fmiGetTypesPlatform");
     if (s==0) { 
         s = 1; // work around bug for FMUs exported using Dymola 2012 and SimulationX 3.x
         fmu->getTypesPlatform    = (fGetTypesPlatform)   getAdr(&s, fmu, "fmiGetModelTypesPlatform");
-        if (s==1) printf("  using fmiGetModelTypesPlatform instead\n");
+        if (s==1) logPrintf("  using fmiGetModelTypesPlatform instead\n");
     }
     fmu->instantiateSlave        = (fInstantiateSlave)   getAdr(&s, fmu, "fmiInstantiateSlave");
     fmu->initializeSlave         = (fInitializeSlave)    getAdr(&s, fmu, "fmiInitializeSlave");    
@@ -254,64 +342,308 @@ static int loadDll(const char* dllPath, FMU *fmu) {
     fmu->getInteger              = (fGetInteger)         getAdr(&s, fmu, "fmiGetInteger");
     fmu->getBoolean              = (fGetBoolean)         getAdr(&s, fmu, "fmiGetBoolean");
     fmu->getString               = (fGetString)          getAdr(&s, fmu, "fmiGetString");
+    timingsAdd(phase_getAdr, start);
     return s; 
 }
 
-static void printModelDescription(ModelDescription* md){
+// Returns 0 to indicate failure
+static int printModelDescription(ModelDescription* md){
     Element* e = (Element*)md;  
     int i;
-    printf("%s\n", elmNames[e->type]);
+    logPrintf("%s\n", elmNames[e->type]);
     for (i=0; i<e->n; i+=2) 
-        printf("  %s=%s\n", e->attributes[i], e->attributes[i+1]);
+        logPrintf("  %s=%s\n", e->attributes[i], e->attributes[i+1]);
 #ifdef FMI_COSIMULATION   
     if (!md->cosimulation) {
-        printf("error: No Implementation element found in model description. This FMU is not for Co-Simulation.\n");
-        exit(EXIT_FAILURE);
+        logPrintf("error: No Implementation element found in model description. This FMU is not for Co-Simulation.\n");
+        return 0; // failure
     }
     e = md->cosimulation->capabilities;
-    printf("%s\n", elmNames[e->type]);
+    logPrintf("%s\n", elmNames[e->type]);
     for (i=0; i<e->n; i+=2) 
-        printf("  %s=%s\n", e->attributes[i], e->attributes[i+1]);
+        logPrintf("  %s=%s\n", e->attributes[i], e->attributes[i+1]);
 #endif // FMI_COSIMULATION  
+    return 1; // success
 }
 
-void loadFMU(FMU* fmu, const char* fmuFileName) {
+static char* getDllPath(const char* tmpPath, const char* dllDir, const char* modelId, const char* dllSuffix) {
+    char* dllPath = calloc(sizeof(char), strlen(tmpPath) + strlen(dllDir) 
+            + strlen(modelId) + strlen(dllSuffix) + 1);
+    if (dllPath) sprintf(dllPath, "%s%s%s%s", tmpPath, dllDir, modelId, dllSuffix);
+    return dllPath;
+}
+
+// Returns NULL to indicate failure
+// Parse only the variables with the given names, see parserContextSelect.
+// Parses text of size n if not NULL, otherwise the file path.
+static ModelDescription* parseSelected(const char* path, const char* text, size_t n, const char** names) {
+    ModelDescription* md = NULL;
+    double start = monotonicTime();
+    int nKept;
+    ParserContext* ctx = parserContextNew();
+    if (!ctx) return NULL; // failure
+    if (parserContextSelect(ctx, names)) {
+        md = text ? parseBufferWithContext(ctx, text, n, path) : parseWithContext(ctx, path);
+    }
+    if (md) {
+        for (nKept=0; md->modelVariables && md->modelVariables[nKept]; nKept++);
+        logPrintf("  parse ........... %d of %d variables, %lu bytes in %.3f ms\n",
+            nKept, nKept + parserContextSkipped(ctx), (unsigned long)md->arena->used,
+            1000 * (monotonicTime() - start));
+    }
+    parserContextFree(ctx);
+    return md;
+}
+
+#ifdef MFD_CLOEXEC
+// Returns 0 to indicate failure
+// Load the given FMU without writing to disk. The model description is
+// parsed from memory and the dll is inflated into an in-memory file,
+// which is loaded through its /proc/self/fd path.
+static int loadFMUInMemory(FMU* fmu, const char* fmuPath, const char** names) {
+    char path[BUFSIZE];
+    char* name;
+    char* data;
+    const char* modelId;
+    ZipEntry* entry;
+    int fd, ok;
+    double start = monotonicTime();
+    ZipArchive* zip = zipOpen(fmuPath);
+    if (!zip) return 0; // failure
+
+    // parse modelDescription.xml, parseBuffer measures its own phases
+    entry = zipFindEntry(zip, XML_FILE);
+    if (!entry) {
+        logPrintf("error: No %s found in %s\n", XML_FILE, fmuPath);
+        zipClose(zip);
+        return 0; // failure
+    }
+    data = (char*)zipReadEntry(zip, entry);
+    timingsAdd(phase_unzip, start);
+    if (data && names) fmu->modelDescription = parseSelected(fmuPath, data, entry->size, names);
+    else if (data) fmu->modelDescription = parseBuffer(data, entry->size, fmuPath);
+    free(data);
+    if (!fmu->modelDescription || !printModelDescription(fmu->modelDescription)) {
+        zipClose(zip);
+        return 0; // failure
+    }
+    modelId = getModelIdentifier(fmu->modelDescription);
+
+    // inflate the dll into an in-memory file
+    name = getDllPath("", DLL_DIR, modelId, DLL_SUFFIX);
+    entry = name ? zipFindEntry(zip, name) : NULL;
+    if (!entry) {
+        free(name);
+        name = getDllPath("", DLL_DIR2, modelId, DLL_SUFFIX2);
+        entry = name ? zipFindEntry(zip, name) : NULL;
+    }
+    if (!entry) {
+        logPrintf("error: No %s found in %s\n", name ? name : modelId, fmuPath);
+        free(name);
+        zipClose(zip);
+        return 0; // failure
+    }
+    free(name);
+    start = monotonicTime();
+    data = (char*)zipReadEntry(zip, entry);
+    fd = data ? memfd_create(modelId, MFD_CLOEXEC) : -1;
+    ok = fd >= 0 && writeAll(fd, data, entry->size);
+    free(data);
+    if (!ok) {
+        logPrintf("error: Could not write %s into memory\n", entry->name);
+        if (fd >= 0) close(fd);
+        zipClose(zip);
+        return 0; // failure
+    }
+    timingsAdd(phase_unzip, start);
+    logPrintf("  unzip ........... %lu bytes into memory\n", entry->size);
+    zipClose(zip);
+
+    // the file stays open until unloadFMU, isolated instances load it again
+    sprintf(path, MEMFD_PATH, fd);
+    fmu->dllPath = strdup(path);
+    if (!fmu->dllPath || !loadDll(fmu->dllPath, fmu, 0)) {
+        close(fd);
+        return 0; // failure
+    }
+    fmu->dllFd = fd;
+    return 1; // success
+}
+#endif
+
+// Returns NULL to indicate failure
+// Parse dir\modelDescription.xml, parse measures its own phases.
+// names is NULL to keep all variables, see parseSelected.
+static ModelDescription* parseModelDescription(const char* dir, const char** names) {
+    ModelDescription* md;
+    char* xmlPath = calloc(sizeof(char), strlen(dir) + strlen(XML_FILE) + 1);
+    if (!xmlPath) return NULL;
+    sprintf(xmlPath, "%s%s", dir, XML_FILE);
+    md = names ? parseSelected(xmlPath, NULL, 0, names) : parse(xmlPath);
+    free(xmlPath);
+    return md;
+}
+
+// Returns 0 to indicate failure
+// Unzip the given FMU, parse its model description and load its dll.
+// names is NULL to parse all variables, otherwise the null-terminated list
+// of the variables to keep, see parserContextSelect.
+// Messages are printed using logPrintf, so the caller may capture them.
+// Can be called from several threads at the same time for different FMUs.
+int tryLoadFMU(FMU* fmu, const char* fmuFileName, const char** names) {
     char* fmuPath;
-    char* tmpPath;
-    char* xmlPath;
+    char* tmpPath = NULL;
     char* dllPath;
+    const char* modelId;
+    int ok = 0;
+    double start;
+#if !WINDOWS
+    char* key;
+    int isTmp = 0;  // 1 if tmpPath is a private directory, to be removed after loading
+#endif
     
     // get absolute path to FMU, NULL if not found
+    fmu->dllFd = -1;
     fmuPath = getFmuPath(fmuFileName);
-    if (!fmuPath) exit(EXIT_FAILURE);
+    if (!fmuPath) return 0; // failure
 
+#ifdef MFD_CLOEXEC
+    if (simOptions.memfd) {
+        ok = loadFMUInMemory(fmu, fmuPath, names);
+        free(fmuPath);
+        return ok;
+    }
+#endif
+
+    start = monotonicTime();
+#if WINDOWS
     // unzip the FMU to the tmpPath directory
     tmpPath = getTmpPath();
-    if (!unzip(fmuPath, tmpPath)) exit(EXIT_FAILURE);
+    if (!tmpPath || !unzip(fmuPath, tmpPath)) goto done;
+#else
+    // reuse the FMU extracted by an earlier run, if found in the cache
+    key = fmuCacheKey(fmuPath);
+    if (key) tmpPath = fmuCacheFind(key);
+    if (tmpPath) {
+        logPrintf("  unzip ........... cached in %s\n", tmpPath);
+    }
+    else {
+        // unzip the FMU and publish it in the cache, or use a private directory
+        tmpPath = key ? fmuCacheStage() : NULL;
+        if (!tmpPath) {
+            tmpPath = getTmpPath();
+            isTmp = 1;
+        }
+        if (!tmpPath || !unzip(fmuPath, tmpPath)) {
+            if (tmpPath && !isTmp) removeTree(tmpPath); // a partly extracted cache entry
+            free(key);
+            goto done;
+        }
+        if (!isTmp) {
+            tmpPath = fmuCacheCommit(tmpPath, key);
+            if (!tmpPath) {
+                logPrintf("error: Could not add %s to the FMU cache\n", fmuPath);
+                free(key);
+                goto done;
+            }
+            fmuCacheEvict(key);
+        }
+    }
+    free(key);
+#endif
+    timingsAdd(phase_unzip, start);
 
-    // parse tmpPath\modelDescription.xml
-    xmlPath = calloc(sizeof(char), strlen(tmpPath) + strlen(XML_FILE) + 1);
-    sprintf(xmlPath, "%s%s", tmpPath, XML_FILE);
-    fmu->modelDescription = parse(xmlPath);
-    free(xmlPath);
-    if (!fmu->modelDescription) exit(EXIT_FAILURE);
-    printModelDescription(fmu->modelDescription);
+#if !WINDOWS
+    // map the image of the model description written by an earlier run
+    if (!isTmp) {
+        char* imagePath = calloc(sizeof(char), strlen(tmpPath) + strlen(MD_IMAGE_FILE) + 1);
+        if (imagePath) {
+            start = monotonicTime();
+            sprintf(imagePath, "%s%s", tmpPath, MD_IMAGE_FILE);
+            fmu->modelDescription = mapModelDescriptionImage(imagePath);
+            timingsAdd(phase_parse, start);
+            if (!fmu->modelDescription) {
+                // the image holds all variables, so only a full parse writes it
+                fmu->modelDescription = parseModelDescription(tmpPath, names);
+                if (fmu->modelDescription && !names) writeModelDescriptionImage(fmu->modelDescription, imagePath);
+            }
+            free(imagePath);
+        }
+    }
+    else
+#endif
+    fmu->modelDescription = parseModelDescription(tmpPath, names);
+    if (!fmu->modelDescription) goto done;
+    if (!printModelDescription(fmu->modelDescription)) goto done;
+    modelId = getModelIdentifier(fmu->modelDescription);
 
     // load the FMU dll
-    dllPath = calloc(sizeof(char), strlen(tmpPath) + strlen(DLL_DIR) 
-            + strlen( getModelIdentifier(fmu->modelDescription)) +  strlen(DLL_SUFFIX) + 1);
-    sprintf(dllPath,"%s%s%s%s", tmpPath, DLL_DIR, getModelIdentifier(fmu->modelDescription), DLL_SUFFIX);
-    if (!loadDll(dllPath, fmu)) {
+    dllPath = getDllPath(tmpPath, DLL_DIR, modelId, DLL_SUFFIX);
+    ok = loadDll(dllPath, fmu, 0);
+    if (!ok) {
         // try the alternative directory and suffix
-        dllPath = calloc(sizeof(char), strlen(tmpPath) + strlen(DLL_DIR2) 
-                + strlen( getModelIdentifier(fmu->modelDescription)) +  strlen(DLL_SUFFIX2) + 1);
-        sprintf(dllPath,"%s%s%s%s", tmpPath, DLL_DIR2, getModelIdentifier(fmu->modelDescription), DLL_SUFFIX2);
-        if (!loadDll(dllPath, fmu)) exit(EXIT_FAILURE); 
+        free(dllPath);
+        dllPath = getDllPath(tmpPath, DLL_DIR2, modelId, DLL_SUFFIX2);
+        ok = loadDll(dllPath, fmu, 0);
     }
+    if (ok) fmu->dllPath = dllPath;
+    else free(dllPath);
 
-    free(dllPath);
+done:
+#if !WINDOWS
+    // keep a private directory until unloadFMU, isolated instances load its dll
+    if (isTmp && tmpPath) {
+        if (ok) {
+            fmu->tmpPath = tmpPath;
+            tmpPath = NULL;
+        }
+        else removeTree(tmpPath);
+    }
+#endif
     free(fmuPath);
     free(tmpPath);
+    return ok;
+}
+
+void loadFMU(FMU* fmu, const char* fmuFileName) {
+    if (!tryLoadFMU(fmu, fmuFileName, NULL)) exit(EXIT_FAILURE);
+}
+
+// Returns 0 to indicate failure
+// Load the dll of the already loaded fmu once more, with its own copy of
+// all global variables. This allows several instances of FMUs that keep
+// state in static variables or can be instantiated only once per process.
+// The model description is shared with fmu.
+int loadIsolatedFMU(FMU* instance, const FMU* fmu) {
+    memset(instance, 0, sizeof(FMU));
+    instance->dllFd = -1;
+    instance->modelDescription = fmu->modelDescription;
+    instance->dllPath = strdup(fmu->dllPath);
+    if (!instance->dllPath) return 0; // failure
+    return loadDll(instance->dllPath, instance, 1);
+}
+
+// Unload the dll of the given fmu and release its memory, except for the
+// fmu itself. The model description is released if freeModelDescription
+// is 1, i.e. not for instances loaded using loadIsolatedFMU. Instances
+// must be unloaded before the fmu they were loaded from.
+void unloadFMU(FMU* fmu, int freeModelDescription) {
+    if (fmu->dllHandle) {
+#ifdef _MSC_VER
+        FreeLibrary(fmu->dllHandle);
+#else
+        dlclose(fmu->dllHandle);
+#endif
+    }
+#if !WINDOWS
+    if (fmu->dllFd >= 0) close(fmu->dllFd);
+    if (fmu->tmpPath) removeTree(fmu->tmpPath);
+#endif
+    if (freeModelDescription && fmu->modelDescription) freeElement(fmu->modelDescription);
+    free(fmu->dllPath);
+    free(fmu->tmpPath);
+    memset(fmu, 0, sizeof(FMU));
+    fmu->dllFd = -1;
 }
 
 static void doubleToCommaString(char* buffer, double r){
@@ -321,7 +653,8 @@ static void doubleToCommaString(char* buffer, double r){
     if (comma) *comma = ',';
 }
 
-// output time and all non-alias variables in CSV format
+// output time and the recorded variables of each component in CSV format,
+// all non-alias variables unless the component lists them in recorded
 // if separator is ',', columns are separated by ',' and '.' is used for floating-point numbers.
 // otherwise, the given separator (e.g. ';' or '\t') is to separate columns, and ',' is used 
 // as decimal dot in floating-point numbers.
@@ -355,16 +688,17 @@ void outputRow(Graph *graph, double time, FILE* file, char separator, boolean he
     for (n=0; graph->components[n]; n++) {
         fmu = (FMU*)graph->components[n]->fmu;
         c = graph->components[n]->instance;
-        vars = fmu->modelDescription->modelVariables;
+        vars = graph->components[n]->recorded;
+        if (!vars) vars = fmu->modelDescription->modelVariables;
 
         for (k=0; vars[k]; k++) {
             ScalarVariable* sv = vars[k];
-            if (getAlias(sv)!=enu_noAlias) continue;
+            if (!graph->components[n]->recorded && getAlias(sv)!=enu_noAlias) continue;
             if (header) {
                 // output names only
                 if (separator==',') {
                     // treat array element, e.g. print a[1, 2] as a[1.2]
-                    char* s = strdup(getName(sv));
+                    const char* s = getName(sv);
                     fprintf(file, "%c", separator);
                     while (*s) {
                        if (*s!=' ') fprintf(file, "%c", *s==',' ? '.' : *s);
@@ -429,22 +763,15 @@ static const char* fmiStatusToString(fmiStatus status){
 // search a fmu for the given variable
 // return NULL if not found or vr = fmiUndefinedValueReference
 static ScalarVariable* getSV(FMU* fmu, char type, fmiValueReference vr) {
-    int i;
     Elm tp;
-    ScalarVariable** vars = fmu->modelDescription->modelVariables;
-    if (vr==fmiUndefinedValueReference) return NULL;
     switch (type) {
         case 'r': tp = elm_Real;    break;
         case 'i': tp = elm_Integer; break;
         case 'b': tp = elm_Boolean; break;
-        case 's': tp = elm_String;  break;                
-    }
-    for (i=0; vars[i]; i++) {
-        ScalarVariable* sv = vars[i];
-        if (vr==getValueReference(sv) && tp==sv->typeSpec->type) 
-            return sv;
+        case 's': tp = elm_String;  break;
+        default: return NULL;
     }
-    return NULL;
+    return getVariable(fmu->modelDescription, vr, tp);
 }
 
 // replace e.g. #r1365# by variable name and ## by # in message
@@ -527,7 +854,117 @@ int error(const char* message){
     return 0;
 }
 
+SimOptions simOptions = { 0, 0, 0, NULL, 0, NULL, 1, 0, 0, NULL };
+
+// Returns NULL to indicate failure
+// Split a comma-separated list into a null-terminated list of names.
+// The list and the names are never released.
+static const char** splitNames(const char* list) {
+    const char** names;
+    char* copy = strdup(list);
+    char* name;
+    int n = 2;
+    const char* s;
+    for (s = list; *s; s++) if (*s == ',') n++;
+    names = (const char**)calloc(n, sizeof(const char*));
+    if (!copy || !names) return NULL;
+    n = 0;
+    for (name = strtok(copy, ","); name; name = strtok(NULL, ",")) names[n++] = name;
+    return names;
+}
+
+// Returns 0 to indicate an unknown option
+// Parse an option of the form --name or --name=value
+static int parseOption(const char* arg) {
+    if (!strncmp(arg, "--threads=", 10)) {
+        if (sscanf(arg + 10, "%d", &simOptions.nThreads) != 1 || simOptions.nThreads < 0) {
+            printf("error: The given number of threads (%s) is not valid\n", arg + 10);
+            exit(EXIT_FAILURE);
+        }
+        return 1;
+    }
+    if (!strncmp(arg, "--step-threads=", 15)) {
+        if (sscanf(arg + 15, "%d", &simOptions.stepThreads) != 1 || simOptions.stepThreads < 0) {
+            printf("error: The given number of threads (%s) is not valid\n", arg + 15);
+            exit(EXIT_FAILURE);
+        }
+        return 1;
+    }
+    if (!strcmp(arg, "--master=jacobi")) {
+        simOptions.gaussSeidel = 0;
+        return 1;
+    }
+    if (!strcmp(arg, "--master=gs")) {
+        simOptions.gaussSeidel = 1;
+        return 1;
+    }
+    if (!strcmp(arg, "--events")) {
+        simOptions.events = 1;
+        return 1;
+    }
+    if (!strncmp(arg, "--ensemble=", 11) && arg[11]) {
+        simOptions.ensemble = arg + 11;
+        return 1;
+    }
+    if (!strcmp(arg, "--isolate")) {
+        simOptions.isolate = 1;
+        return 1;
+    }
+    if (!strcmp(arg, "--timings")) {
+        simOptions.timingsFile = TIMINGS_FILE;
+        return 1;
+    }
+    if (!strncmp(arg, "--timings=", 10) && arg[10]) {
+        simOptions.timingsFile = arg + 10;
+        return 1;
+    }
+    if (!strcmp(arg, "--parser=expat")) {
+        setDefaultTokenizer(tokenizerExpat);
+        return 1;
+    }
+    if (!strcmp(arg, "--parser=insitu")) {
+        setDefaultTokenizer(tokenizerInSitu);
+        return 1;
+    }
+    if (!strcmp(arg, "--selective")) {
+        simOptions.selective = 1;
+        return 1;
+    }
+    if (!strncmp(arg, "--record=", 9) && arg[9]) {
+        simOptions.record = splitNames(arg + 9);
+        if (!simOptions.record) {
+            printf("error: Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        return 1;
+    }
+    if (!strcmp(arg, "--memfd")) {
+#ifdef MFD_CLOEXEC
+        simOptions.memfd = 1;
+        return 1;
+#else
+        printf("error: Option --memfd is not supported on this platform\n");
+        exit(EXIT_FAILURE);
+#endif
+    }
+    return 0;
+}
+
 void parseArguments(int argc, char *argv[], char** graphFileName, double* tEnd, double* h, int* loggingOn, char* csv_separator) {
+    int i, n;
+    // options may appear anywhere, remove them from the positional arguments
+    for (i=1, n=1; i<argc; i++) {
+        if (strncmp(argv[i], "--", 2)) {
+            argv[n++] = argv[i];
+        }
+        else if (!parseOption(argv[i])) {
+            printf("error: Unknown option %s\n", argv[i]);
+            printHelp(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    argc = n;
+
     // parse command line arguments
     if (argc>1) {
         *graphFileName = argv[1];
@@ -573,10 +1010,28 @@ void parseArguments(int argc, char *argv[], char** graphFileName, double* tEnd,
 }
 
 void printHelp(const char* fmusim) {
-    printf("command syntax: %s <graph.xml> <tEnd> <h> <loggingOn> <csv separator>\n", fmusim);
+    printf("command syntax: %s [options] <graph.xml> <tEnd> <h> <loggingOn> <csv separator>\n", fmusim);
     printf("   <graph.xml> .... path to component connection graph xml file, relative to current dir or absolute, required\n");
     printf("   <tEnd> ......... end  time of simulation, optional, defaults to 1.0 sec\n");
     printf("   <h> ............ step size of simulation, optional, defaults to 0.1 sec\n");
     printf("   <loggingOn> .... 1 to activate logging,   optional, defaults to 0\n");
     printf("   <csv separator>. separator in csv file,   optional, c for ';', s for';', defaults to c\n");
+    printf("options:\n");
+    printf("   --threads=<n> .. number of threads to load FMUs, 0 for one per processor, defaults to 0\n");
+    printf("   --master=<name>  jacobi to step all components with the inputs of the last step,\n");
+    printf("                    gs to step each component right after its producers, defaults to jacobi\n");
+    printf("   --step-threads=<n> number of threads to step the components, 0 for one per processor,\n");
+    printf("                    defaults to 1, the results do not depend on it\n");
+    printf("   --events ....... end a step at the first event signalled by a component and\n");
+    printf("                    take zero-length steps until no discrete signal changes\n");
+    printf("   --ensemble=<file> simulate one run per line of the CSV file, which sets the variables\n");
+    printf("                    <modelName>.<variable> named in its first line, on --step-threads workers\n");
+    printf("   --isolate ...... load the dll once per component, for FMUs with global state\n");
+    printf("   --memfd ........ load FMUs from memory without extracting them to disk\n");
+    printf("   --parser=<name>  tokenizer of the XML parser, expat or insitu, defaults to expat\n");
+    printf("   --record=<names> write only the given comma-separated variables to %s\n", RESULT_FILE);
+    printf("   --selective .... parse only the variables of the ports and of --record,\n");
+    printf("                    without --record, write the port variables to %s\n", RESULT_FILE);
+    printf("   --timings[=<file>] report the duration of each startup phase per component,\n");
+    printf("                    and write them as JSON to file, defaults to %s\n", TIMINGS_FILE);
 }
@@ -8,10 +8,9 @@
 // -x   Extracts files from an archive with their full paths in the current dir, or in an output dir if specified
 // -aoa Overwrite All existing files without prompt
 // -o   Specifies a destination directory where files are to be extracted
+// On other platforms, the FMU is read in-process, see zip_reader.h
 #if WINDOWS
 #define UNZIP_CMD_WIN "7z x -aoa -o"
-#else
-#define UNZIP_CMD "unzip"
 #endif /*WINDOWS*/
 
 #define XML_FILE  "modelDescription.xml"
@@ -49,6 +48,9 @@
 #endif /*__APPLE__*/
 #endif /*WINDOWS*/
 
+// path of an in-memory file created using memfd_create
+#define MEMFD_PATH "/proc/self/fd/%d"
+
 #define RESULT_FILE "result.csv"
 #define BUFSIZE 4096
 
@@ -60,10 +62,29 @@
 #define SEVEN_ZIP_OUT_OF_MEMORY 8
 #define SEVEN_ZIP_STOPPED_BY_USER 255
 
+// Options given as --name=value anywhere on the command line
+typedef struct {
+    int nThreads;   // number of threads to load FMUs, 0 for one per processor
+    int isolate;    // 1 to load the dll once per component, see loadIsolatedFMU
+    int memfd;      // 1 to load FMUs from memory, bypassing the FMU cache
+    const char* timingsFile; // file to write startup timings to, NULL for no timings
+    int selective;  // 1 to parse only the variables used by the graph, see parserContextSelect
+    const char** record; // NULL or null-terminated list of the variables to write to the result file
+    int stepThreads; // number of threads to step the components, 0 for one per processor
+    int gaussSeidel; // 1 to step each component right after its producers, see schedule.h
+    int events;     // 1 to cut the communication steps at events, see events.h
+    const char* ensemble; // NULL or the parameter table of an ensemble of runs, see ensemble.h
+} SimOptions;
+
+extern SimOptions simOptions;
+
 void fmuLogger(fmiComponent c, fmiString instanceName, fmiStatus status, fmiString category, fmiString message, ...);
 int unzip(const char *zipPath, const char *outPath);
 void parseArguments(int argc, char *argv[], char** graphFileName, double* tEnd, double* h, int* loggingOn, char* csv_separator);
+int tryLoadFMU(FMU *fmu, const char* fmuFileName, const char** names);
 void loadFMU(FMU *fmu, const char* fmuFileName);
+int loadIsolatedFMU(FMU* instance, const FMU* fmu);
+void unloadFMU(FMU* fmu, int freeModelDescription);
 #ifndef _MSC_VER
 typedef int boolean; 
 #endif
@@ -11,6 +11,7 @@
 
 Stack* stackNew(int initialSize, int inc){
     Stack* s = (Stack*)malloc(sizeof(Stack));
+    if (!s) return NULL; // failure
     s->stack = NULL;
     s->stackSize = 0;
     s->stackPos = -1;
@@ -24,15 +25,18 @@ int stackIsEmpty(Stack* s) {
 }
 
 // add an element to stack and grow stack if required
+// The stack grows geometrically, by at least inc elements, so that
+// pushing n elements costs O(n) copying.
 // returns 1 to indicate success and 0 for error
 int stackPush(Stack* s, void* e) {
-    s->stackPos++;
-    if (s->stackPos==s->stackSize){
-		s->stackSize += (s->stack ? s->inc: s->initialSize);
-        s->stack = (void**) realloc(s->stack, s->stackSize * sizeof(void*));
-        if (!s->stack) return 0; // error;
+    if (s->stackPos + 1 == s->stackSize){
+        int size = s->stack ? s->stackSize + (s->stackSize > s->inc ? s->stackSize : s->inc) : s->initialSize;
+        void** stack = (void**) realloc(s->stack, size * sizeof(void*));
+        if (!stack) return 0; // error, the stack is unchanged
+        s->stack = stack;
+        s->stackSize = size;
     }
-    s->stack[s->stackPos] = e;
+    s->stack[++s->stackPos] = e;
     return 1; // success
 }
 
@@ -50,6 +54,15 @@ void* stackPop(Stack* s){
     return s->stack[s->stackPos--];
 }
 
+// remove the top n elements from stack and return them, bottom first.
+// The returned array is part of the stack: it is valid until the next push.
+// runtime error if the stack holds less than n elements
+void** stackPopN(Stack* s, int n){
+    assert(n >= 0 && n <= s->stackPos + 1);
+    s->stackPos -= n;
+    return s->stack + s->stackPos + 1;
+}
+
 // return the last n elements as null terminated array, 
 // or NULL if memory allocation fails
 void** stackLastPopedAsArray0(Stack* s, int n){
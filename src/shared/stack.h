@@ -12,7 +12,7 @@ typedef struct {
     int stackSize;    // allocated size of stack
     int stackPos;     // array index of top element, -1 if stack is empty.
     int initialSize;  // how many element to allocate initially
-    int inc;          // how many elements to allocate when stack gets full
+    int inc;          // how many elements to allocate at least when stack gets full
 } Stack;
 
 Stack* stackNew(int initialSize, int inc);
@@ -20,6 +20,7 @@ int stackIsEmpty(Stack* s);
 int stackPush(Stack* s, void* e);
 void* stackPeek(Stack* s);
 void* stackPop(Stack* s);
+void** stackPopN(Stack* s, int n);
 void** stackPopAllAsArray(Stack* s, int *size);
 void** stackLastPopedAsArray0(Stack* s, int n);
 void stackFree(Stack* s);
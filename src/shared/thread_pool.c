@@ -0,0 +1,157 @@
+/* -------------------------------------------------------------------------
+ * thread_pool.c
+ * A pool of persistent worker threads, see thread_pool.h
+ * Tasks of a batch are handed out one by one under a mutex, so a slow
+ * task does not hold up the others. The calling thread works on the
+ * batch too, a pool of size n therefore creates n-1 threads.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include "thread_pool.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+
+struct ThreadPool {
+    int nThreads;
+};
+
+int numberOfProcessors() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+// threads are not supported here, all tasks run in the calling thread
+ThreadPool* threadPoolNew(int nThreads) {
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (pool) pool->nThreads = 1;
+    return pool;
+}
+
+void threadPoolRun(ThreadPool* pool, TaskFunction task, void* data, int n) {
+    int i;
+    for (i=0; i<n; i++) task(data, i);
+}
+
+void threadPoolFree(ThreadPool* pool) {
+    free(pool);
+}
+
+#else /* _MSC_VER */
+#include <pthread.h>
+#include <unistd.h>
+
+struct ThreadPool {
+    int nThreads;            // number of threads, including the caller of threadPoolRun
+    pthread_t* threads;      // the nThreads-1 worker threads
+    pthread_mutex_t lock;    // protects all fields below
+    pthread_cond_t start;    // signals a new batch or shutdown
+    pthread_cond_t done;     // signals that all tasks of the batch are done
+    TaskFunction task;       // the task of the current batch
+    void* data;              // passed to each task
+    int n;                   // number of tasks in the current batch
+    int next;                // index of the next task to run
+    int finished;            // number of finished tasks
+    unsigned long batch;     // counts batches, used to detect a new batch
+    int shutdown;            // 1 to terminate all workers
+};
+
+int numberOfProcessors() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// Run tasks of the current batch until none is left.
+// Must be called with the lock held, returns with the lock held.
+static void runTasks(ThreadPool* pool) {
+    while (pool->next < pool->n) {
+        int i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->task(pool->data, i);
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->n) pthread_cond_broadcast(&pool->done);
+    }
+}
+
+static void* worker(void* arg) {
+    ThreadPool* pool = (ThreadPool*)arg;
+    unsigned long batch = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->shutdown && pool->batch == batch)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->shutdown) break;
+        batch = pool->batch;
+        runTasks(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Returns NULL to indicate failure
+// nThreads <= 0 selects one thread per processor
+ThreadPool* threadPoolNew(int nThreads) {
+    int i;
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    if (nThreads <= 0) nThreads = numberOfProcessors();
+    pool->threads = (pthread_t*)calloc(nThreads, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->nThreads = 1;
+    for (i=1; i<nThreads; i++) {
+        if (pthread_create(&pool->threads[i-1], NULL, worker, pool)) break;
+        pool->nThreads++;
+    }
+    return pool;
+}
+
+// Run task(data, i) for i = 0..n-1 and wait until all are done
+void threadPoolRun(ThreadPool* pool, TaskFunction task, void* data, int n) {
+    int i;
+    if (pool->nThreads == 1 || n == 1) {
+        for (i=0; i<n; i++) task(data, i);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->data = data;
+    pool->n = n;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->start);
+    runTasks(pool);
+    while (pool->finished < pool->n)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// terminate all workers and release the pool
+void threadPoolFree(ThreadPool* pool) {
+    int i;
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (i=0; i<pool->nThreads-1; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+}
+#endif /* _MSC_VER */
+
+// number of threads of the pool, including the caller of threadPoolRun
+int threadPoolSize(ThreadPool* pool) {
+    return pool->nThreads;
+}
@@ -0,0 +1,23 @@
+/* -------------------------------------------------------------------------
+ * thread_pool.h
+ * A pool of persistent worker threads that run batches of tasks.
+ * threadPoolRun() returns only after all tasks of the batch are done,
+ * i.e. consecutive batches are separated by a barrier.
+ * Without pthreads, e.g. on Windows, all tasks run in the calling thread.
+ * -------------------------------------------------------------------------*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// task i of a batch of n tasks
+typedef void (*TaskFunction)(void* data, int i);
+
+typedef struct ThreadPool ThreadPool;
+
+int numberOfProcessors();
+ThreadPool* threadPoolNew(int nThreads);
+int threadPoolSize(ThreadPool* pool);
+void threadPoolRun(ThreadPool* pool, TaskFunction task, void* data, int n);
+void threadPoolFree(ThreadPool* pool);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,106 @@
+/* -------------------------------------------------------------------------
+ * timings.c
+ * Durations of the startup phases of a component, see timings.h
+ * -------------------------------------------------------------------------*/
+
+#ifndef _MSC_VER
+#define _POSIX_C_SOURCE 200112L // clock_gettime()
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "timings.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define THREAD_LOCAL __declspec(thread)
+#else
+#include <time.h>
+#define THREAD_LOCAL __thread
+#endif
+
+const char* phaseNames[SIZEOF_PHASE] = {
+    "unzip", "parse", "validate", "dlopen", "getAdr",
+    "instantiate", "initialize"
+};
+
+static THREAD_LOCAL Timings* capture = NULL; // NULL to ignore measured phases
+
+// seconds since some fixed point in time, not affected by clock changes
+double monotonicTime() {
+#ifdef _MSC_VER
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Collect the phases measured by the calling thread in timings, NULL to stop
+void timingsCapture(Timings* timings) {
+    capture = timings;
+}
+
+// Add the time elapsed since start, see monotonicTime, to the given phase
+void timingsAdd(Phase phase, double start) {
+    if (capture) capture->seconds[phase] += monotonicTime() - start;
+}
+
+// Print a table with one row per component, durations in ms
+void timingsPrint(const Timings* timings, int n, double wallTime) {
+    int i, p;
+    double total[SIZEOF_PHASE];
+    memset(total, 0, sizeof(total));
+    printf("Startup timings in ms\n");
+    printf("  %-20s %-8s", "component", "loaded");
+    for (p=0; p<SIZEOF_PHASE; p++) printf(" %11s", phaseNames[p]);
+    printf("\n");
+    for (i=0; i<n; i++) {
+        printf("  %-20.20s %-8s", timings[i].name, timings[i].loadedBy);
+        for (p=0; p<SIZEOF_PHASE; p++) {
+            printf(" %11.3f", timings[i].seconds[p] * 1000);
+            total[p] += timings[i].seconds[p];
+        }
+        printf("\n");
+    }
+    printf("  %-20s %-8s", "total", "");
+    for (p=0; p<SIZEOF_PHASE; p++) printf(" %11.3f", total[p] * 1000);
+    printf("\n");
+    printf("  wall time ........ %.3f ms\n", wallTime * 1000);
+}
+
+static void writeJsonString(FILE* file, const char* s) {
+    fputc('"', file);
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(file, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(file, "\\u%04x", *s);
+        else fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+// Returns 0 to indicate failure
+// Write the timings to the given file as JSON, durations in seconds
+int timingsWriteJson(const char* path, const Timings* timings, int n, double wallTime) {
+    int i, p;
+    FILE* file = fopen(path, "w");
+    if (!file) return 0; // failure
+    fprintf(file, "{\n  \"wallTime\": %.9f,\n  \"components\": [", wallTime);
+    for (i=0; i<n; i++) {
+        fprintf(file, "%s\n    {\"name\": ", i ? "," : "");
+        writeJsonString(file, timings[i].name);
+        fprintf(file, ", \"fmuPath\": ");
+        writeJsonString(file, timings[i].fmuPath);
+        fprintf(file, ", \"loaded\": ");
+        writeJsonString(file, timings[i].loadedBy);
+        for (p=0; p<SIZEOF_PHASE; p++) {
+            fprintf(file, ", \"%s\": %.9f", phaseNames[p], timings[i].seconds[p]);
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,37 @@
+/* -------------------------------------------------------------------------
+ * timings.h
+ * Durations of the startup phases of a component, measured with a
+ * monotonic clock when the simulator is started with --timings.
+ * A thread can collect the phases it measures in a Timings record,
+ * see timingsCapture, like messages are captured in a LogBuffer.
+ * -------------------------------------------------------------------------*/
+
+#ifndef TIMINGS_H
+#define TIMINGS_H
+
+#include <stdio.h>
+
+#define TIMINGS_FILE "timings.json"
+
+typedef enum {
+    phase_unzip, phase_parse, phase_validate, phase_dlopen, phase_getAdr,
+    phase_instantiate, phase_initialize,
+    SIZEOF_PHASE
+} Phase;
+
+extern const char* phaseNames[SIZEOF_PHASE];
+
+typedef struct {
+    const char* name;              // name of the component
+    const char* fmuPath;           // path of its FMU
+    const char* loadedBy;          // "self", "shared" or "isolated", see fmusim_cs
+    double seconds[SIZEOF_PHASE];  // duration of each phase
+} Timings;
+
+double monotonicTime();
+void timingsCapture(Timings* timings);
+void timingsAdd(Phase phase, double start);
+void timingsPrint(const Timings* timings, int n, double wallTime);
+int timingsWriteJson(const char* path, const Timings* timings, int n, double wallTime);
+
+#endif // TIMINGS_H
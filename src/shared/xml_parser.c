@@ -19,9 +19,20 @@
  * -------------------------------------------------------------------------*/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#endif
 #include "xml_parser.h"
+#include "xml_scanner.h"
+#include "log_buffer.h"
+#include "timings.h"
 
 const char *elmNames[SIZEOF_ELM] = { 
     "fmiModelDescription","UnitDefinitions","BaseUnit","DisplayUnitDefinition","TypeDefinitions",
@@ -45,7 +56,7 @@ const char *attNames[SIZEOF_ATT] = {
     "canNotUseMemoryManagementFunctions","file","entryPoint","manualStart","type",
 
     // component graph
-    "connection","fmuPath"
+    "connection","fmuPath","stepRatio"
 };
 
 const char *enuNames[SIZEOF_ENU] = {
@@ -56,24 +67,147 @@ const char *enuNames[SIZEOF_ENU] = {
     "Boolean","Integer","Real","String"
 };
 
+// Hash function for the perfect hash tables of the name arrays, see
+// src/bench/gen_name_hash.c. FNV-1a followed by a final mix, so that the
+// low bits depend on all chars of the name.
+unsigned int hashName(const char* name, unsigned int seed) {
+    unsigned int h = 2166136261u ^ seed;
+    for (; *name; name++) {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// Perfect hash tables generated by 'make namehash', see src/bench/gen_name_hash.c.
+// Slot hashName(name, seed) of a table holds the index of name in the
+// corresponding name array, or -1.
+#define ELM_HASH_SEED 682727u
+#define ELM_HASH_BITS 6
+static const signed char elmHash[1 << ELM_HASH_BITS] = {
+    31, -1, 13, 38, -1, -1, 27, -1, -1, -1, 2, 32, 1, 18, -1, 21,
+    35, -1, -1, 34, -1, 3, -1, 4, -1, 28, -1, 19, 36, 8, -1, 9,
+    -1, 11, 5, -1, -1, 17, 22, -1, 14, -1, -1, 29, -1, 16, 33, 24,
+    -1, -1, 37, 25, 30, 0, 20, -1, 26, -1, 6, 10, 7, 12, 15, 23
+};
+
+#define ATT_HASH_SEED 60863u
+#define ATT_HASH_BITS 7
+static const signed char attHash[1 << ATT_HASH_BITS] = {
+    -1, 43, -1, -1, -1, -1, -1, -1, 44, 16, -1, 13, 15, -1, -1, 38,
+    36, 0, -1, -1, -1, -1, -1, -1, -1, -1, 33, -1, -1, 42, 40, -1,
+    -1, 9, 19, 12, 20, -1, -1, 34, -1, -1, 35, 7, -1, -1, -1, 4,
+    -1, 10, -1, 17, -1, -1, 8, -1, -1, -1, -1, -1, 37, 5, 47, 2,
+    -1, -1, -1, -1, 41, -1, -1, -1, -1, 39, -1, -1, 45, -1, 6, 24,
+    46, -1, -1, -1, -1, 26, -1, 22, 28, -1, 1, -1, 32, -1, -1, 14,
+    -1, 29, -1, 3, -1, -1, -1, 27, 25, -1, -1, -1, -1, -1, -1, 49,
+    23, -1, 31, 18, 30, -1, 48, -1, 21, -1, 11, -1, -1, -1, -1, -1
+};
+
+#define ENU_HASH_SEED 334u
+#define ENU_HASH_BITS 5
+static const signed char enuHash[1 << ENU_HASH_BITS] = {
+    -1, -1, -1, 13, 5, -1, 15, -1, 16, -1, -1, 4, -1, -1, -1, 12,
+    1, 7, -1, 8, -1, 9, -1, 0, 2, -1, 6, 3, 11, -1, 14, 10
+};
+
+// Returns -1 if name is not in array
+static int lookupName(const char* name, const char* array[], const signed char* table,
+        unsigned int seed, int bits) {
+    int i = table[hashName(name, seed) & ((1u << bits) - 1)];
+    return i >= 0 && !strcmp(name, array[i]) ? i : -1;
+}
+
+// Returns -1 if name is not a known element name
+int getElmIndex(const char* name) {
+    return lookupName(name, elmNames, elmHash, ELM_HASH_SEED, ELM_HASH_BITS);
+}
+
+// Returns -1 if name is not a known attribute name
+int getAttIndex(const char* name) {
+    return lookupName(name, attNames, attHash, ATT_HASH_SEED, ATT_HASH_BITS);
+}
+
+// Returns -1 if name is not a known enum value
+int getEnuIndex(const char* name) {
+    return lookupName(name, enuNames, enuHash, ENU_HASH_SEED, ENU_HASH_BITS);
+}
+
+#ifndef NDEBUG
+// Verify that the hash tables match the name arrays.
+// Fails after a name array changed without running 'make namehash'.
+static void checkNameTables() {
+    int i;
+    for (i=0; i<SIZEOF_ELM; i++) assert(getElmIndex(elmNames[i]) == i);
+    for (i=0; i<SIZEOF_ATT; i++) assert(getAttIndex(attNames[i]) == i);
+    for (i=0; i<SIZEOF_ENU; i++) assert(getEnuIndex(enuNames[i]) == i);
+}
+
+#ifdef _MSC_VER
+static int nameTablesChecked = 0; // the thread pool runs in the calling thread here
+
+// Runs checkNameTables before the first document is parsed
+static void checkNameTablesOnce() {
+    if (!nameTablesChecked) checkNameTables();
+    nameTablesChecked = 1;
+}
+#else
+static pthread_once_t nameTablesChecked = PTHREAD_ONCE_INIT;
+
+// Runs checkNameTables before the first document is parsed, by any thread
+static void checkNameTablesOnce() {
+    pthread_once(&nameTablesChecked, checkNameTables);
+}
+#endif
+#endif
+
+// attMask has one bit per attribute
+typedef char attMaskTooSmall[SIZEOF_ATT <= 64 ? 1 : -1];
+
+// Number of bits set in x. Branch-free, unlike __builtin_popcountll
+// this does not become a library call without -mpopcnt.
+static int countBits(unsigned long long x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
 #define ANY_TYPE -1
 #define XMLBUFSIZE 1024
-char text[XMLBUFSIZE];       // XML file is parsed in chunks of length XMLBUFZIZE
-XML_Parser parser = NULL;    // non-NULL during parsing
-Stack* stack = NULL;         // the parser stack
-char* data = NULL;           // buffer that holds element content, see handleData
-int skipData=0;              // 1 to ignore element content, 0 when recordig content
+
+// The state of the parser, passed to the callbacks as expat user data.
+// There is no global state, so several threads may parse at the same time,
+// each with its own context. A context parses one document at a time and
+// keeps the expat parser, the stack and the data buffer for the next one.
+struct ParserContext {
+    XML_Parser parser;       // reused for each document, see beginParse
+    Tokenizer tokenizer;     // tokenizer used for files, see parserContextSetTokenizer
+    XmlScanner* scanner;     // NULL, or the in-situ tokenizer, created on first use
+    int inSitu;              // 1 if attribute values point into the mapped document
+    int stopped;             // 1 after an error stopped the parser, see stopParser
+    Stack* stack;            // the parser stack, cleared for each document
+    Arena* arena;            // holds all nodes and strings of the AST under construction
+    char* data;              // buffer that holds element content, see handleData
+    int skipData;            // 1 to ignore element content, 0 when recordig content
+    const char** selected;   // NULL, or hash set of the variables to keep, see parserContextSelect
+    unsigned int selectedMask; // number of slots of selected - 1
+    int skipDepth;           // > 0 inside a subtree that is skipped, see skipElement
+    int nSkipped;            // number of variables skipped in the current document
+};
 
 // ------------------------------------------------------------------------- 
 // Low-level functions for inspecting the model description 
 
+// Attributes are ordered by Att, see addAttributes
 const char* getString(void* element, Att a){
     Element* e = (Element*)element;
-    const char** attr = e->attributes;
-    int i;
-    for (i=0; i<e->n; i+=2)
-        if (attr[i]==attNames[a]) return attr[i+1];
-    return NULL;
+    unsigned long long bit = 1ULL << a;
+    if (!(e->attMask & bit)) return NULL;
+    return e->attributes[2 * countBits(e->attMask & (bit - 1)) + 1];
 }
 
 double getDouble(void* element, Att a, ValueStatus* vs){
@@ -112,7 +246,7 @@ char getBoolean(void* element, Att a, ValueStatus* vs){
     return 0;
 }
 
-static int checkEnumValue(const char* enu);
+static int checkEnumValue(ParserContext* ps, const char* enu);
 
 // Retrieve the value of the given built-in enum attribute.
 // If the value is missing, this is marked in the ValueStatus
@@ -132,7 +266,7 @@ Enu getEnumValue(void* element, Att a, ValueStatus* vs) {
             default: return -1;
         }
     }
-    id = checkEnumValue(value);
+    id = checkEnumValue(NULL, value);
     if (id==-1) *vs = valueIllegal; 
     return id;
 }
@@ -192,17 +326,110 @@ Enu getAlias(void* scalarVariable) {
 // the vr is unique only for one of the 4 base data types r,i,b,s and
 // may also be fmiUndefinedValueReference = 4294967295 = 0xFFFFFFFF
 // here, i means integer or enumeration
+// The value is parsed once by the parser, validate checks that it is defined.
 fmiValueReference getValueReference(void* scalarVariable) {
-    ValueStatus vs;
-    fmiValueReference vr = getUInt(scalarVariable, att_valueReference, &vs);
-    assert(((Element*)scalarVariable)->type == elm_ScalarVariable);
-    assert(vs==valueDefined); // this is a reqired attribute
+    ScalarVariable* sv = (ScalarVariable*)scalarVariable;
+    assert(sv->type == elm_ScalarVariable);
+    return sv->vr;
+}
+
+// Hash indexes of the model variables, see VariableIndex and indexVariables.
+
+// Returns -1 for elements that are not a base type
+// Integer and Enumeration share the same value references
+static int baseTypeIndex(Elm type) {
+    switch (type) {
+        case elm_Real:        return 0;
+        case elm_Integer:
+        case elm_Enumeration: return 1;
+        case elm_Boolean:     return 2;
+        case elm_String:      return 3;
+        default:              return -1;
+    }
+}
+
+static unsigned int hashVr(fmiValueReference vr) {
+    vr ^= vr >> 16;
+    vr *= 0x45d9f3bu;
+    vr ^= vr >> 16;
     return vr;
 }
 
+static ScalarVariable* lookupVariableByName(VariableIndex* index, const char* name) {
+    const VariableTable* t = &index->byName;
+    unsigned int h;
+    for (h = hashName(name, 0) & t->mask; t->slots[h]; h = (h + 1) & t->mask) {
+        if (!strcmp(getName(t->slots[h]), name)) return t->slots[h];
+    }
+    return NULL;
+}
+
+static ScalarVariable* lookupVariable(VariableIndex* index, fmiValueReference vr, Elm type) {
+    int b = baseTypeIndex(type);
+    const VariableTable* t;
+    unsigned int h;
+    if (b < 0 || vr == fmiUndefinedValueReference) return NULL;
+    t = &index->byVr[b];
+    for (h = hashVr(vr) & t->mask; t->slots[h]; h = (h + 1) & t->mask) {
+        if (t->slots[h]->vr == vr) return t->slots[h];
+    }
+    return NULL;
+}
+
+// Returns 0 to indicate failure
+static int initVariableTable(Arena* arena, VariableTable* t, int n) {
+    unsigned int size = 16;
+    while (size < 2 * (unsigned int)n) size *= 2;
+    t->slots = (ScalarVariable**)arenaAlloc(arena, size * sizeof(ScalarVariable*));
+    t->mask = size - 1;
+    return t->slots != NULL;
+}
+
+// Returns NULL to indicate failure
+// Builds the indexes used by getVariableByName and getVariable in the
+// arena of md. If several variables have the same name, or the same
+// value reference and base type, the first one is found, as by a scan.
+static VariableIndex* indexVariables(ModelDescription* md) {
+    int n[4] = { 0, 0, 0, 0 };
+    int i, b, nVars = 0;
+    unsigned int h;
+    VariableTable* t;
+    VariableIndex* index = (VariableIndex*)arenaAlloc(md->arena, sizeof(VariableIndex));
+    if (!index) return NULL;
+    if (md->modelVariables) {
+        for (i=0; md->modelVariables[i]; i++) {
+            b = baseTypeIndex(md->modelVariables[i]->typeSpec->type);
+            if (b >= 0) n[b]++;
+        }
+        nVars = i;
+    }
+    if (!initVariableTable(md->arena, &index->byName, nVars)) return NULL;
+    for (b=0; b<4; b++) {
+        if (!initVariableTable(md->arena, &index->byVr[b], n[b])) return NULL;
+    }
+    for (i=0; i<nVars; i++) {
+        ScalarVariable* sv = md->modelVariables[i];
+        const char* name = getName(sv);
+        t = &index->byName;
+        for (h = hashName(name, 0) & t->mask; t->slots[h]; h = (h + 1) & t->mask) {
+            if (!strcmp(getName(t->slots[h]), name)) break;
+        }
+        if (!t->slots[h]) t->slots[h] = sv;
+        b = baseTypeIndex(sv->typeSpec->type);
+        if (b < 0 || sv->vr == fmiUndefinedValueReference) continue;
+        t = &index->byVr[b];
+        for (h = hashVr(sv->vr) & t->mask; t->slots[h]; h = (h + 1) & t->mask) {
+            if (t->slots[h]->vr == sv->vr) break;
+        }
+        if (!t->slots[h]) t->slots[h] = sv;
+    }
+    return index;
+}
+
 // the name is unique within a fmu
 ScalarVariable* getVariableByName(ModelDescription* md, const char* name) {
     int i;
+    if (md->index) return lookupVariableByName(md->index, name);
     if (md->modelVariables)
     for (i=0; md->modelVariables[i]; i++){
         ScalarVariable* sv = (ScalarVariable*)md->modelVariables[i];
@@ -222,6 +449,7 @@ int sameBaseType(Elm t1, Elm t2){
 // returns NULL if variable not found or vr==fmiUndefinedValueReference
 ScalarVariable* getVariable(ModelDescription* md, fmiValueReference vr, Elm type){
     int i;
+    if (md->index) return lookupVariable(md->index, vr, type);
     if (md->modelVariables && vr!=fmiUndefinedValueReference)
     for (i=0; md->modelVariables[i]; i++){
         ScalarVariable* sv = (ScalarVariable*)md->modelVariables[i];
@@ -297,73 +525,77 @@ double getNominal(ModelDescription* md, fmiValueReference vr){
 // ------------------------------------------------------------------------- 
 // Various checks that log an error and stop the parser 
 
+// Stop the parser, if any. ps is NULL when called after parsing.
+static void stopParser(ParserContext* ps) {
+    if (!ps) return;
+    ps->stopped = 1;
+    if (ps->parser && !ps->inSitu) XML_StopParser(ps->parser, XML_FALSE);
+}
+
 // Returns 0 to indicate error
-static int checkPointer(const void* ptr){
+static int checkPointer(ParserContext* ps, const void* ptr){
     if (! ptr) {
-        printf("Out of memory\n");
-        if (parser) XML_StopParser(parser, XML_FALSE);
+        logPrintf("Out of memory\n");
+        stopParser(ps);
         return 0; // error 
     }
     return 1; // success
 }
 
-static int checkName(const char* name, const char* kind, const char* array[], int n){
-    int i;
-    for (i=0; i<n; i++) {
-        if (!strcmp(name, array[i])) return i;
-    }
-    printf("Illegal %s %s\n", kind, name);
-    XML_StopParser(parser, XML_FALSE);
+static int checkName(ParserContext* ps, const char* name, const char* kind, int i){
+    if (i >= 0) return i;
+    logPrintf("Illegal %s %s\n", kind, name);
+    stopParser(ps);
     return -1;
 }
 
 // Returns -1 to indicate error
-static int checkElement(const char* elm){
-    return checkName(elm, "element", elmNames, SIZEOF_ELM);
+static int checkElement(ParserContext* ps, const char* elm){
+    return checkName(ps, elm, "element", getElmIndex(elm));
 }
 
 // Returns -1 to indicate error
-static int checkAttribute(const char* att){
-    return checkName(att, "attribute", attNames, SIZEOF_ATT);
+static int checkAttribute(ParserContext* ps, const char* att){
+    return checkName(ps, att, "attribute", getAttIndex(att));
 }
 
 // Returns -1 to indicate error
-static int checkEnumValue(const char* enu){
-    return checkName(enu, "enum value", enuNames, SIZEOF_ENU);
+static int checkEnumValue(ParserContext* ps, const char* enu){
+    return checkName(ps, enu, "enum value", getEnuIndex(enu));
 }
 
-static void logFatalTypeError(const char* expected, Elm found) {
-    printf("Wrong element type, expected %s, found %s\n", 
+static void logFatalTypeError(ParserContext* ps, const char* expected, Elm found) {
+    logPrintf("Wrong element type, expected %s, found %s\n", 
             expected, elmNames[found]);
-    XML_StopParser(parser, XML_FALSE);
+    stopParser(ps);
 }
 
 // Returns 0 to indicate error
 // Verify that Element elm is of the given type
-static int checkElementType(void* element, Elm e) {
+static int checkElementType(ParserContext* ps, void* element, Elm e) {
     Element* elm = (Element* )element;
     if (elm->type == e) return 1; // success
-    logFatalTypeError(elmNames[e], elm->type);
+    logFatalTypeError(ps, elmNames[e], elm->type);
     return 0; // error    
 }
 
 // Returns 0 to indicate error
 // Verify that the next stack element exists and is of the given type
 // If e==ANY_TYPE, the type check is ommited 
-static int checkPeek(Elm e) {
-    if (stackIsEmpty(stack)){
-        printf("Illegal document structure, expected %s\n", elmNames[e]);
-        XML_StopParser(parser, XML_FALSE);
+static int checkPeek(ParserContext* ps, Elm e) {
+    if (stackIsEmpty(ps->stack)){
+        logPrintf("Illegal document structure, expected %s\n", elmNames[e]);
+        stopParser(ps);
         return 0; // error
     }
-    return e==ANY_TYPE ? 1 : checkElementType(stackPeek(stack), e);
+    return e==ANY_TYPE ? 1 : checkElementType(ps, stackPeek(ps->stack), e);
 }
 
 // Returns NULL to indicate error
 // Get the next stack element, it is of the given type.
 // If e==ANY_TYPE, the type check is ommited 
-static void* checkPop(Elm e){
-    return checkPeek(e) ? stackPop(stack) : NULL;
+static void* checkPop(ParserContext* ps, Elm e){
+    return checkPeek(ps, e) ? stackPop(ps->stack) : NULL;
 }
 
 // ------------------------------------------------------------------------- 
@@ -412,52 +644,101 @@ AstNodeType getAstNodeType(Elm e){
 }
 
 // Returns 0 to indicate error
-// Copies the attr array and all values.
+// Copies the attr array and all values into the arena.
 // Replaces all attribute names by constant literal strings.
-// Converts the null-terminated array into an array of known size n.
-int addAttributes(Element* el, const char** attr) {
-    int n, a;
+// Converts the null-terminated array into an array of known size n,
+// ordered by Att. Expat rejects duplicate attributes.
+static int addAttributes(ParserContext* ps, Element* el, const char** attr) {
+    int n, a, k;
+    unsigned long long mask = 0;
     const char** att = NULL;
-    for (n=0; attr[n]; n+=2);
+    for (n=0; attr[n]; n+=2) {
+        a = checkAttribute(ps, attr[n]);
+        if (a == -1) return 0;  // illegal attribute error
+        mask |= 1ULL << a;
+    }
     if (n>0) {
-        att = calloc(n, sizeof(char*));
-        if (!checkPointer(att)) return 0;
+        att = arenaAlloc(ps->arena, n * sizeof(char*));
+        if (!checkPointer(ps, att)) return 0;
     } 
     for (n=0; attr[n]; n+=2) {
-        char* value = strdup(attr[n+1]);
-        if (!checkPointer(value)) return 0;
-        a = checkAttribute(attr[n]);
-        if (a == -1) return 0;  // illegal attribute error
-        att[n  ] = attNames[a]; // no heap memory
-        att[n+1] = value;       // heap memory
+        // values of the in-situ tokenizer live as long as the arena, see parseFileInSitu
+        const char* value = ps->inSitu ? attr[n+1] : arenaStrdup(ps->arena, attr[n+1]);
+        if (!checkPointer(ps, value)) return 0;
+        a = getAttIndex(attr[n]);
+        k = 2 * countBits(mask & ((1ULL << a) - 1));
+        att[k  ] = attNames[a]; // no heap memory
+        att[k+1] = value;       // arena memory or the mapped document
     }
     el->attributes = att; // NULL if n=0
     el->n = n;
+    el->attMask = mask;
     return 1; // success
 }
 
 // Returns NULL to indicate error
-Element* newElement(Elm type, int size, const char** attr) {
-    Element* e = (Element*)calloc(1, size);
-    if (!checkPointer(e)) return NULL; 
+static Element* newElement(ParserContext* ps, Elm type, int size, const char** attr) {
+    Element* e = (Element*)arenaAlloc(ps->arena, size);
+    if (!checkPointer(ps, e)) return NULL; 
     e->type = type;
     e->attributes = NULL;
     e->n=0;
-    if (!addAttributes(e, attr)) return NULL;
+    e->attMask=0;
+    if (!addAttributes(ps, e, attr)) return NULL;
     return e;
 }
 
+// 1 if the variable with the given name is kept by a selective parse
+static int isSelected(ParserContext* ps, const char* name) {
+    unsigned int h;
+    for (h = hashName(name, 0) & ps->selectedMask; ps->selected[h]; h = (h + 1) & ps->selectedMask) {
+        if (!strcmp(ps->selected[h], name)) return 1;
+    }
+    return 0;
+}
+
+// 1 if a selective parse skips element el with the given attributes and
+// all its children: variables not selected, vendor annotations and unit
+// definitions. Nothing is allocated for a skipped subtree.
+static int skipElement(ParserContext* ps, Elm el, const char** attr) {
+    int i;
+    switch (el) {
+        case elm_VendorAnnotations:
+        case elm_UnitDefinitions:
+            return 1;
+        case elm_ScalarVariable:
+            for (i=0; attr[i]; i+=2) {
+                if (!strcmp(attr[i], attNames[att_name])) break;
+            }
+            if (attr[i] && isSelected(ps, attr[i+1])) return 0;
+            ps->nSkipped++;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
 // ------------------------------------------------------------------------- 
 // callback functions called by the XML parser 
 
 // Create and push a new element node
 static void XMLCALL startElement(void *context, const char *elm, const char **attr) {
+    ParserContext* ps = (ParserContext*)context;
     Elm el;
     void* e;
     int size;
-    el = checkElement(elm);
+    if (ps->skipDepth) {
+        ps->skipDepth++; // nested in a skipped subtree, not checked
+        return;
+    }
+    el = checkElement(ps, elm);
     if (el==-1) return; // error
-    skipData = (el != elm_Name); // skip element content for all elements but Name
+    if (ps->selected && skipElement(ps, el, attr)) {
+        ps->skipDepth = 1;
+        ps->skipData = 1;
+        return;
+    }
+    ps->skipData = (el != elm_Name); // skip element content for all elements but Name
     switch(getAstNodeType(el)){
         case astElement:          size = sizeof(Element); break;
         case astListElement:      size = sizeof(ListElement); break;
@@ -474,24 +755,23 @@ static void XMLCALL startElement(void *context, const char *elm, const char **at
         case astGraph:          size = sizeof(Graph); break;
 	default: assert(0);
     }
-    e = newElement(el, size, attr);
-    checkPointer(e); 
-    stackPush(stack, e);
+    e = newElement(ps, el, size, attr);
+    if (e) stackPush(ps->stack, e); // otherwise newElement stopped the parser
 }
 
 // Pop all elements of the given type from stack and 
 // add it to the ListElement that follows.
 // The ListElement remains on the stack.
-static void popList(Elm e) {
+static void popList(ParserContext* ps, Elm e) {
+    Stack* s = ps->stack;
     int n = 0;
     Element** array;
-    Element* elm = stackPop(stack);
-    while (elm->type == e) {
-        elm = stackPop(stack);
-        n++;
-    }
-    stackPush(stack, elm); // push ListElement back to stack
-    array = (Element**)stackLastPopedAsArray0(stack, n); // NULL terminated list
+    Element* elm;
+    while (n <= s->stackPos && ((Element*)s->stack[s->stackPos - n])->type == e) n++;
+    array = (Element**)arenaAlloc(ps->arena, (n + 1) * sizeof(Element*));
+    if (!checkPointer(ps, array)) return; // failure
+    memcpy(array, stackPopN(s, n), n * sizeof(Element*)); // NULL terminated list, arena memory is zeroed
+    elm = stackPeek(s);
     if (getAstNodeType(elm->type)!=astListElement) return; // failure
     ((ListElement*)elm)->list = array;
     return; // success only if list!=NULL    
@@ -500,8 +780,15 @@ static void popList(Elm e) {
 // Pop the children from the stack and
 // check for correct type and sequence of children
 static void XMLCALL endElement(void *context, const char *elm) {
+    ParserContext* ps = (ParserContext*)context;
     Elm el;
-    el = checkElement(elm);
+    // expat reports the end of an empty element even if its start stopped the parser
+    if (ps->stopped) return;
+    if (ps->skipDepth) {
+        ps->skipDepth--;
+        return;
+    }
+    el = checkElement(ps, elm);
     switch(el) { 
         case elm_fmiModelDescription: 
             {
@@ -514,48 +801,44 @@ static void XMLCALL endElement(void *context, const char *elm) {
                  CoSimulation *cs = NULL;     // NULL or CoSimulation
                  ListElement* child;
 
-                 child = checkPop(ANY_TYPE);
+                 child = checkPop(ps, ANY_TYPE);
                  if (child->type == elm_CoSimulation_StandAlone || child->type == elm_CoSimulation_Tool) {
                      cs = (CoSimulation*)child;
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_ModelVariables){
                      mv = (ScalarVariable**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_VendorAnnotations){
                      va = (ListElement**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_DefaultExperiment){
                      de = (Element*)child;
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_TypeDefinitions){
                      td = (Type**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_UnitDefinitions){
                      ud = (ListElement**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  // work around bug of SimulationX 3.4 and 3.5 which places Implementation at wrong location 
                  if (!cs && (child->type == elm_CoSimulation_StandAlone || child->type == elm_CoSimulation_Tool)) {
                      cs = (CoSimulation*)child;
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
-                 if (!checkElementType(child, elm_fmiModelDescription)) return;
+                 if (!checkElementType(ps, child, elm_fmiModelDescription)) return;
                  md = (ModelDescription*)child;
                  md->modelVariables = mv;
                  md->vendorAnnotations = va;
@@ -563,46 +846,45 @@ static void XMLCALL endElement(void *context, const char *elm) {
                  md->typeDefinitions = td;
                  md->unitDefinitions = ud;
                  md->cosimulation = cs;
-                 stackPush(stack, md);
+                 stackPush(ps->stack, md);
                  break;
             }
         case elm_Implementation:
             {
                  // replace Implementation element
-                 void* cs = checkPop(ANY_TYPE);
-                 void* im = checkPop(elm_Implementation);
-                 stackPush(stack, cs);
-                 free(im);
+                 void* cs = checkPop(ps, ANY_TYPE);
+                 checkPop(ps, elm_Implementation); // released with the arena
+                 stackPush(ps->stack, cs);
                  el = ((Element*)cs)->type;
                  break;
             }
         case elm_CoSimulation_StandAlone:  
             {
-                 Element* ca = checkPop(elm_Capabilities);
-                 CoSimulation* cs = checkPop(elm_CoSimulation_StandAlone);
+                 Element* ca = checkPop(ps, elm_Capabilities);
+                 CoSimulation* cs = checkPop(ps, elm_CoSimulation_StandAlone);
                  if (!ca || !cs) return;
                  cs->capabilities = ca;
-                 stackPush(stack, cs);
+                 stackPush(ps->stack, cs);
                  break;
             }   
         case elm_CoSimulation_Tool:
             {
-                 ListElement* mo = checkPop(elm_Model);
-                 Element* ca = checkPop(elm_Capabilities);
-                 CoSimulation* cs = checkPop(elm_CoSimulation_Tool);
+                 ListElement* mo = checkPop(ps, elm_Model);
+                 Element* ca = checkPop(ps, elm_Capabilities);
+                 CoSimulation* cs = checkPop(ps, elm_CoSimulation_Tool);
                  if (!ca || !mo || !cs) return;
                  cs->capabilities = ca;
                  cs->model = mo;
-                 stackPush(stack, cs);
+                 stackPush(ps->stack, cs);
                  break;
             }   
         case elm_Type:
             {
                 Type* tp;
-                Element* ts = checkPop(ANY_TYPE);
+                Element* ts = checkPop(ps, ANY_TYPE);
                 if (!ts) return;
-                if (!checkPeek(elm_Type)) return;
-                tp = (Type*)stackPeek(stack);
+                if (!checkPeek(ps, elm_Type)) return;
+                tp = (Type*)stackPeek(ps->stack);
                 switch (ts->type) {
                     case elm_RealType:
                     case elm_IntegerType:
@@ -611,7 +893,7 @@ static void XMLCALL endElement(void *context, const char *elm) {
                     case elm_EnumerationType:
                         break;
                     default:
-                         logFatalTypeError("RealType or similar", ts->type);
+                         logFatalTypeError(ps, "RealType or similar", ts->type);
                          return;
                 }
                 tp->typeSpec = ts;
@@ -620,17 +902,17 @@ static void XMLCALL endElement(void *context, const char *elm) {
         case elm_ScalarVariable:
             {
                 ScalarVariable* sv;
+                ValueStatus vs;
                 Element** list = NULL;
-                Element* child = checkPop(ANY_TYPE);
+                Element* child = checkPop(ps, ANY_TYPE);
                 if (!child) return;
                 if (child->type==elm_DirectDependency){
                     list = ((ListElement*)child)->list;
-                    free(child);
-                    child = checkPop(ANY_TYPE);
+                    child = checkPop(ps, ANY_TYPE);
                     if (!child) return;
                 }
-                if (!checkPeek(elm_ScalarVariable)) return;
-                sv = (ScalarVariable*)stackPeek(stack);
+                if (!checkPeek(ps, elm_ScalarVariable)) return;
+                sv = (ScalarVariable*)stackPeek(ps->stack);
                 switch (child->type) {
                     case elm_Real:
                     case elm_Integer:
@@ -639,35 +921,39 @@ static void XMLCALL endElement(void *context, const char *elm) {
                     case elm_Enumeration:
                         break;
                     default:
-                         logFatalTypeError("Real or similar", child->type);
+                         logFatalTypeError(ps, "Real or similar", child->type);
                          return;
                 }
                 sv->directDependencies = list;
                 sv->typeSpec = child;
+                sv->vr = getUInt(sv, att_valueReference, &vs); // checked by validate
                 break;
             }
-        case elm_ModelVariables:    popList(elm_ScalarVariable); break;
-        case elm_VendorAnnotations: popList(elm_Tool);break;
-        case elm_Tool:              popList(elm_Annotation); break;
-        case elm_TypeDefinitions:   popList(elm_Type); break;
-        case elm_EnumerationType:   popList(elm_Item); break;
-        case elm_UnitDefinitions:   popList(elm_BaseUnit); break;
-        case elm_BaseUnit:          popList(elm_DisplayUnitDefinition); break;
-        case elm_DirectDependency:  popList(elm_Name); break;
-        case elm_Model:             popList(elm_File); break;
+        case elm_ModelVariables:    popList(ps, elm_ScalarVariable); break;
+        case elm_VendorAnnotations: popList(ps, elm_Tool);break;
+        case elm_Tool:              popList(ps, elm_Annotation); break;
+        case elm_TypeDefinitions:   popList(ps, elm_Type); break;
+        case elm_EnumerationType:   popList(ps, elm_Item); break;
+        case elm_UnitDefinitions:   popList(ps, elm_BaseUnit); break;
+        case elm_BaseUnit:          popList(ps, elm_DisplayUnitDefinition); break;
+        case elm_DirectDependency:  popList(ps, elm_Name); break;
+        case elm_Model:             popList(ps, elm_File); break;
         case elm_Name:
             {
                  // Exception: the name value is represented as element content.
                  // All other values of the XML file are represented using attributes.
-                 Element* name = checkPop(elm_Name);
+                 Element* name = checkPop(ps, elm_Name);
                  if (!name) return;
                  name->n = 2;
-                 name->attributes = malloc(2*sizeof(char*));
+                 name->attMask = 1ULL << att_input;
+                 name->attributes = arenaAlloc(ps->arena, 2*sizeof(char*));
+                 if (!checkPointer(ps, name->attributes)) return;
                  name->attributes[0] = attNames[att_input];
-                 name->attributes[1] = data;
-                 data = NULL;
-                 skipData = 1; // stop recording element content
-                 stackPush(stack, name);
+                 name->attributes[1] = ps->data ? arenaStrdup(ps->arena, ps->data) : NULL;
+                 free(ps->data);
+                 ps->data = NULL;
+                 ps->skipData = 1; // stop recording element content
+                 stackPush(ps->stack, name);
                  break;
             }
 
@@ -680,24 +966,22 @@ static void XMLCALL endElement(void *context, const char *elm) {
                  Connection** conns = NULL;     // list of Connections
                  ListElement* child;
 				
-                 child = checkPop(ANY_TYPE);
+                 child = checkPop(ps, ANY_TYPE);
                  if (child->type == elm_Connections){
                      conns = (Connection**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_Components){
                      comps = (Component**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
-                 if (!checkElementType(child, elm_Graph)) return;
+                 if (!checkElementType(ps, child, elm_Graph)) return;
                  graph = (Graph*)child;
                  graph->components = comps;
                  graph->connections = conns;
-                 stackPush(stack, graph);
+                 stackPush(ps->stack, graph);
                  break;
             }
         case elm_Component:
@@ -707,46 +991,46 @@ static void XMLCALL endElement(void *context, const char *elm) {
                  Port**         outs = NULL;
                  ListElement*   child;
 
-                 child = checkPop(ANY_TYPE);
+                 child = checkPop(ps, ANY_TYPE);
                  if (!child) return;
                  if (child->type == elm_Outputs){
                      outs = (Port**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_Inputs){
                      ins = (Port**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ps, ANY_TYPE);
                      if (!child) return;
                  }
-                 if (!checkElementType(child, elm_Component)) return;
+                 if (!checkElementType(ps, child, elm_Component)) return;
                  component = (Component*)child;
                  component->inputs = ins;
                  component->outputs = outs;
                  component->fmu = NULL;
-                 stackPush(stack, component);
+                 component->recorded = NULL;
+                 stackPush(ps->stack, component);
                  break;
             }
-        case elm_Components:        popList(elm_Component); break;
-        case elm_Inputs:            popList(elm_Port); break;
-        case elm_Outputs:           popList(elm_Port); break;
-        case elm_Connections:       popList(elm_Connection); break;
+        case elm_Components:        popList(ps, elm_Component); break;
+        case elm_Inputs:            popList(ps, elm_Port); break;
+        case elm_Outputs:           popList(ps, elm_Port); break;
+        case elm_Connections:       popList(ps, elm_Connection); break;
         case elm_Connection:
             {
-                Connection* con = checkPop(elm_Connection);
+                Connection* con = checkPop(ps, elm_Connection);
                 if (!con) return;
-                con->value = NULL;
-                stackPush(stack, con);
+                con->valueType = enu_none;
+                con->signal = -1;
+                stackPush(ps->stack, con);
                 break;
             }
         case elm_Port:
             {
-                Port* port = checkPop(elm_Port);
+                Port* port = checkPop(ps, elm_Port);
                 if (!port) return;
                 port->connection = NULL;
-                stackPush(stack, port);
+                stackPush(ps->stack, port);
                 break;
             }
 
@@ -757,7 +1041,7 @@ static void XMLCALL endElement(void *context, const char *elm) {
     }
     // All children of el removed from the stack.
     // The top element must be of type el now.
-    checkPeek(el);
+    checkPeek(ps, el);
 }
 
 // Called to handle element data, e.g. "xy" in <Name>xy</Name>
@@ -766,25 +1050,26 @@ static void XMLCALL endElement(void *context, const char *elm) {
 // For some reason, if the element data is the empty string (Eg. <a></a>)
 // instead of an empty string with len == 0 we get "\n". The workaround is
 // to replace this with the empty string whenever we encounter "\n".
-void XMLCALL handleData(void *context, const XML_Char *s, int len) {
+static void XMLCALL handleData(void *context, const XML_Char *s, int len) {
+    ParserContext* ps = (ParserContext*)context;
     int n;
-    if (skipData) return;
-    if (!data) {
+    if (ps->skipData) return;
+    if (!ps->data) {
         // start a new data string
         if (len == 1 && s[0] == '\n') {
-            data = strdup("");
+            ps->data = strdup("");
         } else {
-            data = malloc(len + 1);
-            strncpy(data, s, len);
-            data[len] = '\0';
+            ps->data = malloc(len + 1);
+            strncpy(ps->data, s, len);
+            ps->data[len] = '\0';
         }
     }
     else {
         // continue existing string
-        n = strlen(data) + len;
-        data = realloc(data, n+1);
-        strncat(data, s, len);
-        data[n] = '\0';
+        n = strlen(ps->data) + len;
+        ps->data = realloc(ps->data, n+1);
+        strncat(ps->data, s, len);
+        ps->data[n] = '\0';
     }
     return;
 }
@@ -870,81 +1155,23 @@ static void printList(int indent, void** list){
 // ------------------------------------------------------------------------- 
 // free memory of the AST
 
-static void freeList(void** list);
-
+// Release the AST with the given root, as returned by parse or parseGraph.
+// All nodes, attribute arrays and strings of an AST are allocated from the
+// arena of its root, so they are released at once. For all other elements,
+// memory is released together with the root.
 void freeElement(void* element){
-    int i;
     Element* e = (Element*)element;
     if (!e) return;
-    // free attributes
-    for (i=0; i<e->n; i+=2) 
-        free((void*)e->attributes[i+1]);
-    if (e->attributes) free(e->attributes);
-    // free child nodes
-    switch (getAstNodeType(e->type)) {
-        case astElement:
-	    // Add an empty case here to avoid warnings from -Wall
-	    // The element e gets freed elsewhere, if we free it
-	    // here,  we get warnings
-	    //freeElement((void**)(Element*)e);
+    switch (e->type) {
+        case elm_fmiModelDescription:
+            arenaFree(((ModelDescription*)e)->arena);
             break;
-        case astListElement:
-            freeList((void*)((ListElement*)e)->list);
+        case elm_Graph:
+            arenaFree(((Graph*)e)->arena);
             break;
-        case astScalarVariable:
-            freeList((void*)((ScalarVariable*)e)->directDependencies);
-        case astType:
-            freeElement(((Type*)e)->typeSpec);
+        default:
             break;
-        case astCoSimulation: {
-            CoSimulation* cs = (CoSimulation*)e;
-            freeElement(cs->capabilities);
-            freeElement(cs->model);
-            break;
-        }
-        case astModelDescription: {
-            ModelDescription* md = (ModelDescription*)e;
-            freeList((void*)md->unitDefinitions);
-            freeList((void*)md->typeDefinitions);
-            freeElement(md->defaultExperiment);
-            freeList((void*)md->vendorAnnotations);
-            freeList((void*)md->modelVariables);
-            freeElement(md->cosimulation);
-            break;
-       }
-
-        // component diagram:
-        case astComponent: {
-            Component* nd = (Component*)e;
-            freeList((void*)nd->inputs);
-            freeList((void*)nd->outputs);
-            break;
-        }
-        case astConnection: {
-            free(((Connection*)e)->value);
-            break;
-        }
-        case astPort: {
-            //TODO
-            break;
-        }
-        case astGraph: {
-            Graph* g = (Graph*)e;
-            freeList((void*)g->components);
-            freeList((void*)g->connections);
-            break;
-       }
     }
-    // free the struct
-    free(e);
-}
-
-static void freeList(void** list){
-    int i;
-    if (!list) return;
-    for (i=0; list[i]; i++) 
-        freeElement(list[i]);
-    free(list);
 }
 
 // ------------------------------------------------------------------------- 
@@ -958,13 +1185,30 @@ ModelDescription* validate(ModelDescription* md) {
         ScalarVariable* sv = (ScalarVariable*)md->modelVariables[i];
         const char* declaredType = getString(sv->typeSpec, att_declaredType);
         Type* decltype = getDeclaredType(md, declaredType);
+        ValueStatus vs;
+        if (!getString(sv, att_name)) {
+            logPrintf("Warning: Variable %d has no name in modelDescription.xml\n", i + 1);
+            error++;
+            continue;
+        }
         if (declaredType && decltype==NULL) {
-            printf("Warning: Declared type %s of variable %s not found in modelDescription.xml\n", declaredType, getName(sv));
+            logPrintf("Warning: Declared type %s of variable %s not found in modelDescription.xml\n", declaredType, getName(sv));
+            error++;
+        }
+        if (sv->vr == fmiUndefinedValueReference) getUInt(sv, att_valueReference, &vs);
+        else vs = valueDefined;
+        if (vs != valueDefined) {
+            logPrintf("Warning: Variable %s has no valid valueReference in modelDescription.xml\n", getName(sv));
             error++;
         }
     }
     if (error) {
-        printf("Error: Found %d error in modelDescription.xml\n", error);
+        logPrintf("Error: Found %d error in modelDescription.xml\n", error);
+        return NULL;
+    }
+    md->index = indexVariables(md);
+    if (!md->index) {
+        logPrintf("Out of memory\n");
         return NULL;
     }
     return md;
@@ -975,14 +1219,46 @@ ModelDescription* validate(ModelDescription* md) {
 // Graph validation - done after parsing to report all errors
 
 
-static Connection* getConnectionByName(Graph* graph, const char* connectionName){
+// Hash index of the connections of a graph by name, built by validateGraph.
+// Open addressing with linear probing, like VariableTable: each slot holds
+// the index + 1 of a connection, 0 if empty.
+typedef struct {
+    int* slots;
+    unsigned int mask;          // number of slots - 1
+    int* types;                 // per connection: the enu_ type of its value, -1 if none
+} ConnectionIndex;
+
+// Returns 0 to indicate failure
+// If several connections have the same name, the first one is found, as by a scan.
+static int indexConnections(Graph* graph, ConnectionIndex* index, int n) {
+    unsigned int size = 16;
+    unsigned int h;
     int i;
-    if (connectionName && graph->connections)
-    for (i=0; graph->connections[i]; i++){
-        Connection* con = graph->connections[i];
-        if (!strcmp(connectionName, getName(con))) return con;
+    while (size < 2 * (unsigned int)n) size *= 2;
+    index->slots = (int*)calloc(size, sizeof(int));
+    index->types = (int*)malloc((n + 1) * sizeof(int));
+    index->mask = size - 1;
+    if (!index->slots || !index->types) return 0;
+    for (i=0; i<n; i++) {
+        const char* name = getString(graph->connections[i], att_name);
+        index->types[i] = -1;
+        if (!name) continue;
+        for (h = hashName(name, 0) & index->mask; index->slots[h]; h = (h + 1) & index->mask) {
+            if (!strcmp(getName(graph->connections[index->slots[h] - 1]), name)) break;
+        }
+        if (!index->slots[h]) index->slots[h] = i + 1;
     }
-    return NULL;
+    return 1;
+}
+
+// Returns -1 if there is no connection with the given name
+static int lookupConnection(Graph* graph, ConnectionIndex* index, const char* name) {
+    unsigned int h;
+    if (!name) return -1;
+    for (h = hashName(name, 0) & index->mask; index->slots[h]; h = (h + 1) & index->mask) {
+        if (!strcmp(getName(graph->connections[index->slots[h] - 1]), name)) return index->slots[h] - 1;
+    }
+    return -1;
 }
 
 // returns one of: real, integer, boolean, string, none
@@ -991,41 +1267,36 @@ static Enu getPortType(void* port) {
     return getEnumValue(port, att_type, &vs);
 }
 
+// Returns the size of a value of the given port type, 0 if the type is illegal
+static size_t portValueSize(Enu type) {
+    switch (type) {
+        case enu_Real:    return sizeof(fmiReal);
+        case enu_Integer: return sizeof(fmiInteger);
+        case enu_Boolean: return sizeof(fmiBoolean);
+        case enu_String:  return sizeof(fmiString);
+        default:          return 0;
+    }
+}
+
 // validates port's connection attribute for declared connection
 // assigns connection to a port if valid, otherwise increases the error count
-static void validatePortConnection(Graph* graph, Port* port, int* error) {
+// The type of the connection's value is taken from its first port of a
+// legal type, its signal index is assigned by numberSignals.
+static void validatePortConnection(Graph* graph, ConnectionIndex* index, Port* port, int* error) {
     const char* conName = getString(port, att_connection);  //TODO: add null-validation
-    Connection* con = getConnectionByName(graph, conName);
-    if (conName && con==NULL) {
-        printf("Warning: Declared connection %s of linked port %s not found in connection diagram file\n", conName, getName(port));
+    int i = lookupConnection(graph, index, conName);
+    if (conName && i < 0) {
+        logPrintf("Warning: Declared connection %s of linked port %s not found in connection diagram file\n", conName, getName(port));
         (*error)++;
-    } else if (con) {
+    } else if (i >= 0) {
         // check port type
-        // allocate type variable
-        if (!con->value) {
-            void* value = NULL;
+        Connection* con = graph->connections[i];
+        if (index->types[i] < 0) {
             Enu type = getPortType(port);
-            switch (type) {
-                case enu_Real:
-                    value = calloc(1, sizeof(fmiReal));
-                    break;
-                case enu_Integer:
-                    value = calloc(1, sizeof(fmiInteger));
-                    break;
-                case enu_Boolean:
-                    value = calloc(1, sizeof(fmiBoolean));
-                    break;
-                case enu_String:
-                    value = calloc(1, sizeof(fmiString));
-                    break;
-                default:
-                    printf("Warning: Declared port %s has illegal type %s\n", getName(port), getString(port, att_type));
-                    (*error)++;
-            }
-            if (value) {
-                con->value = value;
-            } else if (type != -1) {
-                printf("Error: Value allocation failed for port %s\n", getName(port));
+            if (portValueSize(type)) {
+                index->types[i] = type;
+            } else {
+                logPrintf("Warning: Declared port %s has illegal type %s\n", getName(port), getString(port, att_type));
                 (*error)++;
             }
         }
@@ -1033,31 +1304,73 @@ static void validatePortConnection(Graph* graph, Port* port, int* error) {
     }
 }
 
-// validates the graph for valid port connections
+// Sets the value type of the n connections and numbers the connections
+// of each type in document order, so that a simulator can keep the values
+// of each type in one array indexed by signal.
+static void numberSignals(Graph* graph, ConnectionIndex* index, int n) {
+    int count[4] = { 0, 0, 0, 0 }; // per type Real, Integer, Boolean, String
+    int i, t;
+    for (i=0; i<n; i++) {
+        Connection* con = graph->connections[i];
+        con->valueType = index->types[i] < 0 ? enu_none : (Enu)index->types[i];
+        switch (con->valueType) {
+            case enu_Real:    t = 0; break;
+            case enu_Integer: t = 1; break;
+            case enu_Boolean: t = 2; break;
+            case enu_String:  t = 3; break;
+            default:          t = -1; break;
+        }
+        con->signal = t < 0 ? -1 : count[t]++;
+    }
+}
+
+// validates the graph for valid port connections and step ratios
+// Runs in time linear in the number of ports and connections.
 //TODO: add more validation i.e. missing attributes, port types etc.
 Graph* validateGraph(Graph* graph) {
     int error = 0;
-    int i,n;
+    int i,n,nCons = 0;
     Port** ports;
+    ConnectionIndex index;
+    ValueStatus vs;
 
+    if (graph->connections) {
+        for (; graph->connections[nCons]; nCons++);
+    }
+    if (!indexConnections(graph, &index, nCons)) {
+        logPrintf("Out of memory\n");
+        free(index.slots);
+        free(index.types);
+        return NULL;
+    }
     for (i=0; graph->components[i]; i++) {
+        // check the optional number of communication steps per step of the component
+        n = getInt(graph->components[i], att_stepRatio, &vs);
+        if (vs == valueIllegal || (vs == valueDefined && n < 1)) {
+            logPrintf("Warning: Component %s has illegal stepRatio %s\n",
+                    getString(graph->components[i], att_modelName), getString(graph->components[i], att_stepRatio));
+            error++;
+        }
         // check output ports' connections
         ports = graph->components[i]->outputs;
         if (ports) {
             for (n=0; ports[n]; n++) {
-                validatePortConnection(graph, ports[n], &error);
+                validatePortConnection(graph, &index, ports[n], &error);
             }
         }
         // check input ports' connections
         ports = graph->components[i]->inputs;
         if (ports) {
             for (n=0; ports[n]; n++) {
-                validatePortConnection(graph, ports[n], &error);
+                validatePortConnection(graph, &index, ports[n], &error);
             }
         }
     }
+    numberSignals(graph, &index, nCons);
+    free(index.slots);
+    free(index.types);
     if (error) {
-        printf("Error: Found %d error(s) in component diagram file\n", error);
+        logPrintf("Error: Found %d error(s) in component diagram file\n", error);
         return NULL;
     }
     return graph;
@@ -1066,89 +1379,340 @@ Graph* validateGraph(Graph* graph) {
 // ------------------------------------------------------------------------- 
 // Entry function parse() of the XML parser 
 
-static void cleanup(FILE *file) {
-    stackFree(stack);
-    stack = NULL;
-    XML_ParserFree(parser);
-    parser = NULL;
-    fclose(file);
+static Tokenizer defaultTokenizer = tokenizerExpat;
+
+// Let contexts created later use tokenizer t, e.g. by parse().
+// To be called before threads are started.
+void setDefaultTokenizer(Tokenizer t) {
+    defaultTokenizer = t;
+}
+
+// Let ctx use tokenizer t for files. Documents in memory are always
+// tokenized by expat, as are files not supported by the in-situ tokenizer.
+void parserContextSetTokenizer(ParserContext* ctx, Tokenizer t) {
+    ctx->tokenizer = t;
 }
 
 // Returns NULL to indicate failure
-// Otherwise, return the root node md of the AST.
-// The receiver must call freeElement(md) to release AST memory.
-ModelDescription* parse(const char* xmlPath) {
-    ModelDescription* md = NULL;
-    FILE *file;
-    int done = 0;
-    stack = stackNew(100, 10);
-    if (!checkPointer(stack)) return NULL;  // failure
-    parser = XML_ParserCreate(NULL);
-    if (!checkPointer(parser)) return NULL;  // failure
-    XML_SetElementHandler(parser, startElement, endElement);
-    XML_SetCharacterDataHandler(parser, handleData);
-  	file = fopen(xmlPath, "rb");
-	if (file == NULL) {
-        printf("Cannot open file '%s'\n", xmlPath);
-     	XML_ParserFree(parser);
+// The context can be used for any number of documents, but only by
+// one thread at a time. Release it with parserContextFree.
+ParserContext* parserContextNew() {
+    ParserContext* ps = (ParserContext*)calloc(1, sizeof(ParserContext));
+    if (!checkPointer(NULL, ps)) return NULL;  // failure
+    ps->tokenizer = defaultTokenizer;
+    ps->stack = stackNew(100, 10);
+    ps->parser = XML_ParserCreate(NULL);
+    if (!checkPointer(NULL, ps->stack) || !checkPointer(NULL, ps->parser)) {
+        parserContextFree(ps);
+        return NULL;  // failure
+    }
+    return ps;
+}
+
+void parserContextFree(ParserContext* ps) {
+    if (!ps) return;
+    if (ps->stack) stackFree(ps->stack);
+    if (ps->parser) XML_ParserFree(ps->parser);
+    xmlScannerFree(ps->scanner);
+    arenaFree(ps->arena);
+    free(ps->data);
+    free(ps->selected);
+    free(ps);
+}
+
+// Returns 0 to indicate failure
+// Let the following model descriptions parsed with ctx keep only the
+// variables with the given names, names is NULL or null-terminated.
+// The unit definitions and vendor annotations are skipped as well.
+// All other elements, e.g. the attributes of fmiModelDescription with the
+// number of states and event indicators, type definitions and capabilities
+// are kept. Skipped subtrees are not checked. The names must stay valid
+// while ctx is used, NULL selects all variables again.
+int parserContextSelect(ParserContext* ctx, const char** names) {
+    unsigned int h, size = 16;
+    int i, n;
+    free(ctx->selected);
+    ctx->selected = NULL;
+    ctx->selectedMask = 0;
+    if (!names) return 1; // success
+    for (n=0; names[n]; n++);
+    while (size < 2 * (unsigned int)n) size *= 2;
+    ctx->selected = (const char**)calloc(size, sizeof(const char*));
+    if (!checkPointer(NULL, ctx->selected)) return 0; // failure
+    ctx->selectedMask = size - 1;
+    for (i=0; i<n; i++) {
+        for (h = hashName(names[i], 0) & ctx->selectedMask; ctx->selected[h]; h = (h + 1) & ctx->selectedMask) {
+            if (!strcmp(ctx->selected[h], names[i])) break;
+        }
+        ctx->selected[h] = names[i];
+    }
+    return 1; // success
+}
+
+// Number of variables skipped in the last document parsed with ctx,
+// see parserContextSelect
+int parserContextSkipped(ParserContext* ctx) {
+    return ctx->nSkipped;
+}
+
+// Returns 0 to indicate failure
+// Prepare the context for a new document
+static int beginParse(ParserContext* ps) {
+#ifndef NDEBUG
+    checkNameTablesOnce();
+#endif
+    if (!XML_ParserReset(ps->parser, NULL)) {
+        logPrintf("Could not reset the XML parser\n");
+        return 0;  // failure
+    }
+    XML_SetUserData(ps->parser, ps);
+    XML_SetElementHandler(ps->parser, startElement, endElement);
+    XML_SetCharacterDataHandler(ps->parser, handleData);
+    ps->stack->stackPos = -1;  // elements left by a failed document live in its arena
+    free(ps->data);
+    ps->data = NULL;
+    ps->skipData = 0;
+    ps->skipDepth = 0;
+    ps->nSkipped = 0;
+    ps->inSitu = 0;
+    ps->stopped = 0;
+    ps->arena = arenaNew();
+    return checkPointer(NULL, ps->arena);
+}
+
+// Release the AST of a failed document
+static void abortParse(ParserContext* ps) {
+    arenaFree(ps->arena);
+    ps->arena = NULL;
+}
+
+// Returns 0 to indicate failure
+// Parse the next n chars of the XML document named name. done is 1 for the
+// last chunk.
+static int parseChunk(ParserContext* ps, const char* text, int n, int done, const char* name) {
+    if (XML_Parse(ps->parser, text, n, done)) return 1; // success
+    logPrintf("Parse error in file %s at line %d:\n%s\n",
+            name,
+            (int)XML_GetCurrentLineNumber(ps->parser),
+            XML_ErrorString(XML_GetErrorCode(ps->parser)));
+    return 0; // failure
+}
+
+// Returns NULL to indicate failure
+// Returns the root node of the AST, which takes over the arena
+static void* finishParse(ParserContext* ps) {
+    Element* root = stackPop(ps->stack);
+    assert(stackIsEmpty(ps->stack));
+    switch (root->type) {
+        case elm_fmiModelDescription:
+            ((ModelDescription*)root)->arena = ps->arena;
+            break;
+        case elm_Graph:
+            ((Graph*)root)->arena = ps->arena;
+            break;
+        default:
+            logPrintf("Illegal root element %s\n", elmNames[root->type]);
+            abortParse(ps);
+            return NULL;
+    }
+    ps->arena = NULL;
+    //printElement(1, root); // debug
+    return root;
+}
+
+#ifndef _MSC_VER
+// Line of the char at the given offset of file xmlPath, for error messages.
+// The mapped document was changed by the in-situ tokenizer.
+// Like expat, counts "\r\n", "\r" and "\n" as line ends.
+static int lineOfOffset(const char* xmlPath, size_t offset) {
+    char text[XMLBUFSIZE];
+    char last = 0;
+    int line = 1;
+    size_t i, n;
+    FILE* file = fopen(xmlPath, "rb");
+    if (!file) return 0;
+    while (offset > 0 && (n = fread(text, sizeof(char), XMLBUFSIZE, file)) > 0) {
+        if (n > offset) n = offset;
+        for (i = 0; i < n; i++) {
+            line += text[i] == '\r' || (text[i] == '\n' && last != '\r');
+            last = text[i];
+        }
+        offset -= n;
+    }
+    fclose(file);
+    return line;
+}
+
+// Returns NULL to indicate failure, sets *supported to 0 if the in-situ
+// tokenizer does not support the file, see xml_scanner.h.
+// Otherwise, return the root node of the AST of the given XML file.
+// The file is mapped privately and tokenized in place. Attribute values
+// point into the mapping, which is released together with the arena.
+static void* parseFileInSitu(ParserContext* ps, const char* xmlPath, int* supported) {
+    struct stat st;
+    char* text;
+    size_t n;
+    int fd = open(xmlPath, O_RDONLY);
+    *supported = 1;
+    if (fd < 0) {
+        logPrintf("Cannot open file '%s'\n", xmlPath);
         return NULL; // failure
     }
-    while (!done) {
-        int n = fread(text, sizeof(char), XMLBUFSIZE, file);
-	    if (n != XMLBUFSIZE) done = 1;
-        if (!XML_Parse(parser, text, n, done)){
-             printf("Parse error in file %s at line %d:\n%s\n", 
-                     xmlPath,
-                     (int)XML_GetCurrentLineNumber(parser),
-                     XML_ErrorString(XML_GetErrorCode(parser)));
-             while (! stackIsEmpty(stack)) md = stackPop(stack);
-             if (md) freeElement(md);
-             cleanup(file);
-             return NULL; // failure
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        *supported = 0; // let expat report the empty document
+        return NULL;
+    }
+    n = (size_t)st.st_size;
+    text = (char*)mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        logPrintf("Cannot map file '%s'\n", xmlPath);
+        return NULL; // failure
+    }
+    if (!ps->scanner) ps->scanner = xmlScannerNew();
+    if (ps->scanner && !xmlScannerReset(ps->scanner, text, n)) *supported = 0;
+    if (!checkPointer(NULL, ps->scanner) || !*supported || !beginParse(ps)) {
+        munmap(text, n);
+        return NULL; // failure
+    }
+    ps->arena->mapped = text;
+    ps->arena->mappedSize = n;
+    ps->inSitu = 1;
+    for (;;) {
+        XmlScanner* s = ps->scanner;
+        switch (xmlScannerNext(s)) {
+            case tokStartElement: startElement(ps, s->name, s->attributes); break;
+            case tokEndElement:   endElement(ps, s->name); break;
+            case tokText:
+                // expat reports a leading line end separately, see handleData
+                if (s->len > 1 && s->text[0] == '\n') {
+                    handleData(ps, s->text, 1);
+                    handleData(ps, s->text + 1, s->len - 1);
+                }
+                else handleData(ps, s->text, s->len);
+                break;
+            case tokEndOfDocument: return finishParse(ps);
+            case tokError:        stopParser(ps); break;
+        }
+        if (ps->stopped) {
+            logPrintf("Parse error in file %s at line %d:\n%s\n", xmlPath,
+                lineOfOffset(xmlPath, s->pos - s->start), s->error ? s->error : "parsing aborted");
+            abortParse(ps);
+            return NULL; // failure
         }
     }
-    md = stackPop(stack);
-    assert(stackIsEmpty(stack));
-    cleanup(file);
-    //printElement(1, md); // debug
-    return validate(md); // success if all refs are valid    
 }
+#endif
 
-Graph* parseGraph(const char* xmlPath) {
-    Graph* g = NULL;
+// Returns NULL to indicate failure
+// Otherwise, return the root node of the AST of the given XML file.
+static void* parseFile(ParserContext* ps, const char* xmlPath) {
+    char text[XMLBUFSIZE];       // XML file is parsed in chunks of length XMLBUFZIZE
     FILE *file;
     int done = 0;
-    stack = stackNew(100, 10);
-    if (!checkPointer(stack)) return NULL;  // failure
-    parser = XML_ParserCreate(NULL);
-    if (!checkPointer(parser)) return NULL;  // failure
-    XML_SetElementHandler(parser, startElement, endElement);
-    XML_SetCharacterDataHandler(parser, handleData);
-  	file = fopen(xmlPath, "rb");
-	if (file == NULL) {
-        printf("Cannot open file '%s'\n", xmlPath);
-     	XML_ParserFree(parser);
+#ifndef _MSC_VER
+    if (ps->tokenizer == tokenizerInSitu) {
+        int supported;
+        void* root = parseFileInSitu(ps, xmlPath, &supported);
+        if (root || supported) return root;
+    }
+#endif
+    file = fopen(xmlPath, "rb");
+    if (file == NULL) {
+        logPrintf("Cannot open file '%s'\n", xmlPath);
+        return NULL; // failure
+    }
+    if (!beginParse(ps)) {
+        fclose(file);
         return NULL; // failure
     }
     while (!done) {
         int n = fread(text, sizeof(char), XMLBUFSIZE, file);
-	    if (n != XMLBUFSIZE) done = 1;
-        if (!XML_Parse(parser, text, n, done)){
-             printf("Parse error in file %s at line %d:\n%s\n", 
-                     xmlPath,
-                     (int)XML_GetCurrentLineNumber(parser),
-                     XML_ErrorString(XML_GetErrorCode(parser)));
-             while (! stackIsEmpty(stack)) g = stackPop(stack);
-             if (g) freeElement(g);
-             cleanup(file);
+        if (n != XMLBUFSIZE) done = 1;
+        if (!parseChunk(ps, text, n, done, xmlPath)) {
+             abortParse(ps);
+             fclose(file);
              return NULL; // failure
         }
     }
-    g = stackPop(stack);
-    assert(stackIsEmpty(stack));
-    cleanup(file);
-    //printElement(1, md); // debug
-    return validateGraph(g); // success if all refs are valid    
+    fclose(file);
+    return finishParse(ps);
 }
 
+// Returns NULL to indicate failure
+// Validates md, which is released on failure
+static ModelDescription* validateOrFree(ModelDescription* md) {
+    double start = monotonicTime();
+    if (!validate(md)) { // success if all refs are valid
+        freeElement(md);
+        md = NULL;
+    }
+    timingsAdd(phase_validate, start);
+    return md;
+}
+
+// Returns NULL to indicate failure
+// Otherwise, return the root node md of the AST of the model description
+// held in memory, e.g. read from an FMU by zipReadEntry. name is used
+// in error messages only.
+// The receiver must call freeElement(md) to release AST memory.
+ModelDescription* parseBufferWithContext(ParserContext* ps, const char* text, size_t n, const char* name) {
+    ModelDescription* md = NULL;
+    double start = monotonicTime();
+    if (beginParse(ps)) {
+        if (parseChunk(ps, text, (int)n, 1, name)) md = finishParse(ps);
+        else abortParse(ps);
+    }
+    timingsAdd(phase_parse, start);
+    return md ? validateOrFree(md) : NULL;
+}
+
+// Returns NULL to indicate failure
+// Otherwise, return the root node md of the AST.
+// The receiver must call freeElement(md) to release AST memory.
+ModelDescription* parseWithContext(ParserContext* ps, const char* xmlPath) {
+    double start = monotonicTime();
+    ModelDescription* md = parseFile(ps, xmlPath);
+    timingsAdd(phase_parse, start);
+    return md ? validateOrFree(md) : NULL;
+}
 
+Graph* parseGraphWithContext(ParserContext* ps, const char* xmlPath) {
+    Graph* g = parseFile(ps, xmlPath);
+    if (!g) return NULL;
+    if (!validateGraph(g)) { // success if all refs are valid
+        freeElement(g);
+        return NULL;
+    }
+    return g;
+}
+
+// The functions below use a private context for a single document
+
+ModelDescription* parseBuffer(const char* text, size_t n, const char* name) {
+    ModelDescription* md;
+    ParserContext* ps = parserContextNew();
+    if (!ps) return NULL; // failure
+    md = parseBufferWithContext(ps, text, n, name);
+    parserContextFree(ps);
+    return md;
+}
+
+ModelDescription* parse(const char* xmlPath) {
+    ModelDescription* md;
+    ParserContext* ps = parserContextNew();
+    if (!ps) return NULL; // failure
+    md = parseWithContext(ps, xmlPath);
+    parserContextFree(ps);
+    return md;
+}
+
+Graph* parseGraph(const char* xmlPath) {
+    Graph* g;
+    ParserContext* ps = parserContextNew();
+    if (!ps) return NULL; // failure
+    g = parseGraphWithContext(ps, xmlPath);
+    parserContextFree(ps);
+    return g;
+}
@@ -13,6 +13,7 @@
 #define XML_STATIC 
 #include "expat.h"
 #include "stack.h"
+#include "arena.h"
 
 #ifndef fmiModelTypes_h
 #ifndef fmiPlatformTypes_h
@@ -29,7 +30,7 @@ typedef const char*  fmiString;
 #define SIZEOF_ELM 39
 extern const char *elmNames[SIZEOF_ELM];
 
-#define SIZEOF_ATT 49
+#define SIZEOF_ATT 50
 extern const char *attNames[SIZEOF_ATT];
 
 #define SIZEOF_ENU 17
@@ -59,7 +60,7 @@ typedef enum {
   att_canNotUseMemoryManagementFunctions,att_file,att_entryPoint,att_manualStart,att_type,
 
   // component graph
-  att_connection,att_fmuPath
+  att_connection,att_fmuPath,att_stepRatio
 } Att;
 
 // Enumeration values
@@ -74,10 +75,14 @@ typedef enum {
 // AST node for element 
 // DisplayUnitDefinition, RealType, IntegerType, BooleanType, StringType, DefaultExperiment, 
 // Item, Annotation, Name, Real, Integer, Boolean, String, Enumeration, Capabilities, File
+// In all AST nodes, the attributes are stored as name/value pairs ordered by Att,
+// so attribute a is found at index 2*k of attributes, where k is the number of
+// bits set in attMask below bit a.
 typedef struct {
     Elm type;          // element type 
     const char** attributes; // null or n attribute value strings
     int n;             // size of attributes, even number
+    unsigned long long attMask; // bit a is set if attribute a is present
 } Element;
 
 // AST node for element that has a list of elements 
@@ -86,6 +91,7 @@ typedef struct {
     Elm type;          // element type 
     const char** attributes; // null or n attribute value strings
     int n;             // size of attributes, even number
+    unsigned long long attMask; // bit a is set if attribute a is present
     Element** list;    // null-terminated array of pointers to elements, not null
 } ListElement;
 
@@ -94,6 +100,7 @@ typedef struct {
     Elm type;          // element type 
     const char** attributes; // null or n attribute value strings
     int n;             // size of attributes, an even number
+    unsigned long long attMask; // bit a is set if attribute a is present
     Element* typeSpec; // one of RealType, IntegerType etc. 
 } Type;
 
@@ -102,15 +109,32 @@ typedef struct {
     Elm type;          // element type 
     const char** attributes; // null or n attribute value strings
     int n;             // size of attributes, even number
+    unsigned long long attMask; // bit a is set if attribute a is present
     Element* typeSpec; // one of Real, Integer, etc
     Element** directDependencies; // null or null-terminated list of Name
+    fmiValueReference vr; // value of attribute valueReference, see getValueReference
 } ScalarVariable;
 
+// Hash indexes of the model variables by name and by value reference,
+// built by validate(), see indexVariables in xml_parser.c.
+// Open addressing with linear probing. Each table has a power of 2 size
+// of at least twice its number of entries, empty slots are NULL.
+typedef struct {
+    ScalarVariable** slots;
+    unsigned int mask;       // number of slots - 1
+} VariableTable;
+
+typedef struct VariableIndex {
+    VariableTable byName;
+    VariableTable byVr[4];   // per base type Real, Integer or Enumeration, Boolean, String
+} VariableIndex;
+
 // AST node for element CoSimulation_StandAlone and CoSimulation_Tool
 typedef struct {
     Elm type; // one of elm_CoSimulation_StandAlone and elm_CoSimulation_Tool
     const char** attributes; // null or n attribute value strings
     int n;                   // size of attributes, even number
+    unsigned long long attMask; // bit a is set if attribute a is present
     Element* capabilities;   // a set of capability attributes
     ListElement* model;      // non-NULL to support tool coupling, NULL for standalone 
 } CoSimulation;
@@ -120,12 +144,15 @@ typedef struct {
     Elm type;          // element type
     const char** attributes; // null or n attribute value strings
     int n;             // size of attributes, even number
+    unsigned long long attMask; // bit a is set if attribute a is present
     ListElement** unitDefinitions;    // NULL or null-terminated list of BaseUnits
     Type**        typeDefinitions;    // NULL or null-terminated list of Types 
     Element*      defaultExperiment;  // NULL or DefaultExperiment
     ListElement** vendorAnnotations;  // NULL or null-terminated list of Tools
     ScalarVariable** modelVariables;  // NULL or null-terminated list of ScalarVariable
     CoSimulation* cosimulation;       // NULL if this ModelDescription is for model exchange only
+    Arena* arena;                     // holds all nodes and strings of this AST
+    VariableIndex* index;             // NULL or index of modelVariables, set by validate
 } ModelDescription;
 
 // AST node for element Connection
@@ -133,7 +160,9 @@ typedef struct {
     Elm type;
     const char** attributes;
     int n;
-    void* value;                // connection's current value
+    unsigned long long attMask; // bit a is set if attribute a is present
+    Enu valueType;              // type of its value: enu_Real, enu_Integer, enu_Boolean or enu_String, enu_none if unused
+    int signal;                 // index of its value among the connections of its type, see validateGraph
 } Connection;
 
 // AST node for element Port
@@ -141,6 +170,7 @@ typedef struct {
     Elm type;
     const char** attributes;
     int n;
+    unsigned long long attMask; // bit a is set if attribute a is present
     Connection* connection;     // reference to linked Connection
     void* variable;             // reference to ScalarVariable
 } Port;
@@ -150,10 +180,12 @@ typedef struct {
     Elm type;
     const char** attributes;
     int n;
+    unsigned long long attMask; // bit a is set if attribute a is present
     Port** inputs;              // list of input ports
     Port** outputs;             // list of output ports
     void* fmu;                  // reference to FMU structure
     fmiComponent instance;      // instance of the fmu (after call to fmiInstantiateSlave)
+    ScalarVariable** recorded;  // NULL to record all non-alias variables, see outputRow
 } Component;
 
 // AST node for element Graph
@@ -161,8 +193,10 @@ typedef struct {
     Elm type;                   // element type
     const char** attributes;    // null or n attribute value strings
     int n;                      // size of attributes, even number
+    unsigned long long attMask; // bit a is set if attribute a is present
     Component** components;     // list of Components
     Connection** connections;   // list of Connections
+    Arena* arena;               // holds all nodes and strings
 } Graph;
 
 // types of AST nodes used to represent an element
@@ -181,6 +215,8 @@ typedef enum {
     astGraph
 } AstNodeType;
 
+AstNodeType getAstNodeType(Elm e);
+
 // Possible results when retrieving an attribute value from an element
 typedef enum { 
     valueMissing,
@@ -188,9 +224,36 @@ typedef enum {
     valueIllegal
 } ValueStatus;
 
+// State of the parser. Threads may parse at the same time using
+// different contexts, see xml_parser.c
+typedef struct ParserContext ParserContext;
+
+// Tokenizers of the parser: expat, which reads files in chunks and copies
+// all strings, or the in-situ tokenizer of xml_scanner.h, which maps a
+// file and tokenizes it in place. Both build the same AST.
+typedef enum {
+    tokenizerExpat,
+    tokenizerInSitu
+} Tokenizer;
+
 // Public methods: Parsing and low-level AST access
 ModelDescription* parse(const char* xmlPath);
+ModelDescription* parseBuffer(const char* text, size_t n, const char* name);
 Graph* parseGraph(const char* xmlPath);
+Graph* validateGraph(Graph* graph);
+ParserContext* parserContextNew();
+void parserContextFree(ParserContext* ctx);
+ModelDescription* parseWithContext(ParserContext* ctx, const char* xmlPath);
+ModelDescription* parseBufferWithContext(ParserContext* ctx, const char* text, size_t n, const char* name);
+Graph* parseGraphWithContext(ParserContext* ctx, const char* xmlPath);
+int parserContextSelect(ParserContext* ctx, const char** names);
+void parserContextSetTokenizer(ParserContext* ctx, Tokenizer t);
+void setDefaultTokenizer(Tokenizer t);
+int parserContextSkipped(ParserContext* ctx);
+unsigned int hashName(const char* name, unsigned int seed);
+int getElmIndex(const char* name);
+int getAttIndex(const char* name);
+int getEnuIndex(const char* name);
 const char* getString(void* element, Att a);
 double getDouble     (void* element, Att a, ValueStatus* vs);
 int getInt           (void* element, Att a, ValueStatus* vs);
@@ -210,6 +273,7 @@ Enu getAlias(void* scalarVariable);
 fmiValueReference getValueReference(void* scalarVariable);
 ScalarVariable* getVariableByName(ModelDescription* md, const char* name);
 ScalarVariable* getVariable(ModelDescription* md, fmiValueReference vr, Elm type);
+int sameBaseType(Elm t1, Elm t2);
 Type* getDeclaredType(ModelDescription* md, const char* declaredType);
 const char* getString2(ModelDescription* md, void* sv, Att a);
 const char * getDescription(ModelDescription* md, ScalarVariable* sv);
@@ -0,0 +1,694 @@
+/* -------------------------------------------------------------------------
+ * xml_scanner.c
+ * An in-situ XML tokenizer, see xml_scanner.h
+ * Text and attribute values are scanned 16 bytes at a time using SSE2,
+ * where available, for the few chars that end them or need decoding.
+ * Names are short and scanned char by char.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "xml_scanner.h"
+
+#define INITIAL_SIZE 16
+
+// messages of expat for the errors detected
+static const char errSyntax[] = "not well-formed (invalid token)";
+static const char errProlog[] = "syntax error";
+static const char errUnclosed[] = "unclosed token";
+static const char errUnclosedCdata[] = "unclosed CDATA section";
+static const char errNoElem[] = "no element found";
+static const char errMismatch[] = "mismatched tag";
+static const char errJunk[] = "junk after document element";
+static const char errDuplicate[] = "duplicate attribute";
+static const char errEntity[] = "undefined entity";
+static const char errCharRef[] = "reference to invalid character number";
+static const char errMemory[] = "out of memory";
+static const char errMisplacedDecl[] = "XML or text declaration not at start of entity";
+
+#define isSpace(c) ((c) == ' ' || (c) == '\n' || (c) == '\t' || (c) == '\r')
+
+static int isNameStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':'
+        || (unsigned char)c >= 0x80;
+}
+
+static int isNameChar(char c) {
+    return isNameStart(c) || (c >= '0' && c <= '9') || c == '-' || c == '.';
+}
+
+// index of the lowest set bit of bits, which is not 0
+static int lowestBit(unsigned int bits) {
+#ifdef __GNUC__
+    return __builtin_ctz(bits);
+#else
+    int k = 0;
+    for (; !(bits & 1); bits >>= 1) k++;
+    return k;
+#endif
+}
+
+// Returns the first char at or after p that is c1, c2 or c3, or a control
+// char below ' '. Returns end if there is none.
+static char* scan(char* p, char* end, char c1, char c2, char c3) {
+#ifdef __SSE2__
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+    const __m128i v3 = _mm_set1_epi8(c3);
+    const __m128i ctl = _mm_set1_epi8(0x1f); // max(x, 0x1f) == 0x1f for x < ' ' only
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2)),
+            _mm_or_si128(_mm_cmpeq_epi8(x, v3), _mm_cmpeq_epi8(_mm_max_epu8(x, ctl), ctl)));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return p + lowestBit(mask);
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == c1 || *p == c2 || *p == c3 || (unsigned char)*p < ' ') return p;
+    }
+    return end;
+}
+
+// Returns the first occurrence of s at or after p, NULL if there is none
+static char* find(char* p, char* end, const char* s) {
+    size_t n = strlen(s);
+    while (end - p >= (ptrdiff_t)n) {
+        p = (char*)memchr(p, s[0], end - p - n + 1);
+        if (!p) return NULL;
+        if (!memcmp(p, s, n)) return p;
+        p++;
+    }
+    return NULL;
+}
+
+// Returns the first char at or after p that XML does not allow, a control
+// char other than white space, or end if there is none
+static char* invalidChar(char* p, char* end) {
+    for (;; p++) {
+        p = scan(p, end, '\0', '\0', '\0');
+        if (p == end || !isSpace(*p)) return p;
+    }
+}
+
+// Replaces the line ends of the n chars at p by '\n' in place and
+// returns the new number of chars
+static int normalizeLineEnds(char* p, int n) {
+    char* out = (char*)memchr(p, '\r', n);
+    char* end = p + n;
+    if (!out) return n;
+    for (p = out; p < end; p++) {
+        if (*p == '\r') {
+            *out++ = '\n';
+            if (p + 1 < end && p[1] == '\n') p++;
+        }
+        else *out++ = *p;
+    }
+    return n - (int)(end - out);
+}
+
+// 1 if some char of text is not ASCII
+static int hasHighBytes(const char* p, const char* end) {
+#ifdef __SSE2__
+    while (end - p >= 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p))) return 1;
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if ((unsigned char)*p >= 0x80) return 1;
+    }
+    return 0;
+}
+
+// 1 if text is valid UTF-8. Overlong forms, surrogates and code points
+// above U+10FFFF are invalid.
+static int isUtf8(const char* text, const char* end) {
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* e = (const unsigned char*)end;
+    int i, n;
+    while (p < e) {
+#ifdef __SSE2__
+        if (e - p >= 16 && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p))) {
+            p += 16;
+            continue;
+        }
+#endif
+        if (*p < 0x80) {
+            p++;
+            continue;
+        }
+        if (*p >= 0xc2 && *p <= 0xdf) n = 1;
+        else if (*p >= 0xe0 && *p <= 0xef) n = 2;
+        else if (*p >= 0xf0 && *p <= 0xf4) n = 3;
+        else return 0;
+        if (e - p <= n) return 0;
+        for (i = 1; i <= n; i++) {
+            if ((p[i] & 0xc0) != 0x80) return 0;
+        }
+        if ((*p == 0xe0 && p[1] < 0xa0) || (*p == 0xed && p[1] >= 0xa0)
+            || (*p == 0xf0 && p[1] < 0x90) || (*p == 0xf4 && p[1] >= 0x90)) return 0;
+        p += n + 1;
+    }
+    return 1;
+}
+
+static XmlToken fail(XmlScanner* s, char* p, const char* error) {
+    s->pos = p;
+    s->error = error;
+    return tokError;
+}
+
+// Returns NULL to indicate error, see s->pos and s->error
+// Decodes the reference at p, which starts with '&', into out, which is
+// at or before p, and sets *next to the char after it, also if its entity
+// is undefined or its char is invalid. References only shrink when
+// decoded. Returns the end of the decoded chars.
+static char* decodeReference(XmlScanner* s, char* p, char* out, char** next) {
+    char* end = s->end;
+    char* q = p + 1;
+    unsigned long c = 0;
+    const char* error = errSyntax;
+    if (q < end && *q == '#') {
+        int hex = ++q < end && *q == 'x';
+        char* digits = q += hex;
+        for (; q < end; q++) {
+            int d = *q >= '0' && *q <= '9' ? *q - '0'
+                : hex && (*q | 0x20) >= 'a' && (*q | 0x20) <= 'f' ? (*q | 0x20) - 'a' + 10 : -1;
+            if (d < 0) break;
+            c = (hex ? 16 : 10) * c + d;
+            if (c > 0x10ffff) c = 0x110000; // invalid, avoids overflow
+        }
+        if (q == digits) q = NULL;
+    }
+    else if (q < end && isNameStart(*q)) {
+        char* name = q;
+        while (q < end && isNameChar(*q)) q++;
+        if      (q - name == 2 && !memcmp(name, "lt", 2))   c = '<';
+        else if (q - name == 2 && !memcmp(name, "gt", 2))   c = '>';
+        else if (q - name == 3 && !memcmp(name, "amp", 3))  c = '&';
+        else if (q - name == 4 && !memcmp(name, "quot", 4)) c = '"';
+        else if (q - name == 4 && !memcmp(name, "apos", 4)) c = '\'';
+        else if (q < end && *q == ';') {
+            s->pos = p;
+            s->error = errEntity;
+            *next = q + 1;
+            return NULL;
+        }
+        if (!c) q = NULL;
+    }
+    else q = NULL;
+    if (q == end) error = errUnclosed;
+    if (!q || q == end || *q != ';') {
+        s->pos = q && q < end && *q != ';' ? q : p;
+        s->error = error;
+        return NULL;
+    }
+    *next = q + 1;
+    if ((c < ' ' && c != '\t' && c != '\n' && c != '\r') || (c >= 0xd800 && c < 0xe000) || c > 0x10ffff) {
+        s->pos = p;
+        s->error = errCharRef;
+        return NULL;
+    }
+    // encode as UTF-8
+    if (c < 0x80) {
+        *out++ = (char)c;
+    }
+    else if (c < 0x800) {
+        *out++ = (char)(0xc0 | c >> 6);
+        *out++ = (char)(0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000) {
+        *out++ = (char)(0xe0 | c >> 12);
+        *out++ = (char)(0x80 | (c >> 6 & 0x3f));
+        *out++ = (char)(0x80 | (c & 0x3f));
+    }
+    else {
+        *out++ = (char)(0xf0 | c >> 18);
+        *out++ = (char)(0x80 | (c >> 12 & 0x3f));
+        *out++ = (char)(0x80 | (c >> 6 & 0x3f));
+        *out++ = (char)(0x80 | (c & 0x3f));
+    }
+    return out;
+}
+
+// Returns NULL to indicate error, see s->pos and s->error
+// Decodes the attribute value at p, up to the given quote, in place and
+// terminates it. White space chars are replaced by ' ', as required by XML.
+// Returns the char after the quote. Like expat, reports an undefined
+// entity or an invalid char reference after the tag only: sets *deferred
+// to the first of these errors, at *deferredPos, if *deferred is NULL.
+static char* scanValue(XmlScanner* s, char* p, char quote, const char** deferred, char** deferredPos) {
+    char* out = p = scan(p, s->end, quote, '&', '<');
+    while (p < s->end && *p != quote) {
+        if (*p == '&') {
+            char* ref = p;
+            char* decoded = decodeReference(s, p, out, &p);
+            if (!decoded && s->error != errEntity && s->error != errCharRef) return NULL;
+            if (!decoded && !*deferred) {
+                *deferred = s->error;
+                *deferredPos = ref;
+            }
+            if (decoded) out = decoded;
+        }
+        else if (*p == '\r') {
+            *out++ = ' ';
+            p += p + 1 < s->end && p[1] == '\n' ? 2 : 1;
+        }
+        else if (*p == '\n' || *p == '\t') {
+            *out++ = ' ';
+            p++;
+        }
+        else if (*p == '<' || (unsigned char)*p < ' ') {
+            s->pos = p;
+            s->error = errSyntax;
+            return NULL;
+        }
+        else *out++ = *p++;
+    }
+    if (p == s->end) {
+        s->pos = p;
+        s->error = errUnclosed;
+        return NULL;
+    }
+    *out = '\0';
+    return p + 1;
+}
+
+// Returns NULL to indicate error, see s->pos and s->error
+// Decodes the text at p, up to the next '<', in place. Line ends are
+// replaced by '\n', as required by XML. Returns the '<' or the end.
+static char* scanText(XmlScanner* s, char* p) {
+    char* out;
+    s->text = p;
+    out = p = scan(p, s->end, '<', '&', ']');
+    while (p < s->end && *p != '<') {
+        if (*p == '&') {
+            out = decodeReference(s, p, out, &p);
+            if (!out) return NULL;
+        }
+        else if (*p == '\r') {
+            *out++ = '\n';
+            p += p + 1 < s->end && p[1] == '\n' ? 2 : 1;
+        }
+        else if ((*p == ']' && s->end - p >= 3 && !memcmp(p, "]]>", 3))
+                || ((unsigned char)*p < ' ' && !isSpace(*p))) {
+            s->pos = *p == ']' ? p + 2 : p;
+            s->error = errSyntax;
+            return NULL;
+        }
+        else *out++ = *p++;
+    }
+    s->len = (int)(out - s->text);
+    return p;
+}
+
+// Returns 0 to indicate failure
+static int grow(const char*** array, int* size, int n) {
+    const char** a;
+    int newSize;
+    if (n <= *size) return 1;
+    newSize = *size ? 2 * *size : INITIAL_SIZE;
+    while (newSize < n) newSize *= 2;
+    a = (const char**)realloc((void*)*array, newSize * sizeof(const char*));
+    if (!a) return 0;
+    *array = a;
+    *size = newSize;
+    return 1;
+}
+
+// Fails at the char at p outside of the root element, which is not white
+// space, as expat does: it reads a token of a DTD there, a name, a literal
+// or a delimiter, which is a syntax error before and junk after the root
+// element, unless followed by a char that may not follow a token.
+static XmlToken outsideRoot(XmlScanner* s, char* p) {
+    const char* error = s->seenRoot ? errJunk : errProlog;
+    char* q;
+    if (*p == '"' || *p == '\'') {
+        q = (char*)memchr(p + 1, *p, s->end - p - 1);
+        if (!q) return fail(s, p, errUnclosed);
+        q++;
+    }
+    else if (*p == '#' || isNameChar(*p)) {
+        for (q = p + 1; q < s->end && isNameChar(*q); q++);
+        if (*p == '#' && q == p + 1) return fail(s, q == s->end ? p : q, q == s->end ? errUnclosed : errSyntax);
+        // only a name may be followed by '?', '*' or '+'
+        if (!isNameStart(*p) && q < s->end && *q && strchr("?*+", *q)) return fail(s, q, errSyntax);
+    }
+    else if (*p == '%') {
+        // a parameter entity reference, not supported
+        for (q = p + 1; q < s->end && isNameChar(*q); q++);
+        if (q == s->end) return fail(s, p, errUnclosed);
+        return q == p + 1 && isSpace(*q) ? fail(s, p, error) : fail(s, q, errSyntax);
+    }
+    else if (*p && strchr("(,>[]|", *p)) return fail(s, p, error);
+    else return fail(s, p, errSyntax);
+    if (q < s->end && !isSpace(*q) && !(*q && strchr(">),|[%?*+", *q))) return fail(s, q, errSyntax);
+    return fail(s, p, error);
+}
+
+// Fails at "<!" at p, which starts neither a comment nor a CDATA section,
+// as expat does: outside of the root element, a declaration of a DTD
+// is a syntax error before and junk after the root element
+static XmlToken declaration(XmlScanner* s, char* p) {
+    char* q = p + 2;
+    if (q == s->end) return fail(s, p, errUnclosed);
+    if (*q == '-') return fail(s, q + 1 == s->end ? p : q + 1, q + 1 == s->end ? errUnclosed : errSyntax);
+    if (s->depth > 0) {
+        if (s->end - p < 9 && !memcmp(p, "<![CDATA[", s->end - p)) return fail(s, p, errUnclosed);
+        return fail(s, q, errSyntax);
+    }
+    if (*q == '[') return fail(s, p, s->seenRoot ? errJunk : errProlog);
+    if (!isNameStart(*q)) return fail(s, q, errSyntax);
+    while (q < s->end && isNameChar(*q)) q++;
+    if (q == s->end) return fail(s, p, errUnclosed);
+    if (!isSpace(*q)) return fail(s, q, errSyntax);
+    return fail(s, p, s->seenRoot ? errJunk : errProlog);
+}
+
+// Returns NULL to indicate error, see s->pos and s->error
+// Skips the processing instruction at p, which starts with "<?", and
+// returns the char after it. Its target is a name other than "xml",
+// which may start the document only, see xmlScannerReset.
+static char* processingInstruction(XmlScanner* s, char* p) {
+    char* target = p + 2;
+    char* q = target;
+    char* piEnd;
+    if (p == s->decl) return find(p, s->end, "?>") + 2;
+    while (q < s->end && isNameChar(*q)) q++;
+    if (q < s->end && (q == target || !isNameStart(*target) || (!isSpace(*q)
+            && (*q != '?' || (q + 1 < s->end && q[1] != '>'))))) {
+        fail(s, q, errSyntax);
+        return NULL;
+    }
+    piEnd = find(q, s->end, "?>");
+    if (!piEnd) {
+        fail(s, p, errUnclosed);
+        return NULL;
+    }
+    if (invalidChar(q, piEnd) != piEnd) {
+        fail(s, invalidChar(q, piEnd), errSyntax);
+        return NULL;
+    }
+    if (q - target == 3 && (target[0] | 0x20) == 'x' && (target[1] | 0x20) == 'm' && (target[2] | 0x20) == 'l') {
+        fail(s, p, memcmp(target, "xml", 3) ? errSyntax : errMisplacedDecl);
+        return NULL;
+    }
+    return piEnd + 2;
+}
+
+// Scans the start tag at p, which is after the '<'. Like expat, reports
+// a duplicate attribute, an undefined entity or an invalid char reference
+// after the tag is scanned.
+static XmlToken startTag(XmlScanner* s, char* p) {
+    char* end = s->end;
+    char* name = p;
+    char* nameEnd;
+    const char* deferred = NULL; // the first error reported after the tag
+    char* deferredPos = NULL;
+    int i, n = 0;
+    if (s->depth == 0 && s->seenRoot) return fail(s, p - 1, errJunk);
+    if (p == end || !isNameStart(*p)) return fail(s, p == end ? p - 1 : p, p == end ? errUnclosed : errSyntax);
+    while (p < end && isNameChar(*p)) p++;
+    nameEnd = p;
+    for (;;) {
+        char* attName;
+        char* attNameEnd;
+        char* space = p;
+        while (p < end && isSpace(*p)) p++;
+        if (p == end) return fail(s, name - 1, errUnclosed);
+        if (*p == '>') {
+            p++;
+            break;
+        }
+        if (*p == '/') {
+            if (p + 1 == end) return fail(s, name - 1, errUnclosed);
+            if (p[1] != '>') return fail(s, p, errSyntax);
+            s->emptyElement = 1;
+            p += 2;
+            break;
+        }
+        // an attribute, preceded by white space
+        if (p == space || !isNameStart(*p)) return fail(s, p, errSyntax);
+        attName = p;
+        while (p < end && isNameChar(*p)) p++;
+        attNameEnd = p;
+        while (p < end && isSpace(*p)) p++;
+        if (p == end) return fail(s, name - 1, errUnclosed);
+        if (*p != '=') return fail(s, p, errSyntax);
+        for (p++; p < end && isSpace(*p); p++);
+        if (p == end) return fail(s, name - 1, errUnclosed);
+        if (*p != '"' && *p != '\'') return fail(s, p, errSyntax);
+        *attNameEnd = '\0';
+        for (i = 0; i < n && !deferred; i += 2) {
+            if (!strcmp(s->attr[i], attName)) {
+                deferred = errDuplicate;
+                deferredPos = attName;
+            }
+        }
+        if (!grow(&s->attr, &s->attrSize, n + 3)) return fail(s, p, errMemory);
+        s->attr[n++] = attName;
+        s->attr[n++] = p + 1;
+        p = scanValue(s, p + 1, *p, &deferred, &deferredPos);
+        if (!p) return fail(s, s->error == errUnclosed ? name - 1 : s->pos, s->error);
+    }
+    // expat reports an undefined entity at the start of the tag
+    if (deferred) return fail(s, deferred == errEntity ? name - 1 : deferredPos, deferred);
+    if (!grow(&s->attr, &s->attrSize, n + 1) || !grow(&s->open, &s->openSize, s->depth + 1)) {
+        return fail(s, p, errMemory);
+    }
+    *nameEnd = '\0';
+    s->attr[n] = NULL;
+    s->open[s->depth++] = name;
+    s->name = name;
+    s->attributes = s->attr;
+    s->seenRoot = 1;
+    s->pos = p;
+    return tokStartElement;
+}
+
+// Scans the end tag at p, which is after the "</"
+static XmlToken endTag(XmlScanner* s, char* p) {
+    char* name = p;
+    size_t n;
+    if (s->depth == 0) return fail(s, p - 1, errSyntax);
+    if (p < s->end && isNameStart(*p)) {
+        while (p < s->end && isNameChar(*p)) p++;
+    }
+    n = p - name;
+    if (n == 0 && p < s->end) return fail(s, p, errSyntax);
+    while (p < s->end && isSpace(*p)) p++;
+    if (p == s->end) return fail(s, name - 2, errUnclosed);
+    if (*p != '>') return fail(s, p, errSyntax);
+    if (strlen(s->open[s->depth - 1]) != n || memcmp(s->open[s->depth - 1], name, n)) {
+        return fail(s, name, errMismatch);
+    }
+    s->name = s->open[--s->depth];
+    s->pos = p + 1;
+    return tokEndElement;
+}
+
+// Returns the end of the pseudo-attribute of the given name at p of the XML
+// declaration, preceded by white space, and sets *value and *valueEnd.
+// Returns p if there is no such attribute, NULL if it is not well-formed.
+static char* pseudoAttribute(char* p, char* end, const char* name, char** value, char** valueEnd) {
+    size_t n = strlen(name);
+    char* q = p;
+    while (q < end && isSpace(*q)) q++;
+    if (q == p || end - q < (ptrdiff_t)n || memcmp(q, name, n)) return p;
+    for (q += n; q < end && isSpace(*q); q++);
+    if (q == end || *q != '=') return NULL;
+    for (q++; q < end && isSpace(*q); q++);
+    if (q == end || (*q != '"' && *q != '\'')) return NULL;
+    *value = q + 1;
+    *valueEnd = (char*)memchr(q + 1, *q, end - q - 1);
+    return *valueEnd ? *valueEnd + 1 : NULL;
+}
+
+// 1 if the n chars at p are a version number: 1.digits
+static int isVersion(const char* p, ptrdiff_t n) {
+    ptrdiff_t i;
+    if (n < 3 || p[0] != '1' || p[1] != '.') return 0;
+    for (i = 2; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') return 0;
+    }
+    return 1;
+}
+
+// 1 if the n chars at p are an encoding name
+static int isEncodingName(const char* p, ptrdiff_t n) {
+    ptrdiff_t i;
+    if (n < 1 || !((p[0] | 0x20) >= 'a' && (p[0] | 0x20) <= 'z')) return 0;
+    for (i = 1; i < n; i++) {
+        if (!isNameChar(p[i]) || p[i] == ':' || (unsigned char)p[i] >= 0x80) return 0;
+    }
+    return 1;
+}
+
+// Returns NULL if the XML declaration at p, which starts with "<?xml",
+// is not well-formed. Otherwise returns the char after it and sets
+// *name to its encoding name, or to NULL if it has none, ending at *nameEnd.
+static char* xmlDeclaration(char* p, char* end, char** name, char** nameEnd) {
+    char* declEnd = find(p, end, "?>");
+    char* value;
+    char* valueEnd;
+    char* q;
+    *name = NULL;
+    if (!declEnd) return NULL;
+    q = pseudoAttribute(p + 5, declEnd, "version", &value, &valueEnd);
+    if (!q || q == p + 5 || !isVersion(value, valueEnd - value)) return NULL;
+    p = q;
+    q = pseudoAttribute(p, declEnd, "encoding", &value, &valueEnd);
+    if (!q) return NULL;
+    if (q != p) {
+        if (!isEncodingName(value, valueEnd - value)) return NULL;
+        *name = value;
+        *nameEnd = valueEnd;
+        p = q;
+    }
+    q = pseudoAttribute(p, declEnd, "standalone", &value, &valueEnd);
+    if (!q) return NULL;
+    if (q != p) {
+        if ((valueEnd - value != 3 || memcmp(value, "yes", 3))
+            && (valueEnd - value != 2 || memcmp(value, "no", 2))) return NULL;
+        p = q;
+    }
+    while (p < declEnd && isSpace(*p)) p++;
+    return p == declEnd ? declEnd + 2 : NULL;
+}
+
+// 1 if a DOCTYPE precedes the root element
+static int hasDoctype(char* p, char* end) {
+    char* q;
+    for (;;) {
+        while (p < end && isSpace(*p)) p++;
+        if (end - p >= 4 && !memcmp(p, "<!--", 4)) q = find(p + 4, end, "-->");
+        else if (end - p >= 2 && !memcmp(p, "<?", 2)) q = find(p + 2, end, "?>");
+        else return end - p >= 9 && !memcmp(p, "<!DOCTYPE", 9);
+        if (!q) return 0; // reported by xmlScannerNext
+        p = q + (q[0] == '-' ? 3 : 2);
+    }
+}
+
+// 1 if the n chars at name are the given encoding name, ignoring case
+static int isEncoding(const char* name, size_t n, const char* encoding) {
+    size_t i;
+    if (n != strlen(encoding)) return 0;
+    for (i = 0; i < n; i++) {
+        if ((name[i] | 0x20) != (encoding[i] | 0x20)) return 0;
+    }
+    return 1;
+}
+
+// Returns NULL to indicate failure
+XmlScanner* xmlScannerNew() {
+    return (XmlScanner*)calloc(1, sizeof(XmlScanner));
+}
+
+void xmlScannerFree(XmlScanner* s) {
+    if (!s) return;
+    free((void*)s->open);
+    free((void*)s->attr);
+    free(s);
+}
+
+// Returns 0 if the document of n chars at text is not supported, see
+// xml_scanner.h, then text is not modified.
+// Otherwise, prepare s for tokenizing the document in place.
+int xmlScannerReset(XmlScanner* s, char* text, size_t n) {
+    char* end = text + n;
+    char* name;
+    char* nameEnd;
+    s->start = s->pos = text;
+    s->end = end;
+    s->depth = 0;
+    s->emptyElement = 0;
+    s->seenRoot = 0;
+    s->decl = NULL;
+    s->error = NULL;
+    if (n >= 2 && (((unsigned char)text[0] == 0xfe && (unsigned char)text[1] == 0xff)
+            || ((unsigned char)text[0] == 0xff && (unsigned char)text[1] == 0xfe))) {
+        return 0; // UTF-16
+    }
+    if (n >= 3 && !memcmp(text, "\xef\xbb\xbf", 3)) s->pos += 3; // UTF-8 byte order mark
+    name = NULL;
+    if (end - s->pos >= 6 && !memcmp(s->pos, "<?xml", 5) && !isNameChar(s->pos[5])) {
+        // let expat report an XML declaration that is not well-formed
+        if (!xmlDeclaration(s->pos, end, &name, &nameEnd)) return 0;
+        s->decl = s->pos;
+    }
+    if (name && !isEncoding(name, nameEnd - name, "UTF-8")) {
+        if (!isEncoding(name, nameEnd - name, "US-ASCII")
+                && !isEncoding(name, nameEnd - name, "ISO-8859-1")) return 0;
+        if (hasHighBytes(text, end)) return 0;
+    }
+    else if (!isUtf8(s->pos, end)) return 0; // let expat report the error
+    return !hasDoctype(s->pos, end);
+}
+
+// Returns the next token of the document
+XmlToken xmlScannerNext(XmlScanner* s) {
+    char* p = s->pos;
+    char* end = s->end;
+    char* q;
+    if (s->emptyElement) {
+        s->emptyElement = 0;
+        s->name = s->open[--s->depth];
+        return tokEndElement;
+    }
+    for (;;) {
+        if (p == end) {
+            if (s->depth > 0 || !s->seenRoot) return fail(s, p, errNoElem);
+            s->pos = p;
+            return tokEndOfDocument;
+        }
+        if (*p != '<' && s->depth == 0) {
+            // only white space outside of the root element
+            if (!isSpace(*p)) return outsideRoot(s, p);
+            p++;
+        }
+        else if (*p != '<') {
+            q = scanText(s, p);
+            if (!q) return fail(s, s->pos, s->error);
+            s->pos = p = q;
+            if (s->len > 0) return tokText;
+        }
+        else if (end - p >= 4 && !memcmp(p, "<!--", 4)) {
+            // "--" must not occur in a comment but at its end
+            q = find(p + 4, end, "--");
+            if (q && invalidChar(p + 4, q) != q) return fail(s, invalidChar(p + 4, q), errSyntax);
+            if (!q || q + 2 == end) return fail(s, p, errUnclosed);
+            if (q[2] != '>') return fail(s, q, errSyntax);
+            p = q + 3;
+        }
+        else if (end - p >= 2 && p[1] == '?') {
+            q = processingInstruction(s, p);
+            if (!q) return tokError;
+            p = q;
+        }
+        else if (end - p >= 9 && !memcmp(p, "<![CDATA[", 9)) {
+            if (s->depth == 0) return fail(s, p, s->seenRoot ? errJunk : errProlog);
+            q = find(p + 9, end, "]]>");
+            if (!q) return fail(s, end, errUnclosedCdata);
+            if (invalidChar(p + 9, q) != q) return fail(s, invalidChar(p + 9, q), errSyntax);
+            s->text = p + 9;
+            s->len = normalizeLineEnds(p + 9, (int)(q - p - 9));
+            s->pos = q + 3;
+            if (s->len > 0) return tokText;
+            p = q + 3;
+        }
+        else if (end - p >= 2 && p[1] == '/') {
+            return endTag(s, p + 2);
+        }
+        else if (end - p >= 2 && p[1] == '!') {
+            return declaration(s, p);
+        }
+        else {
+            return startTag(s, p + 1);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/* -------------------------------------------------------------------------
+ * xml_scanner.h
+ * An in-situ XML tokenizer, the alternative to expat used by the parser
+ * with tokenizerInSitu, see xml_parser.h. The document is tokenized in
+ * place: names and attribute values are terminated with '\0' and entities
+ * are decoded inside the given buffer, so the tokens point into it and no
+ * string is copied.
+ * Supports what model descriptions and graphs use: elements, attributes,
+ * character data, CDATA sections, comments and processing instructions,
+ * in UTF-8, or in another declared encoding if the document is ASCII.
+ * xmlScannerReset rejects other documents, e.g. those with a DOCTYPE,
+ * which may define entities, or with invalid UTF-8. Errors are reported
+ * with the messages of expat, at the same position. Unlike expat, the
+ * scanner accepts any non-ASCII char in names and does not tell apart
+ * all the errors in a prolog that looks like a DTD.
+ * -------------------------------------------------------------------------*/
+
+#ifndef XML_SCANNER_H
+#define XML_SCANNER_H
+
+#include <stddef.h>
+
+typedef enum {
+    tokStartElement,   // name and attributes
+    tokEndElement,     // name, also reported for an empty element <a/>
+    tokText,           // len chars of text, not terminated
+    tokEndOfDocument,
+    tokError           // error, at byte offset pos - start
+} XmlToken;
+
+typedef struct {
+    const char* name;        // element name of tokStartElement and tokEndElement
+    const char** attributes; // of tokStartElement, null-terminated name/value pairs
+    const char* text;        // of tokText
+    int len;
+    const char* error;       // message of tokError, as given by expat
+
+    char* start;             // the document
+    char* pos;               // the next char to scan
+    char* end;               // the end of the document
+    const char** open;       // names of the open elements
+    int depth;               // number of open elements
+    int openSize;            // size of open
+    const char** attr;       // holds the attributes of the current element
+    int attrSize;            // size of attr
+    int emptyElement;        // 1 if the current element is empty, <a/>
+    int seenRoot;            // 1 after the start of the root element
+    char* decl;              // the XML declaration, NULL if there is none
+} XmlScanner;
+
+XmlScanner* xmlScannerNew();
+void xmlScannerFree(XmlScanner* s);
+int xmlScannerReset(XmlScanner* s, char* text, size_t n);
+XmlToken xmlScannerNext(XmlScanner* s);
+
+#endif // XML_SCANNER_H
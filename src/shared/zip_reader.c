@@ -0,0 +1,306 @@
+/* -------------------------------------------------------------------------
+ * zip_reader.c
+ * A minimal reader for the zip archives used as FMU container.
+ * The central directory is read once by zipOpen(). Single entries are
+ * then inflated into memory or into a file using zlib, so that only the
+ * files needed to run the FMU are ever written to disk.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "zip_reader.h"
+#include "log_buffer.h"
+
+#ifdef _MSC_VER
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#define ZIP_EOCD_SIGNATURE    0x06054b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_LOCAL_SIGNATURE   0x04034b50
+#define ZIP_EOCD_SIZE         22
+#define ZIP_CENTRAL_SIZE      46
+#define ZIP_LOCAL_SIZE        30
+#define ZIP_MAX_COMMENT       0xFFFF
+#define ZIP_STORED            0
+#define ZIP_DEFLATED          8
+
+// zip stores all numbers in little endian byte order
+static unsigned int readU16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned long readU32(const unsigned char* p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8)
+        | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+// Returns 0 to indicate error
+// Locate the end of central directory record, which is followed
+// by an optional comment of at most 64 KB.
+static int readEndOfCentralDirectory(FILE* file, unsigned long* cdOffset,
+        unsigned long* cdSize, int* nEntries) {
+    unsigned char* buffer;
+    long fileSize, n;
+    long i;
+    if (fseek(file, 0, SEEK_END)) return 0;
+    fileSize = ftell(file);
+    if (fileSize < ZIP_EOCD_SIZE) return 0;
+    n = fileSize < ZIP_EOCD_SIZE + ZIP_MAX_COMMENT ? fileSize : ZIP_EOCD_SIZE + ZIP_MAX_COMMENT;
+    buffer = (unsigned char*)malloc(n);
+    if (!buffer) return 0;
+    if (fseek(file, fileSize - n, SEEK_SET) || fread(buffer, 1, n, file) != (size_t)n) {
+        free(buffer);
+        return 0;
+    }
+    for (i = n - ZIP_EOCD_SIZE; i >= 0; i--) {
+        if (readU32(buffer + i) == ZIP_EOCD_SIGNATURE) {
+            *nEntries = readU16(buffer + i + 10);
+            *cdSize   = readU32(buffer + i + 12);
+            *cdOffset = readU32(buffer + i + 16);
+            free(buffer);
+            return 1; // success
+        }
+    }
+    free(buffer);
+    return 0; // not a zip file
+}
+
+// Returns NULL to indicate failure.
+// Reads the central directory of the given archive.
+// The receiver must call zipClose() to release the archive.
+ZipArchive* zipOpen(const char* zipPath) {
+    ZipArchive* zip;
+    unsigned char* cd;
+    unsigned char* p;
+    unsigned long cdOffset, cdSize;
+    int nEntries, i;
+    FILE* file = fopen(zipPath, "rb");
+    if (!file) {
+        logPrintf("error: Could not open %s\n", zipPath);
+        return NULL;
+    }
+    if (!readEndOfCentralDirectory(file, &cdOffset, &cdSize, &nEntries)) {
+        logPrintf("error: %s is not a zip file\n", zipPath);
+        fclose(file);
+        return NULL;
+    }
+    if (cdOffset == 0xFFFFFFFF || nEntries == 0xFFFF) {
+        logPrintf("error: %s is a zip64 archive, which is not supported\n", zipPath);
+        fclose(file);
+        return NULL;
+    }
+    cd = (unsigned char*)malloc(cdSize);
+    zip = (ZipArchive*)calloc(1, sizeof(ZipArchive));
+    if (zip) zip->entries = (ZipEntry*)calloc(nEntries > 0 ? nEntries : 1, sizeof(ZipEntry));
+    if (!cd || !zip || !zip->entries) {
+        logPrintf("error: Out of memory\n");
+        free(cd);
+        if (zip) free(zip->entries);
+        free(zip);
+        fclose(file);
+        return NULL;
+    }
+    zip->file = file;
+    if (fseek(file, cdOffset, SEEK_SET) || fread(cd, 1, cdSize, file) != cdSize) {
+        logPrintf("error: Could not read central directory of %s\n", zipPath);
+        free(cd);
+        zipClose(zip);
+        return NULL;
+    }
+    p = cd;
+    for (i = 0; i < nEntries; i++) {
+        ZipEntry* e = &zip->entries[i];
+        unsigned int nameLength, extraLength, commentLength;
+        if (p + ZIP_CENTRAL_SIZE > cd + cdSize || readU32(p) != ZIP_CENTRAL_SIGNATURE) {
+            logPrintf("error: Corrupt central directory in %s\n", zipPath);
+            free(cd);
+            zipClose(zip);
+            return NULL;
+        }
+        nameLength    = readU16(p + 28);
+        extraLength   = readU16(p + 30);
+        commentLength = readU16(p + 32);
+        e->method         = readU16(p + 10);
+        e->crc            = readU32(p + 16);
+        e->compressedSize = readU32(p + 20);
+        e->size           = readU32(p + 24);
+        e->localOffset    = readU32(p + 42);
+        e->name = (char*)malloc(nameLength + 1);
+        if (!e->name || p + ZIP_CENTRAL_SIZE + nameLength > cd + cdSize) {
+            logPrintf("error: Corrupt central directory in %s\n", zipPath);
+            free(cd);
+            zipClose(zip);
+            return NULL;
+        }
+        memcpy(e->name, p + ZIP_CENTRAL_SIZE, nameLength);
+        e->name[nameLength] = '\0';
+        zip->nEntries++;
+        p += ZIP_CENTRAL_SIZE + nameLength + extraLength + commentLength;
+    }
+    free(cd);
+    return zip;
+}
+
+// compare entry names, ignoring a leading "./" and the kind of path separator
+static int sameEntryName(const char* entryName, const char* name) {
+    if (!strncmp(entryName, "./", 2)) entryName += 2;
+    for (; *entryName && *name; entryName++, name++) {
+        char a = *entryName == '\\' ? '/' : *entryName;
+        char b = *name == '\\' ? '/' : *name;
+        if (a != b) return 0;
+    }
+    return *entryName == *name;
+}
+
+// Returns NULL if the archive has no entry with the given name
+ZipEntry* zipFindEntry(ZipArchive* zip, const char* name) {
+    int i;
+    for (i = 0; i < zip->nEntries; i++) {
+        if (sameEntryName(zip->entries[i].name, name)) return &zip->entries[i];
+    }
+    return NULL;
+}
+
+// Returns 0 to indicate error
+// Positions the archive at the start of the compressed data of entry.
+static int seekData(ZipArchive* zip, ZipEntry* entry) {
+    unsigned char header[ZIP_LOCAL_SIZE];
+    if (fseek(zip->file, entry->localOffset, SEEK_SET)
+            || fread(header, 1, ZIP_LOCAL_SIZE, zip->file) != ZIP_LOCAL_SIZE
+            || readU32(header) != ZIP_LOCAL_SIGNATURE) {
+        logPrintf("error: Corrupt local header of %s\n", entry->name);
+        return 0;
+    }
+    // name and extra field length may differ from those in the central directory
+    return !fseek(zip->file, readU16(header + 26) + readU16(header + 28), SEEK_CUR);
+}
+
+// Returns NULL to indicate failure.
+// Inflates the given entry into a new buffer of entry->size bytes,
+// followed by a terminating '\0'. The receiver must free the buffer.
+void* zipReadEntry(ZipArchive* zip, ZipEntry* entry) {
+    unsigned char* in = NULL;
+    unsigned char* out;
+    int ok = 0;
+    out = (unsigned char*)malloc(entry->size + 1);
+    if (!out) {
+        logPrintf("error: Out of memory\n");
+        return NULL;
+    }
+    if (!seekData(zip, entry)) {
+        free(out);
+        return NULL;
+    }
+    switch (entry->method) {
+        case ZIP_STORED:
+            ok = fread(out, 1, entry->size, zip->file) == entry->size;
+            break;
+        case ZIP_DEFLATED: {
+            z_stream zs;
+            int ret;
+            in = (unsigned char*)malloc(entry->compressedSize);
+            if (!in || fread(in, 1, entry->compressedSize, zip->file) != entry->compressedSize)
+                break;
+            memset(&zs, 0, sizeof(zs));
+            if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) break; // raw deflate data
+            zs.next_in = in;
+            zs.avail_in = entry->compressedSize;
+            zs.next_out = out;
+            zs.avail_out = entry->size;
+            ret = inflate(&zs, Z_FINISH);
+            ok = ret == Z_STREAM_END && zs.total_out == entry->size;
+            inflateEnd(&zs);
+            break;
+        }
+        default:
+            logPrintf("error: Unsupported compression method %u of %s\n", entry->method, entry->name);
+            free(out);
+            return NULL;
+    }
+    free(in);
+    if (!ok || crc32(crc32(0L, Z_NULL, 0), out, entry->size) != entry->crc) {
+        logPrintf("error: Could not inflate %s\n", entry->name);
+        free(out);
+        return NULL;
+    }
+    out[entry->size] = '\0';
+    return out;
+}
+
+// Create all missing parent directories of the given file path
+static void makeParentDirs(char* path) {
+    char* p;
+    for (p = path + 1; *p; p++) {
+        if (*p != '/' && *p != '\\') continue;
+        *p = '\0';
+        mkdir(path, 0755); // may already exist, checked by fopen below
+        *p = '/';
+    }
+}
+
+// true if name stays below the directory it is extracted to: it is not
+// absolute, has no drive prefix or backslash and no '..' component
+static int isSafeName(const char* name) {
+    const char* p;
+    if (!*name || *name == '/' || name[1] == ':' || strchr(name, '\\')) return 0;
+    for (p = name; p; p = strchr(p, '/')) {
+        if (*p == '/') p++;
+        if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || !p[2])) return 0;
+    }
+    return 1;
+}
+
+// Returns 0 to indicate error
+// Writes entry to outPath + entry->name, creating directories as needed.
+// outPath must end with a path separator.
+int zipExtractEntry(ZipArchive* zip, ZipEntry* entry, const char* outPath) {
+    FILE* out;
+    void* data;
+    char* path;
+    int ok;
+    const char* name = strncmp(entry->name, "./", 2) ? entry->name : entry->name + 2;
+    if (!isSafeName(name)) {
+        logPrintf("error: Invalid file name %s in the archive\n", entry->name);
+        return 0;
+    }
+    data = zipReadEntry(zip, entry);
+    if (!data) return 0;
+    path = (char*)malloc(strlen(outPath) + strlen(name) + 1);
+    if (!path) {
+        free(data);
+        return 0;
+    }
+    sprintf(path, "%s%s", outPath, name);
+    makeParentDirs(path);
+    out = fopen(path, "wb");
+    if (!out) {
+        logPrintf("error: Could not write %s\n", path);
+        free(path);
+        free(data);
+        return 0;
+    }
+    ok = fwrite(data, 1, entry->size, out) == entry->size;
+    ok = !fclose(out) && ok;
+    if (!ok) logPrintf("error: Could not write %s\n", path);
+    free(path);
+    free(data);
+    return ok;
+}
+
+// release the given archive
+void zipClose(ZipArchive* zip) {
+    int i;
+    if (!zip) return;
+    for (i = 0; i < zip->nEntries; i++)
+        free(zip->entries[i].name);
+    free(zip->entries);
+    if (zip->file) fclose(zip->file);
+    free(zip);
+}
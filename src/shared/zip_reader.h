@@ -0,0 +1,35 @@
+/* -------------------------------------------------------------------------
+ * zip_reader.h
+ * A minimal reader for the zip archives used as FMU container.
+ * Reads the central directory once and inflates single entries on demand.
+ * Supports the methods stored and deflate, no zip64 and no encryption.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ZIP_READER_H
+#define ZIP_READER_H
+
+#include <stdio.h>
+
+// entry of the central directory
+typedef struct {
+    char* name;                    // path of the entry inside the archive
+    unsigned int method;           // 0 = stored, 8 = deflate
+    unsigned int crc;              // crc32 of the uncompressed data
+    unsigned long compressedSize;
+    unsigned long size;            // uncompressed size
+    unsigned long localOffset;     // offset of the local file header
+} ZipEntry;
+
+typedef struct {
+    FILE* file;                    // the open archive
+    int nEntries;                  // number of entries in the central directory
+    ZipEntry* entries;             // the central directory
+} ZipArchive;
+
+ZipArchive* zipOpen(const char* zipPath);
+ZipEntry* zipFindEntry(ZipArchive* zip, const char* name);
+void* zipReadEntry(ZipArchive* zip, ZipEntry* entry);
+int zipExtractEntry(ZipArchive* zip, ZipEntry* entry, const char* outPath);
+void zipClose(ZipArchive* zip);
+
+#endif // ZIP_READER_H